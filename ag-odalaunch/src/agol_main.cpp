@@ -39,6 +39,7 @@
 #include "agol_manual.h"
 #include "game_command.h"
 #include "gui_config.h"
+#include "net_query.h"
 #include "typedefs.h"
 #include "icons.h"
 
@@ -1408,25 +1409,38 @@ int AGOL_MainWindow::QuerySingleServer(Server *server)
 {
 	odalpapi::BufferedSocket socket;
 	unsigned int serverTimeout;
+	unsigned int serverRetries;
 	int          ret;
 
 	if(GuiConfig::Read("ServerTimeout", serverTimeout) || serverTimeout == 0)
 		serverTimeout = 500;
 
+	if(GuiConfig::Read("ServerRetries", serverRetries) || serverRetries == 0)
+		serverRetries = 2;
+
 	server->GetLock();
 	server->SetSocket(&socket);
+	server->SetRetries(static_cast<int8_t>(serverRetries));
 	ret = server->Query(serverTimeout);
 	server->Unlock();
 
 	return ret;
 }
 
+// Passed to ServerQueried while all servers are queried
+struct QueryProgress
+{
+	AGOL_MainWindow *window;
+	QueryEngine     *engine;
+};
+
 void *AGOL_MainWindow::QueryAllServers(void *arg)
 {
-	size_t   count = 0;
-	size_t   serverCount = 0;
-	size_t   serversQueried = 0;
-	int      selectedNdx;
+	size_t       serverCount = 0;
+	unsigned int serverTimeout;
+	unsigned int serverRetries;
+	int          selectedNdx;
+	QueryEngine  engine;
 
 	MServer.GetLock();
 
@@ -1438,6 +1452,12 @@ void *AGOL_MainWindow::QueryAllServers(void *arg)
 	if(serverCount == 0)
 		return NULL;
 
+	if(GuiConfig::Read("ServerTimeout", serverTimeout) || serverTimeout == 0)
+		serverTimeout = 500;
+
+	if(GuiConfig::Read("ServerRetries", serverRetries) || serverRetries == 0)
+		serverRetries = 2;
+
 #ifdef _XBOX
 	Xbox::EnableJoystickUpdates(false);
 #endif
@@ -1448,44 +1468,15 @@ void *AGOL_MainWindow::QueryAllServers(void *arg)
 	ClearList(ServInfoList);
 	UpdateQueriedLabelCompleted(0);
 
-	while(count < serverCount)
-	{
-		for(size_t i = 0; i < NUM_THREADS; i++)
-		{
-			if((!QServerThread.empty()) && ((QServerThread.size() - 1) >= i))
-			{
-				// If a thread is no longer running delete it
-				if(QServerThread[i]->IsRunning())
-					continue;
-				else
-				{
-					QServerThread[i]->Join(NULL);
-					delete QServerThread[i];
-					QServerThread.erase(QServerThread.begin() + i);
-					count++;
-				}
-			}
-			if(serversQueried < serverCount)
-			{
-				// Push a new thread onto the thread vector
-				QServerThread.push_back(new ODA_Thread());
+	// Every server is queried at once from this thread, the engine locks
+	// each one while its reply is read
+	for(size_t i = 0; i < serverCount; i++)
+		engine.AddTarget(&QServer[i]);
 
-				// Start the thread for a server query
-				QServerThread.back()->Create(this, (THREAD_FUNC_PTR)&AGOL_MainWindow::QueryServerThrEntry,
-					&QServer[serversQueried]);
+	QueryProgress progress = { this, &engine };
 
-				// Incremement the number of requested server queries
-				serversQueried++;
-			}
-		}
-#ifdef _XBOX
-		// This yield is required on Xbox. Without it the Xbox sometimes fails to give the other
-		// threads CPU time and that results in an unacceptably long query and an interface pause
-		// while this thread continuously queries the other threads for completion. -- Hyper_Eye
-		AG_Delay(1); // 1ms yield
-#endif
-		UpdateQueriedLabelCompleted(static_cast<int>(count));
-	}
+	engine.SetCallback(&AGOL_MainWindow::ServerQueried, &progress);
+	engine.Run(serverTimeout, static_cast<int8_t>(serverRetries));
 
 	// Stop the server list automatic polling
 	StopServerListPoll();
@@ -1505,12 +1496,11 @@ void *AGOL_MainWindow::QueryAllServers(void *arg)
 	return NULL;
 }
 
-void *AGOL_MainWindow::QueryServerThrEntry(void *arg)
+void AGOL_MainWindow::ServerQueried(odalpapi::ServerBase *server, int32_t result, void *arg)
 {
-	if(arg)
-		QuerySingleServer((Server*)arg);
+	QueryProgress *progress = static_cast<QueryProgress*>(arg);
 
-	return NULL;
+	progress->window->UpdateQueriedLabelCompleted(static_cast<int>(progress->engine->GetFinished()));
 }
 
 bool AGOL_MainWindow::CvarCompare(const Cvar_t &a, const Cvar_t &b)
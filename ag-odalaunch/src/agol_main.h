@@ -177,7 +177,7 @@ private:
 	void *QueryServer(void *arg);
 	int   QuerySingleServer(Server *server);
 	void *QueryAllServers(void *arg);
-	void *QueryServerThrEntry(void *arg);
+	static void ServerQueried(odalpapi::ServerBase *server, int32_t result, void *arg);
 
 	// Comapre functions
 	static bool CvarCompare(const Cvar_t &a, const Cvar_t &b);
@@ -215,7 +215,6 @@ private:
 
 	// Threads
 	ODA_Thread                MasterThread;
-	std::vector<ODA_Thread*>  QServerThread;
 
 	bool                      StartupQuery;
 	bool                      WindowExited;
@@ -103,12 +103,19 @@ ODA_SrvOptionsBox *AGOL_Settings::CreateSrvOptionsBox(void *parent)
 	if(GuiConfig::Read("ServerTimeout", ServerTimeout) || ServerTimeout == 0)
 		ServerTimeout = 500;
 
+	// Read the retry count. If it is not set use a default of 2 attempts.
+	if(GuiConfig::Read("ServerRetries", ServerRetries) || ServerRetries == 0)
+		ServerRetries = 2;
+
 	obox->masterTimeoutSpin = AG_NumericalNewUintR(obox->optionsBox, 0, NULL, 
 			"Master Timeout (ms)", &MasterTimeout, 1, 5000);
 
 	obox->serverTimeoutSpin = AG_NumericalNewUintR(obox->optionsBox, 0, NULL, 
 			"Server Timeout (ms)", &ServerTimeout, 1, 5000);
 
+	obox->serverRetriesSpin = AG_NumericalNewUintR(obox->optionsBox, 0, NULL, 
+			"Server Retries", &ServerRetries, 1, 10);
+
 	return obox;
 }
 
@@ -566,6 +573,7 @@ void AGOL_Settings::SaveServerOptions()
 	GuiConfig::Write("ShowBlockedServers", ShowBlocked);
 	GuiConfig::Write("MasterTimeout", MasterTimeout);
 	GuiConfig::Write("ServerTimeout", ServerTimeout);
+	GuiConfig::Write("ServerRetries", ServerRetries);
 }
 
 void AGOL_Settings::SaveGuiOptions()
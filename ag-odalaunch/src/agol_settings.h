@@ -45,6 +45,7 @@ typedef struct
 	AG_Checkbox  *showBlockedCheck;
 	AG_Numerical *masterTimeoutSpin;
 	AG_Numerical *serverTimeoutSpin;
+	AG_Numerical *serverRetriesSpin;
 } ODA_SrvOptionsBox;
 
 typedef struct
@@ -143,6 +144,7 @@ private:
 	int                ShowBlocked;
 	unsigned int       MasterTimeout;
 	unsigned int       ServerTimeout;
+	unsigned int       ServerRetries;
 
 	std::list<std::string>  WadDirs;
 };
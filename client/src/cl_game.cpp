@@ -1018,13 +1018,18 @@ void G_Ticker (void)
 			if (!CL_ReadPacketHeader())
 				continue;
 
-			if (netdemo.isRecording())
-				netdemo.capture(&net_message);
+			// A datagram can hold several packets that were sent again.
+			do
+			{
+				if (netdemo.isRecording())
+					netdemo.capture(&net_message);
 
-			CL_ParseCommands();
+				CL_ParseCommands();
 
-			if (gameaction == ga_fullconsole) // Host_EndGame was called
-				return;
+				if (gameaction == ga_fullconsole) // Host_EndGame was called
+					return;
+			}
+			while (CL_ReadCoalescedPacket());
 		}
 
 		if (!(gametic%TICRATE))
@@ -122,6 +122,20 @@ netadr_t  lastconaddr;
 const static size_t PACKET_SEQ_MASK = 0xFF;
 static int packetseq[256];
 
+// Received packets are acknowledged once per tic with the newest sequence
+// and a bitfield of the ones before it.
+const static int ACK_WINDOW = 32;
+static int ack_latest = -1;
+static uint32_t ack_bits = 0; // bit N is set if ack_latest - N - 1 arrived
+static bool ack_pending = false;
+
+// Old servers don't understand clc_ackbits, so every packet is acknowledged
+// with its own clc_ack until the server flags a packet with SVF_ACKBITS.
+static bool server_ackbits = false;
+
+// Resent reliable packets the server sent together in one datagram.
+static buf_t coalesced_packet;
+
 // denis - unique session key provided by the server
 std::string digest;
 
@@ -288,7 +302,7 @@ EXTERN_CVAR (waddirs)
 
 void CL_PlayerTimes (void);
 void CL_TryToConnect(DWORD server_token);
-void CL_Decompress();
+void CL_Decompress(byte flags);
 
 bool M_FindFreeName(std::string &filename, const std::string &extension);
 
@@ -1759,6 +1773,11 @@ bool CL_Connect()
 	players.clear();
 
 	memset(packetseq, -1, sizeof(packetseq));
+	ack_latest = -1;
+	ack_bits = 0;
+	ack_pending = false;
+	server_ackbits = false;
+	coalesced_packet.clear();
 
 	// [AM] This needs to go out ASAP so the server can start sending us
 	//      messages.
@@ -1781,9 +1800,9 @@ bool CL_Connect()
 		Printf(PRINT_WARNING, "Protocol flag bits (%u) were not understood.", flags);
 		CL_QuitNetGame(NQ_PROTO);
 	}
-	else if (flags & SVF_COMPRESSED)
+	else if (flags & (SVF_COMPRESSED | SVF_HUFFMAN))
 	{
-		CL_Decompress();
+		CL_Decompress(flags);
 	}
 	CL_ParseCommands();
 
@@ -1884,6 +1903,9 @@ void CL_TryToConnect(DWORD server_token)
 
         MSG_WriteString(&net_buffer, (char *)connectpasshash.c_str());
 
+		// Let the server know which optional features we support.
+		MSG_WriteByte(&net_buffer, CLF_HUFFMAN | CLF_MOBJDELTA | CLF_ACKBITS);
+
 		NET_SendPacket(net_buffer, serveraddr);
 		SZ_Clear(&net_buffer);
 	}
@@ -1930,12 +1952,117 @@ void CL_ClearSectorSnapshots()
 // [Russell] - reason this was failing is because of huffman routines, so just
 // use minilzo for now (cuts a packet size down by roughly 45%), huffman is the
 // if 0'd sections
-void CL_Decompress()
+//
+// Packets flagged with SVF_HUFFMAN use the fixed protocol model instead.
+void CL_Decompress(byte flags)
 {
 	if(!MSG_BytesLeft())
 		return;
 
-	MSG_DecompressMinilzo();
+	if (flags & SVF_HUFFMAN)
+		MSG_DecompressAdaptive(protocol_huffman);
+	else
+		MSG_DecompressMinilzo();
+}
+
+/**
+ * @brief Write the pending acknowledgements to the server.
+ */
+static void CL_WriteAcks()
+{
+	if (!ack_pending)
+		return;
+
+	MSG_WriteMarker(&net_buffer, clc_ackbits);
+	MSG_WriteLong(&net_buffer, ack_latest);
+	MSG_WriteLong(&net_buffer, ack_bits);
+	ack_pending = false;
+}
+
+/**
+ * @brief Remember to acknowledge a packet.  Duplicates are acknowledged
+ *        again, in case the first acknowledgement got lost.
+ */
+static void CL_AckPacket(int sequence)
+{
+	if (!server_ackbits)
+	{
+		MSG_WriteMarker(&net_buffer, clc_ack);
+		MSG_WriteLong(&net_buffer, sequence);
+		return;
+	}
+
+	if (sequence > ack_latest && ack_latest < 0)
+	{
+		ack_latest = sequence;
+		ack_bits = 0;
+	}
+	else if (sequence > ack_latest)
+	{
+		// The old newest packet joins the bitfield.
+		const int shift = sequence - ack_latest;
+		const uint64_t window = (static_cast<uint64_t>(ack_bits) << 1) | 1;
+
+		// Don't let packets that haven't been acknowledged yet fall out of
+		// the window.
+		if (ack_pending && (shift > ACK_WINDOW || (window << (shift - 1)) >> ACK_WINDOW))
+			CL_WriteAcks();
+
+		ack_bits = shift > ACK_WINDOW ? 0 : static_cast<uint32_t>(window << (shift - 1));
+		ack_latest = sequence;
+	}
+	else if (sequence < ack_latest && ack_latest - sequence <= ACK_WINDOW)
+	{
+		ack_bits |= 1U << (ack_latest - sequence - 1);
+	}
+	else if (sequence < ack_latest)
+	{
+		// Too old for the window.
+		MSG_WriteMarker(&net_buffer, clc_ack);
+		MSG_WriteLong(&net_buffer, sequence);
+		return;
+	}
+
+	ack_pending = true;
+}
+
+/**
+ * @brief Load the next new packet out of a coalesced datagram into
+ *        net_message.
+ *
+ * @return False if there are no more, otherwise true.
+ */
+bool CL_ReadCoalescedPacket()
+{
+	while (::coalesced_packet.BytesLeftToRead() > 0)
+	{
+		const int sequence = ::coalesced_packet.ReadLong();
+		const int size = ::coalesced_packet.ReadShort();
+		if (size < 0)
+			break;
+
+		const byte* data = ::coalesced_packet.ReadChunk(size);
+		if (data == NULL)
+			break;
+
+		CL_AckPacket(sequence);
+
+		// Parts we already have are skipped.
+		if (::packetseq[sequence & PACKET_SEQ_MASK] == sequence)
+			continue;
+
+		::packetseq[sequence & PACKET_SEQ_MASK] = sequence;
+
+		SZ_Clear(&::net_message);
+		::net_message.WriteChunk(reinterpret_cast<const char*>(data), size);
+
+		netgraph.addPacketIn();
+		return true;
+	}
+
+	::coalesced_packet.clear();
+	SZ_Clear(&::net_message);
+	return false;
 }
 
 /**
@@ -1947,32 +2074,48 @@ bool CL_ReadPacketHeader()
 {
 	// Packet sequence number.
 	int sequence = MSG_ReadLong();
-	int oldsequence = ::packetseq[sequence & PACKET_SEQ_MASK];
 
-	if (sequence == oldsequence)
+	// Flag bits.
+	byte flags = MSG_ReadByte();
+
+	if (flags & SVF_ACKBITS)
+		server_ackbits = true;
+
+	// A coalesced datagram's own sequence number means nothing, the packets
+	// inside it carry their own.
+	if (!(flags & SVF_COALESCED))
 	{
-		// Duplicate packet, burn it and return early.
-		SZ_Clear(&::net_message);
-		return false;
-	}
+		// Acknowledge it to the server, even if it's a dupe.
+		CL_AckPacket(sequence);
 
-	// Not a dupe, keep it in our array of known received packets.
-	::packetseq[sequence & PACKET_SEQ_MASK] = sequence;
+		if (sequence == ::packetseq[sequence & PACKET_SEQ_MASK])
+		{
+			// Duplicate packet, burn it and return early.
+			SZ_Clear(&::net_message);
+			return false;
+		}
 
-	// Send an ACK to the server.
-	MSG_WriteMarker(&net_buffer, clc_ack);
-	MSG_WriteLong(&net_buffer, sequence);
+		// Not a dupe, keep it in our array of known received packets.
+		::packetseq[sequence & PACKET_SEQ_MASK] = sequence;
+	}
 
-	// Flag bits.
-	byte flags = MSG_ReadByte();
 	if (flags & SVF_UNUSED_MASK)
 	{
 		Printf(PRINT_WARNING, "Protocol flag bits (%u) were not understood.", flags);
 		CL_QuitNetGame(NQ_PROTO);
 	}
-	else if (flags & SVF_COMPRESSED)
+	else if (flags & (SVF_COMPRESSED | SVF_HUFFMAN))
 	{
-		CL_Decompress();
+		CL_Decompress(flags);
+	}
+
+	if (flags & SVF_COALESCED)
+	{
+		if (::coalesced_packet.maxsize() < ::net_message.maxsize())
+			::coalesced_packet.resize(::net_message.maxsize());
+
+		::coalesced_packet.swap(::net_message);
+		return CL_ReadCoalescedPacket();
 	}
 
 	netgraph.addPacketIn();
@@ -2102,6 +2245,8 @@ void CL_SendCmd(void)
 		MSG_WriteLong(&net_buffer, p->mo->z);
 	}
 
+	CL_WriteAcks();
+
 	MSG_WriteMarker(&net_buffer, clc_move);
 
 	// Write current client-tic.  Server later sends this back to client
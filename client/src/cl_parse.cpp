@@ -43,6 +43,7 @@
 #include "g_gametype.h"
 #include "g_levelstate.h"
 #include "gi.h"
+#include "hashtable.h"
 #include "i_video.h"
 #include "m_argv.h"
 #include "m_random.h"
@@ -457,6 +458,87 @@ static void CL_UpdatePing(const odaproto::svc::UpdatePing* msg)
 	p.ping = msg->ping();
 }
 
+//
+// Actor states the server sent delta-compressed updates against, keyed by
+// netid.  Only the most recent snapshots of each actor are kept.
+//
+struct MobjSnapshots
+{
+	uint32_t newest;
+	uint32_t ids[baseline_t::MAX_SNAPSHOTS];
+	baseline_t states[baseline_t::MAX_SNAPSHOTS];
+
+	MobjSnapshots() : newest(0)
+	{
+		for (size_t i = 0; i < baseline_t::MAX_SNAPSHOTS; i++)
+			ids[i] = 0;
+	}
+};
+
+typedef OHashTable<uint32_t, MobjSnapshots> MobjSnapshotTable;
+static MobjSnapshotTable mobj_snapshots;
+
+// How many snapshots ago the given id was sent, wrapping around.
+static uint32_t CL_SnapshotAge(uint32_t newest, uint32_t id)
+{
+	return (newest + baseline_t::MAX_SNAPSHOT_ID - id) % baseline_t::MAX_SNAPSHOT_ID;
+}
+
+static const baseline_t* CL_FindMobjSnapshot(uint32_t netid, uint32_t id)
+{
+	MobjSnapshotTable::iterator it = mobj_snapshots.find(netid);
+	if (it == mobj_snapshots.end())
+		return NULL;
+
+	for (size_t i = 0; i < baseline_t::MAX_SNAPSHOTS; i++)
+	{
+		if (it->second.ids[i] == id)
+			return &it->second.states[i];
+	}
+
+	return NULL;
+}
+
+static void CL_StoreMobjSnapshot(uint32_t netid, uint32_t id, const baseline_t& state)
+{
+	MobjSnapshots& snaps = mobj_snapshots[netid];
+
+	if (snaps.newest == 0 ||
+	    CL_SnapshotAge(id, snaps.newest) < baseline_t::MAX_SNAPSHOT_ID / 2)
+	{
+		snaps.newest = id;
+	}
+
+	// Replace an empty slot or the oldest snapshot, unless this one is even
+	// older than that.
+	size_t slot = 0;
+	uint32_t oldest = 0;
+	for (size_t i = 0; i < baseline_t::MAX_SNAPSHOTS; i++)
+	{
+		if (snaps.ids[i] == 0 || snaps.ids[i] == id)
+		{
+			slot = i;
+			break;
+		}
+
+		const uint32_t age = CL_SnapshotAge(snaps.newest, snaps.ids[i]);
+		if (age > oldest)
+		{
+			slot = i;
+			oldest = age;
+		}
+	}
+
+	if (snaps.ids[slot] != 0 && snaps.ids[slot] != id &&
+	    CL_SnapshotAge(snaps.newest, id) > oldest)
+	{
+		return;
+	}
+
+	snaps.ids[slot] = id;
+	snaps.states[slot] = state;
+}
+
 //
 // CL_SpawnMobj
 //
@@ -494,6 +576,7 @@ static void CL_SpawnMobj(const odaproto::svc::SpawnMobj* msg)
 		return;
 
 	P_ClearId(netid);
+	mobj_snapshots.erase(netid);
 
 	AActor* mo = new AActor(base.pos.x, base.pos.y, base.pos.z, type);
 	mo->baseline = base;
@@ -750,6 +833,8 @@ static void CL_DisconnectClient(const odaproto::svc::DisconnectClient* msg)
 static void CL_LoadMap(const odaproto::svc::LoadMap* msg)
 {
 	ClientReplay::getInstance().reset();
+	mobj_snapshots.clear();
+
 	bool splitnetdemo =
 	    (netdemo.isRecording() && ::cl_splitnetdemos) || ::forcenetdemosplit;
 	::forcenetdemosplit = false;
@@ -926,6 +1011,7 @@ static void CL_RemoveMobj(const odaproto::svc::RemoveMobj* msg)
 	if (mo && mo->flags & MF_COUNTITEM)
 		level.found_items++;
 
+	mobj_snapshots.erase(netid);
 	P_ClearId(netid);
 }
 
@@ -970,6 +1056,17 @@ static void CL_UpdateMobj(const odaproto::svc::UpdateMobj* msg)
 	uint32_t flags = msg->flags();
 
 	baseline_t update = mo->baseline;
+	if (msg->delta_from())
+	{
+		// Fields are relative to an earlier update.  If we don't have it
+		// anymore, the server sends a full update before long.
+		const baseline_t* snap = CL_FindMobjSnapshot(mo->netid, msg->delta_from());
+		if (snap == NULL)
+			return;
+
+		update = *snap;
+	}
+
 	if (flags & baseline_t::POSX)
 	{
 		update.pos.x = msg->actor().pos().x();
@@ -1020,6 +1117,11 @@ static void CL_UpdateMobj(const odaproto::svc::UpdateMobj* msg)
 		update.mom.z = msg->actor().mom().z();
 	}
 
+	if (msg->snapshot())
+	{
+		CL_StoreMobjSnapshot(mo->netid, msg->snapshot(), update);
+	}
+
 	if (mo->player)
 	{
 		// [SL] 2013-07-21 - Save the position information to a snapshot
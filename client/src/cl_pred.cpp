@@ -31,6 +31,7 @@
 #include "cl_netgraph.h"
 
 #include "p_snapshot.h"
+#include "stats.h"
 
 EXTERN_CVAR (cl_prednudge)
 EXTERN_CVAR (cl_predictsectors)
@@ -257,6 +258,8 @@ void CL_PredictWorld(void)
 	if (!validplayer(*p) || !p->mo || noservermsgs || netdemo.isPaused())
 		return;
 
+	BEGIN_STAT(PredictCycles);
+
 	// tenatively tell the netgraph that our prediction was successful
 	netgraph.setMisprediction(false);
 
@@ -332,6 +335,8 @@ void CL_PredictWorld(void)
 	if (cl_predictsectors)
 		CL_PredictSectors(gametic);		
 	CL_PredictLocalPlayer(gametic);
+
+	END_STAT(PredictCycles);
 }
 
 
@@ -275,6 +275,7 @@ void D_Display()
 			C_DisplayTicker();
 			M_Drawer();
 			I_FinishUpdate();
+			END_STAT(D_Display);
 			return;
 
 		case GS_LEVEL:
@@ -627,7 +628,7 @@ void D_Init()
 	// start the Zone memory manager
 	Z_Init();
 	if (first_time)
-		Printf("Z_Init: Using native allocator with OZone bookkeeping.\n");
+		Printf("Z_Init: Using %s.\n", Z_AllocatorName());
 
 	// Load palette and set up colormaps
 	V_Init();
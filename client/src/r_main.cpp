@@ -999,6 +999,8 @@ void R_RenderPlayerView(player_t* player)
 	if (!viewactive)
 		return;
 
+	SCOPED_STAT(R_RenderPlayerView);
+
 	R_SetupFrame(player);
 
 	// Clear buffers.
@@ -1029,6 +1031,7 @@ void R_RenderPlayerView(player_t* player)
 
     // [Russell] - From zdoom 1.22 source, added camera pointer check
 	// Never draw the player unless in chasecam mode
+	BEGIN_STAT(R_RenderBSPNode);
 	if (camera && camera->player && !(player->cheats & CF_CHASECAM))
 	{
 		int flags2_backup = camera->flags2;
@@ -1038,10 +1041,15 @@ void R_RenderPlayerView(player_t* player)
 	}
 	else
 		R_RenderBSPNode(numnodes - 1);	// The head node is the last node output.
+	END_STAT(R_RenderBSPNode);
 
+	BEGIN_STAT(R_DrawPlanes);
 	R_DrawPlanes();
+	END_STAT(R_DrawPlanes);
 
+	BEGIN_STAT(R_DrawMasked);
 	R_DrawMasked();
+	END_STAT(R_DrawMasked);
 
 	// NOTE(jsd): Full-screen status color blending:
 	int blend_alpha = int(blend_color.geta() * 255.0f);
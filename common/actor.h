@@ -323,6 +323,11 @@ struct baseline_t
 	static const uint32_t MOMY = BIT(10);
 	static const uint32_t MOMZ = BIT(11);
 
+	// Number of delta snapshots a client remembers per actor, and the
+	// highest snapshot id before they wrap around.
+	static const size_t MAX_SNAPSHOTS = 4;
+	static const uint32_t MAX_SNAPSHOT_ID = 127;
+
 	baseline_t()
 	    : angle(0), targetid(0), tracerid(0), movecount(0), movedir(0), rndindex(0)
 	{
@@ -417,6 +422,10 @@ public:
 	void Destroy ();
 	~AActor ();
 
+	// Actors come from their own pool rather than the zone.
+	void *operator new (size_t size);
+	void operator delete (void *block, size_t size);
+
 	virtual void RunThink ();
 
     // Info for drawing: position.
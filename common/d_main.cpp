@@ -58,6 +58,7 @@
 #include "gi.h"
 #include "w_ident.h"
 #include "m_resfile.h"
+#include "stats.h"
 
 #ifdef GEKKO
 #include "i_wii.h"
@@ -75,6 +76,10 @@ bool missingCommercialIWAD = false;
 bool lastWadRebootSuccess = true;
 extern bool step_mode;
 
+#ifdef SERVER_APP
+void SV_WaitForNextTic(dtime_t wake_time);
+#endif
+
 bool capfps = true;
 float maxfps = 35.0f;
 
@@ -1104,7 +1109,8 @@ void STACK_ARGS D_ClearTaskSchedulers()
 // TICRATE times a second. If the framerate is uncapped, the simulation function
 // will still be called TICRATE times a second but the display function will
 // be called as often as possible. After each iteration through the loop,
-// the program yields briefly to the operating system.
+// the program yields briefly to the operating system.  The server handles
+// network and console input while it waits.
 //
 void D_RunTics(void (*sim_func)(), void(*display_func)())
 {
@@ -1126,6 +1132,8 @@ void D_RunTics(void (*sim_func)(), void(*display_func)())
 
 	display_scheduler->run();
 
+	FStat::endframe();
+
 	if (timingdemo)
 		return;
 
@@ -1134,6 +1142,9 @@ void D_RunTics(void (*sim_func)(), void(*display_func)())
 	dtime_t display_wake_time = display_scheduler->getNextTime();
 	dtime_t wake_time = std::min<dtime_t>(simulation_wake_time, display_wake_time);
 
+#ifdef SERVER_APP
+	SV_WaitForNextTic(wake_time);
+#else
 	const dtime_t max_sleep_amount = 1000LL * 1000LL;	// 1ms
 
 	// Sleep in 1ms increments until the next scheduled task
@@ -1142,6 +1153,7 @@ void D_RunTics(void (*sim_func)(), void(*display_func)())
 		dtime_t sleep_amount = std::min<dtime_t>(max_sleep_amount, wake_time - now);
 		I_Sleep(sleep_amount);
 	}
+#endif
 }
 
 VERSION_CONTROL (d_main_cpp, "$Id$")
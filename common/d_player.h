@@ -266,15 +266,22 @@ public:
 	// denis - things that are pending to be sent to this player
 	std::queue<AActor::AActorPtr> to_spawn;
 
+	// netid of the last actor checked by SV_UpdateHiddenMobj, it picks up
+	// from here next tic
+	uint32_t awareness_cursor;
+
 	// denis - client structure is here now for a 1:1
 	struct client_t
 	{
 		struct oldPacket_t
 		{
-			int		sequence;
-			buf_t	data;
+			int		sequence;	// -1 if the slot is unused
+			buf_t	data;		// reliable part of the packet
+			dtime_t	sent;		// when it was last put on the wire, in ms
+			int		resends;
+			bool	acked;
 
-			oldPacket_t() : sequence(-1)
+			oldPacket_t() : sequence(-1), sent(0), resends(0), acked(false)
 			{
 				data.resize(0);
 			}
@@ -283,6 +290,9 @@ public:
 			{
 				sequence = other.sequence;
 				data = other.data;
+				sent = other.sent;
+				resends = other.resends;
+				acked = other.acked;
 			}
 		};
 
@@ -299,13 +309,27 @@ public:
 		oldPacket_t oldpackets[256];
 
 		int         sequence;
-		int         last_sequence;
+		int         last_sequence;	// newest packet the client acknowledged
+		int         oldest_unacked;	// no reliable data is pending before this
 		byte        packetnum;
 
+		bool        ackbits_capable;	// client understands SVF_ACKBITS
+		bool        selective_acks;	// client acknowledges with clc_ackbits
+		int         srtt;			// smoothed round trip time, in ms
+		int         rttvar;
+		int         rto;			// retransmission timeout, in ms
+
+		unsigned int resent_packets;	// reliable payloads sent again
+		unsigned int dropped_packets;	// reliable payloads given up on
+
 		int         rate;
 		int         reliable_bps;	// bytes per second
 		int         unreliable_bps;
 
+		int         rate_tokens;	// bytes that can be sent right now
+		dtime_t     rate_refilled;	// when rate_tokens was last topped up, in ms
+		unsigned int throttled_bytes;	// unreliable data left out to keep to rate
+
 		int			last_received;	// for timeouts
 
 		int			lastcmdtic, lastclientcmdtic;
@@ -315,6 +339,8 @@ public:
 		bool		displaydisconnect; // display disconnect message when disconnecting
 
 		huffman_server	compressor;	// denis - adaptive huffman compression
+		bool        huffman_packets;	// client understands SVF_HUFFMAN
+		bool        mobj_deltas;		// client understands delta_from in svc_updatemobj
 
 		class download_t
 		{
@@ -340,10 +366,21 @@ public:
 			}
 			sequence = 0;
 			last_sequence = 0;
+			oldest_unacked = 0;
 			packetnum = 0;
+			ackbits_capable = false;
+			selective_acks = false;
+			srtt = -1;
+			rttvar = 0;
+			rto = 0;
+			resent_packets = 0;
+			dropped_packets = 0;
 			rate = 0;
 			reliable_bps = 0;
 			unreliable_bps = 0;
+			rate_tokens = 0;
+			rate_refilled = 0;
+			throttled_bytes = 0;
 			last_received = 0;
 			lastcmdtic = 0;
 			lastclientcmdtic = 0;
@@ -355,6 +392,8 @@ public:
 			digest = "";
 			allow_rcon = false;
 			displaydisconnect = true;
+			huffman_packets = false;
+			mobj_deltas = false;
 		/*
 		huffman_server	compressor;	// denis - adaptive huffman compression*/
 		}
@@ -366,10 +405,21 @@ public:
 			packedversion(other.packedversion),
 			sequence(other.sequence),
 			last_sequence(other.last_sequence),
+			oldest_unacked(other.oldest_unacked),
 			packetnum(other.packetnum),
+			ackbits_capable(other.ackbits_capable),
+			selective_acks(other.selective_acks),
+			srtt(other.srtt),
+			rttvar(other.rttvar),
+			rto(other.rto),
+			resent_packets(other.resent_packets),
+			dropped_packets(other.dropped_packets),
 			rate(other.rate),
 			reliable_bps(other.reliable_bps),
 			unreliable_bps(other.unreliable_bps),
+			rate_tokens(other.rate_tokens),
+			rate_refilled(other.rate_refilled),
+			throttled_bytes(other.throttled_bytes),
 			last_received(other.last_received),
 			lastcmdtic(other.lastcmdtic),
 			lastclientcmdtic(other.lastclientcmdtic),
@@ -377,6 +427,8 @@ public:
 			allow_rcon(false),
 			displaydisconnect(true),
 			compressor(other.compressor),
+			huffman_packets(other.huffman_packets),
+			mobj_deltas(other.mobj_deltas),
 			download(other.download)
 		{
 			for (size_t i = 0; i < ARRAY_LENGTH(oldpackets); i++)
@@ -413,6 +465,9 @@ player_t		&consoleplayer();
 player_t		&displayplayer();
 player_t		&listenplayer();
 player_t		&idplayer(byte id);
+void			P_AddPlayerToIndex(player_t &player);
+void			P_RemovePlayerFromIndex(player_t &player);
+void			P_ClearPlayerIndex();
 player_t		&nameplayer(const std::string &netname);
 bool			validplayer(player_t &ref);
 
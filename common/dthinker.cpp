@@ -31,11 +31,25 @@
 #include "z_zone.h"
 #include "stats.h"
 #include "p_local.h"
+#include "c_dispatch.h"
+#include "i_system.h"
 
 IMPLEMENT_SERIAL (DThinker, DObject)
 
 DThinker *DThinker::FirstThinker = NULL;
 DThinker *DThinker::LastThinker = NULL;
+DThinker *DThinker::FirstInCategory[NUM_THINKCATEGORIES];
+DThinker *DThinker::LastInCategory[NUM_THINKCATEGORIES];
+size_t DThinker::CategorySize[NUM_THINKCATEGORIES];
+int DThinker::ActiveIterators = 0;
+DThinker *DThinker::FirstInTickList[NUM_TICKLISTS];
+DThinker *DThinker::LastInTickList[NUM_TICKLISTS];
+size_t DThinker::TickListSize[NUM_TICKLISTS];
+
+// The game mode the tick lists were sorted for.
+static int TickListMode = -1;
+
+bool IndependentThinker(DThinker *thinker);
 
 std::vector<DThinker *> LingerDestroy;
 
@@ -97,6 +111,22 @@ DThinker::DThinker ()
 	LastThinker = this;
 	refCount = 0;
 	destroyed = false;
+
+	// Our class isn't known until the constructors are done.
+	m_Category = THINK_NONE;
+	LinkCategory (THINK_UNSORTED);
+
+	// Being the newest thinker, this goes at the end of the list.
+	m_Predicted = false;
+	m_TickList = TICK_THINKERS;
+	m_TickPrev = LastInTickList[TICK_THINKERS];
+	m_TickNext = NULL;
+	if (LastInTickList[TICK_THINKERS])
+		LastInTickList[TICK_THINKERS]->m_TickNext = this;
+	if (!FirstInTickList[TICK_THINKERS])
+		FirstInTickList[TICK_THINKERS] = this;
+	LastInTickList[TICK_THINKERS] = this;
+	TickListSize[TICK_THINKERS]++;
 }
 
 DThinker::~DThinker ()
@@ -110,9 +140,246 @@ void DThinker::Orphan()
 {
 	m_Next = NULL;
 	m_Prev = NULL;
+	m_CatNext = NULL;
+	m_CatPrev = NULL;
+	m_Category = THINK_NONE;
+	m_TickNext = NULL;
+	m_TickPrev = NULL;
+	m_TickList = TICK_NONE;
 	refCount = 0;
 }
 
+// Add the thinker at the end of a category list.
+void DThinker::LinkCategory (thinkercategory_t cat)
+{
+	m_Category = cat;
+	m_CatPrev = LastInCategory[cat];
+	m_CatNext = NULL;
+	if (LastInCategory[cat])
+		LastInCategory[cat]->m_CatNext = this;
+	if (!FirstInCategory[cat])
+		FirstInCategory[cat] = this;
+	LastInCategory[cat] = this;
+	CategorySize[cat]++;
+}
+
+// Take the thinker out of its category list.  Its own links are left alone,
+// so an iterator that is about to move on from it still can.
+void DThinker::UnlinkCategory ()
+{
+	if (m_Category == THINK_NONE)
+		return;
+
+	if (FirstInCategory[m_Category] == this)
+		FirstInCategory[m_Category] = m_CatNext;
+	if (LastInCategory[m_Category] == this)
+		LastInCategory[m_Category] = m_CatPrev;
+	if (m_CatNext)
+		m_CatNext->m_CatPrev = m_CatPrev;
+	if (m_CatPrev)
+		m_CatPrev->m_CatNext = m_CatNext;
+
+	CategorySize[m_Category]--;
+	m_Category = THINK_NONE;
+}
+
+//
+// DThinker::WantedTickList
+//
+// Returns the list that should tick a sorted thinker, the same way
+// IndependentThinker decides.
+//
+ticklist_t DThinker::WantedTickList () const
+{
+	// Only have independent thinkers in client/server mode
+	if (!multiplayer || demoplayback)
+		return TICK_THINKERS;
+
+	if (m_Category == THINK_ACTORS)
+	{
+		const AActor *mobj = static_cast<const AActor *>(this);
+		if (!mobj->player || mobj->player->spectator)
+			return TICK_THINKERS;
+
+		// Clientside prediction takes care of ticking, and the server ticks
+		// players as it processes their ticcmds
+		if (clientside || serverside)
+			return TICK_PLAYERS;
+	}
+
+	// Client ticks movable sectors in prediction code
+	if (m_Predicted && clientside)
+		return TICK_PREDICTED;
+
+	return TICK_THINKERS;
+}
+
+//
+// DThinker::LinkTickList
+//
+// Add the thinker to a tick list, after the newest thinker in it that was
+// created before this one.
+//
+void DThinker::LinkTickList (ticklist_t list)
+{
+	DThinker *prev = m_Prev;
+	while (prev && prev->m_TickList != list)
+		prev = prev->m_Prev;
+
+	m_TickList = list;
+	m_TickPrev = prev;
+	m_TickNext = prev ? prev->m_TickNext : FirstInTickList[list];
+	if (m_TickNext)
+		m_TickNext->m_TickPrev = this;
+	else
+		LastInTickList[list] = this;
+	if (prev)
+		prev->m_TickNext = this;
+	else
+		FirstInTickList[list] = this;
+	TickListSize[list]++;
+}
+
+// Take the thinker out of its tick list, leaving its own links alone like
+// UnlinkCategory does.
+void DThinker::UnlinkTickList ()
+{
+	if (m_TickList == TICK_NONE)
+		return;
+
+	if (FirstInTickList[m_TickList] == this)
+		FirstInTickList[m_TickList] = m_TickNext;
+	if (LastInTickList[m_TickList] == this)
+		LastInTickList[m_TickList] = m_TickPrev;
+	if (m_TickNext)
+		m_TickNext->m_TickPrev = m_TickPrev;
+	if (m_TickPrev)
+		m_TickPrev->m_TickNext = m_TickNext;
+
+	TickListSize[m_TickList]--;
+	m_TickList = TICK_NONE;
+}
+
+// Move the thinker to the list that should tick it now.
+void DThinker::RefreshTickList ()
+{
+	const ticklist_t list = WantedTickList ();
+	if (list == m_TickList)
+		return;
+
+	UnlinkTickList ();
+	LinkTickList (list);
+}
+
+//
+// DThinker::UpdateTickLists
+//
+// Catch up with whatever changed who ticks which thinker.  Only player
+// bodies change lists during a game, everything else only when the game
+// mode does.
+//
+void DThinker::UpdateTickLists ()
+{
+	const int mode = (multiplayer && !demoplayback ? 1 : 0) |
+	                 (clientside ? 2 : 0) | (serverside ? 4 : 0);
+
+	if (mode != TickListMode)
+	{
+		TickListMode = mode;
+
+		for (int i = 0; i < NUM_TICKLISTS; i++)
+		{
+			FirstInTickList[i] = LastInTickList[i] = NULL;
+			TickListSize[i] = 0;
+		}
+
+		// Going through every thinker in order, each one is the newest of
+		// its list so far.
+		for (DThinker *thinker = FirstThinker; thinker; thinker = thinker->m_Next)
+		{
+			const ticklist_t list = thinker->m_Category == THINK_UNSORTED
+			                            ? TICK_THINKERS
+			                            : thinker->WantedTickList ();
+
+			thinker->m_TickList = list;
+			thinker->m_TickPrev = LastInTickList[list];
+			thinker->m_TickNext = NULL;
+			if (LastInTickList[list])
+				LastInTickList[list]->m_TickNext = thinker;
+			else
+				FirstInTickList[list] = thinker;
+			LastInTickList[list] = thinker;
+			TickListSize[list]++;
+		}
+		return;
+	}
+
+	// Bodies that lost their player or whose player started spectating.
+	DThinker *thinker = FirstInTickList[TICK_PLAYERS];
+	while (thinker)
+	{
+		DThinker *next = thinker->m_TickNext;
+		thinker->RefreshTickList ();
+		thinker = next;
+	}
+
+	for (Players::iterator it = players.begin(); it != players.end(); ++it)
+	{
+		if (it->mo && it->mo->m_Category == THINK_ACTORS)
+			it->mo->RefreshTickList ();
+	}
+}
+
+//
+// DThinker::CategoryOf
+//
+// Returns the category thinkers of the given type are sorted into.
+//
+thinkercategory_t DThinker::CategoryOf (const TypeInfo *type)
+{
+	if (type->IsDescendantOf (RUNTIME_CLASS (AActor)))
+		return THINK_ACTORS;
+	if (type->IsDescendantOf (RUNTIME_CLASS (DMover)))
+		return THINK_MOVERS;
+	if (type->IsDescendantOf (RUNTIME_CLASS (DLighting)))
+		return THINK_LIGHTS;
+	return THINK_OTHER;
+}
+
+//
+// DThinker::SortThinkers
+//
+// Move thinkers that were created since the last time into their category
+// lists.  They were created after everything that is sorted already, so
+// each category stays in the order its thinkers were created in.
+//
+void DThinker::SortThinkers ()
+{
+	if (ActiveIterators > 0)
+		return;
+
+	DThinker *thinker = FirstInCategory[THINK_UNSORTED];
+	while (thinker)
+	{
+		DThinker *next = thinker->m_CatNext;
+		const TypeInfo *type = thinker->StaticType ();
+
+		thinker->UnlinkCategory ();
+		thinker->LinkCategory (CategoryOf (type));
+
+		thinker->m_Predicted = type == RUNTIME_CLASS (DPillar) ||
+		                       type == RUNTIME_CLASS (DElevator) ||
+		                       type == RUNTIME_CLASS (DFloor) ||
+		                       type == RUNTIME_CLASS (DCeiling) ||
+		                       type == RUNTIME_CLASS (DPlat) ||
+		                       type == RUNTIME_CLASS (DDoor);
+		if (thinker->m_TickList != TICK_NONE)
+			thinker->RefreshTickList ();
+
+		thinker = next;
+	}
+}
+
 void DThinker::Destroy ()
 {
 	// denis - allow this function to be safely called multiple times
@@ -127,7 +394,9 @@ void DThinker::Destroy ()
 		m_Next->m_Prev = m_Prev;
 	if (m_Prev)
 		m_Prev->m_Next = m_Next;
-	
+	UnlinkCategory ();
+	UnlinkTickList ();
+
 	destroyed = true;
 		
 	if(refCount)
@@ -247,13 +516,20 @@ void DThinker::RunThinkers ()
 {
 	DThinker *currentthinker;
 
+	SortThinkers ();
+	UpdateTickLists ();
+
 	BEGIN_STAT (ThinkCycles);
-	currentthinker = FirstThinker;
+	currentthinker = FirstInTickList[TICK_THINKERS];
 	while (currentthinker)
 	{
-		if (!IndependentThinker(currentthinker))
+		// Thinkers created during this loop haven't been sorted yet.
+		if (currentthinker->m_Category != THINK_UNSORTED ||
+		    !IndependentThinker(currentthinker))
+		{
 			currentthinker->RunThink();
-		currentthinker = currentthinker->m_Next;
+		}
+		currentthinker = currentthinker->m_TickNext;
 	}
 	END_STAT (ThinkCycles);
 }
@@ -270,6 +546,41 @@ void DThinker::operator delete (void *mem)
 	Z_Free (mem);
 }
 
+FThinkerIterator::FThinkerIterator (TypeInfo *type)
+{
+	m_ParentType = type;
+
+	// Anything that is a kind of one category lives in just that one, a type
+	// that spans several has to look at every thinker.
+	m_Category = DThinker::CategoryOf (type);
+	if (m_Category == THINK_OTHER &&
+	    (type->IsAncestorOf (RUNTIME_CLASS (AActor)) ||
+	     type->IsAncestorOf (RUNTIME_CLASS (DMover)) ||
+	     type->IsAncestorOf (RUNTIME_CLASS (DLighting))))
+	{
+		m_Category = THINK_NONE;
+	}
+
+	DThinker::SortThinkers ();
+	DThinker::ActiveIterators++;
+
+	Start ();
+}
+
+FThinkerIterator::~FThinkerIterator ()
+{
+	DThinker::ActiveIterators--;
+}
+
+void FThinkerIterator::Start ()
+{
+	m_InUnsorted = false;
+	if (m_Category == THINK_NONE)
+		m_CurrThinker = DThinker::FirstThinker;
+	else
+		m_CurrThinker = DThinker::FirstInCategory[m_Category];
+}
+
 bool P_ThinkerIsPlayerType(DThinker* thinker)
 {
 	if (thinker == NULL)
@@ -279,4 +590,74 @@ bool P_ThinkerIsPlayerType(DThinker* thinker)
 	       static_cast<AActor*>(thinker)->type == MT_PLAYER;
 }
 
+static const char *CategoryNames[NUM_THINKCATEGORIES] =
+{
+	"Actors", "Movers", "Lights", "Other", "Unsorted"
+};
+
+static const char *TickListNames[NUM_TICKLISTS] =
+{
+	"Ticked by RunThinkers", "Ticked by prediction", "Ticked with ticcmds"
+};
+
+//
+// thinkerbench
+//
+// Time iterating over every actor through the actor list against walking
+// every thinker, with the given number of extra thinkers standing in for
+// sector lighting.
+//
+BEGIN_COMMAND (thinkerbench)
+{
+	const int extra = argc > 1 ? clamp(atoi(argv[1]), 0, 100000) : 4000;
+	const int passes = 100;
+
+	std::vector<DThinker *> fillers;
+	fillers.reserve(extra);
+	for (int i = 0; i < extra; i++)
+		fillers.push_back(new DThinker);
+
+	DThinker::SortThinkers ();
+
+	int found_all = 0, found_cat = 0;
+
+	dtime_t start = I_GetTime();
+	for (int pass = 0; pass < passes; pass++)
+	{
+		TThinkerIterator<DThinker> iterator;
+		DThinker *thinker;
+		while ((thinker = iterator.Next()))
+		{
+			if (thinker->IsKindOf(RUNTIME_CLASS(AActor)))
+				found_all++;
+		}
+	}
+	const dtime_t all_time = I_GetTime() - start;
+
+	start = I_GetTime();
+	for (int pass = 0; pass < passes; pass++)
+	{
+		TThinkerIterator<AActor> iterator;
+		while (iterator.Next())
+			found_cat++;
+	}
+	const dtime_t cat_time = I_GetTime() - start;
+
+	for (int i = 0; i < NUM_THINKCATEGORIES; i++)
+		Printf(PRINT_HIGH, "%-8s %" PRIuSIZE "\n", CategoryNames[i],
+		       DThinker::CategorySize[i]);
+	for (int i = 0; i < NUM_TICKLISTS; i++)
+		Printf(PRINT_HIGH, "%s: %" PRIuSIZE "\n", TickListNames[i],
+		       DThinker::TickListSize[i]);
+
+	for (size_t i = 0; i < fillers.size(); i++)
+		fillers[i]->Destroy();
+
+	Printf(PRINT_HIGH, "Every thinker: %.1f us per pass, %d actors\n",
+	       static_cast<double>(all_time) / passes / 1000.0, found_all / passes);
+	Printf(PRINT_HIGH, "Actor list:    %.1f us per pass, %d actors\n",
+	       static_cast<double>(cat_time) / passes / 1000.0, found_cat / passes);
+}
+END_COMMAND (thinkerbench)
+
 VERSION_CONTROL (dthinker_cpp, "$Id$")
@@ -51,6 +51,35 @@ typedef actionf_t  think_t;
 
 class FThinkerIterator;
 
+// Thinkers are also kept in a list for their category, so iterating over
+// one kind of thinker doesn't have to look at all the others.  Thinkers
+// are created before their class is known, so they wait in the unsorted
+// list until the next time no iterator is running.
+enum thinkercategory_t
+{
+	THINK_ACTORS,
+	THINK_MOVERS,
+	THINK_LIGHTS,
+	THINK_OTHER,
+	THINK_UNSORTED,
+
+	NUM_THINKCATEGORIES,
+	THINK_NONE = NUM_THINKCATEGORIES
+};
+
+// Thinkers are also split up by who ticks them, so RunThinkers doesn't have
+// to ask every thinker every tic.  Each list keeps the order its thinkers
+// were created in, which is the order Doom has always ticked them in.
+enum ticklist_t
+{
+	TICK_THINKERS,  // ticked by RunThinkers
+	TICK_PREDICTED, // moving sectors, ticked by client prediction
+	TICK_PLAYERS,   // player bodies, ticked as their ticcmds are run
+
+	NUM_TICKLISTS,
+	TICK_NONE = NUM_TICKLISTS
+};
+
 // Doubly linked list of thinkers
 class DThinker : public DObject
 {
@@ -74,14 +103,42 @@ public:
 	static void DestroyMostThinkers ();
 	static void SerializeAll (FArchive &arc, bool keepPlayers);
 
+	// Heads of the category lists.
+	static DThinker *FirstInCategory[NUM_THINKCATEGORIES];
+	static DThinker *LastInCategory[NUM_THINKCATEGORIES];
+	static size_t CategorySize[NUM_THINKCATEGORIES];
+	static thinkercategory_t CategoryOf (const TypeInfo *type);
+	static void SortThinkers ();
+
+	static DThinker *FirstInTickList[NUM_TICKLISTS];
+	static DThinker *LastInTickList[NUM_TICKLISTS];
+	static size_t TickListSize[NUM_TICKLISTS];
+	static void UpdateTickLists ();
+
 	bool WasDestroyed();
 
 	size_t refCount;
 
 private:
 	DThinker *m_Next, *m_Prev;
+	DThinker *m_CatNext, *m_CatPrev;
+	DThinker *m_TickNext, *m_TickPrev;
+	BYTE m_Category;
+	BYTE m_TickList;
+	bool m_Predicted; // one of the sector movers clients predict
 	bool destroyed;
 
+	// Iterators that are alive, thinkers can't be sorted while any are.
+	static int ActiveIterators;
+
+	void LinkCategory (thinkercategory_t cat);
+	void UnlinkCategory ();
+
+	ticklist_t WantedTickList () const;
+	void LinkTickList (ticklist_t list);
+	void UnlinkTickList ();
+	void RefreshTickList ();
+
 	friend class FThinkerIterator;
 };
 
@@ -90,26 +147,54 @@ class FThinkerIterator
 private:
 	TypeInfo *m_ParentType;
 	DThinker *m_CurrThinker;
+	// Category list to walk, or THINK_NONE to walk every thinker
+	thinkercategory_t m_Category;
+	bool m_InUnsorted;
+
+	void Start ();
+
+	FThinkerIterator (const FThinkerIterator&);
+	FThinkerIterator& operator= (const FThinkerIterator&);
 
 public:
-	FThinkerIterator (TypeInfo *type)
-	{
-		m_ParentType = type;
-		m_CurrThinker = DThinker::FirstThinker;
-	}
+	FThinkerIterator (TypeInfo *type);
+	~FThinkerIterator ();
+
 	DThinker *Next ()
 	{
-		while (m_CurrThinker)
+		if (m_Category == THINK_NONE)
 		{
-			if (m_CurrThinker->IsKindOf (m_ParentType))
+			while (m_CurrThinker)
 			{
 				DThinker *res = m_CurrThinker;
 				m_CurrThinker = m_CurrThinker->m_Next;
-				return res;
+				if (res->IsKindOf (m_ParentType))
+					return res;
 			}
-			m_CurrThinker = m_CurrThinker->m_Next;
 		}
-		m_CurrThinker = DThinker::FirstThinker;
+		else
+		{
+			for (;;)
+			{
+				while (m_CurrThinker)
+				{
+					DThinker *res = m_CurrThinker;
+					m_CurrThinker = m_CurrThinker->m_CatNext;
+					if (res->IsKindOf (m_ParentType))
+						return res;
+				}
+
+				// Thinkers created since the last sort come after the
+				// sorted ones.
+				if (m_InUnsorted)
+					break;
+
+				m_InUnsorted = true;
+				m_CurrThinker = DThinker::FirstInCategory[THINK_UNSORTED];
+			}
+		}
+
+		Start ();
 		return NULL;
 	}
 };
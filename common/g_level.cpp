@@ -604,6 +604,18 @@ void G_SerializeLevel(FArchive &arc, bool hubLoad)
 	if (!hubLoad && !arc.IsReset())
 		P_SerializePlayers(arc);
 
+	// Players may have been removed by the resize, or given new ids when
+	// they were read back.  Only the server keeps the index up to date as
+	// players come and go, the client always does a full search.
+	if (!arc.IsStoring())
+	{
+		P_ClearPlayerIndex();
+#ifdef SERVER_APP
+		for (Players::iterator it = players.begin(); it != players.end(); ++it)
+			P_AddPlayerToIndex(*it);
+#endif
+	}
+
 	P_SerializeThinkers(arc, hubLoad);
 	P_SerializeWorld(arc);
 	P_SerializePolyobjs(arc);
@@ -160,22 +160,25 @@ unsigned int huffman::_Huffman_Read8Bits( huff_bitstream_t *stream )
 
 void huffman::_Huffman_WriteBits( huff_bitstream_t *stream, unsigned int x, unsigned int bits )
 {
-  unsigned int  bit, count;
+  unsigned int  bit, count, room;
   unsigned char *buf;
-  unsigned int  mask;
 
   /* Get current stream state */
   buf = stream->BytePtr;
   bit = stream->BitPos;
 
-  /* Append bits */
-  mask = 1 << (bits-1);
-  for( count = 0; count < bits; ++ count )
+  /* Append bits, as many at a time as fit in the current byte. Whatever
+     follows them in the byte is cleared, it gets written next anyway. */
+  while( bits > 0 )
   {
-    *buf = (*buf & (0xff^(1<<(7-bit)))) +
-            ((x & mask ? 1 : 0) << (7-bit));
-    x <<= 1;
-    bit = (bit+1) & 7;
+    room = 8 - bit;
+    count = bits < room ? bits : room;
+    bits -= count;
+
+    *buf = (unsigned char)( (*buf & (0xff00 >> bit)) |
+            (((x >> bits) & ((1 << count) - 1)) << (room - count)) );
+
+    bit = (bit + count) & 7;
     if( !bit )
     {
       ++ buf;
@@ -526,12 +529,81 @@ bool huffman::decompress( unsigned char *in_data, size_t in_len, unsigned char *
 	return Huffman_Uncompress_Using_Tree(in_data, in_len, out_data, out_len, root);
 }
 
+// Number of bits a chunk of data would be compressed to
+size_t huffman::compressed_bits( const unsigned char *in_data, size_t in_len)
+{
+	if(fresh_histogram)
+	{
+		root = _Huffman_MakeTree( sym, (huff_encodenode_t *)&nodes );
+		fresh_histogram = false;
+	}
+
+	size_t bits = 0;
+	for(size_t i = 0; i < in_len; i++)
+		bits += sym[in_data[i]].Bits;
+
+	return bits;
+}
+
 // Constructor
 huffman::huffman()
 {
 	reset();
 }
 
+// Start out with a fixed histogram, and build the tree right away
+huffman::huffman(const unsigned short counts[256])
+{
+	total_count = 0;
+
+	for( int k = 0; k < 256; ++ k )
+	{
+		sym[k].Symbol = k;
+		sym[k].Count  = counts[k] ? counts[k] : 1;
+		sym[k].Code   = 0;
+		sym[k].Bits   = 0;
+
+		total_count += sym[k].Count;
+	}
+
+	root = _Huffman_MakeTree( sym, (huff_encodenode_t *)&nodes );
+	fresh_histogram = false;
+}
+
+//
+// Protocol model
+//
+// Byte frequencies of the packets a server sends every tic, scaled to fit
+// in 16 bits: the svc header and size of each message followed by its
+// protobuf encoding.  Most of it is actor and player positions, so tags,
+// small varints and the zeroed low bytes of fixed point numbers are
+// common, while the rest is close to uniform.
+//
+// Both ends must use exactly the same table, so any change to it needs a
+// protocol version bump.  Use "netcodecmodel" on a server to print a new one
+// from live traffic.
+//
+static const unsigned short protocol_counts[256] = {
+	65535, 19782, 6608, 5752, 3737, 6545, 5245, 3430, 28997, 2846, 8639, 2670, 2571, 16097, 2523, 20356,
+	3113, 1621, 24881, 1429, 1565, 14837, 1493, 1462, 11929, 1440, 2823, 1231, 1956, 16872, 1280, 1026,
+	9390, 1506, 4039, 1829, 1005, 869, 1204, 1511, 1318, 1498, 1076, 1040, 579, 1863, 528, 560,
+	1170, 609, 4744, 649, 510, 524, 514, 828, 702, 494, 488, 545, 485, 448, 449, 455,
+	1456, 514, 2392, 663, 449, 457, 457, 484, 676, 477, 478, 552, 446, 451, 451, 465,
+	711, 466, 468, 517, 444, 448, 448, 456, 670, 456, 456, 481, 445, 444, 446, 449,
+	6023, 515, 516, 662, 448, 458, 460, 484, 7201, 479, 478, 551, 446, 450, 451, 464,
+	3136, 465, 468, 515, 444, 449, 449, 458, 669, 456, 456, 480, 443, 444, 445, 2021,
+	1398, 445, 440, 508, 408, 413, 413, 428, 649, 421, 423, 458, 407, 411, 408, 416,
+	6447, 417, 419, 439, 407, 406, 410, 413, 628, 412, 411, 424, 407, 406, 406, 411,
+	1400, 442, 440, 507, 405, 412, 410, 425, 630, 421, 420, 455, 398, 383, 382, 388,
+	642, 391, 391, 414, 379, 380, 379, 385, 602, 382, 383, 394, 377, 377, 379, 381,
+	1371, 394, 396, 428, 377, 379, 379, 388, 597, 383, 381, 399, 375, 376, 376, 378,
+	635, 378, 381, 392, 374, 374, 374, 375, 596, 377, 379, 382, 376, 374, 374, 375,
+	1363, 392, 390, 425, 377, 377, 378, 384, 596, 382, 384, 401, 373, 375, 376, 379,
+	1525, 1272, 1270, 1279, 1262, 1266, 1263, 1267, 1486, 1268, 1269, 1273, 1263, 1262, 1265, 8040
+};
+
+huffman protocol_huffman(protocol_counts);
+
 //
 // Huffman Server
 //
@@ -95,11 +95,17 @@ public:
 	// Decompress a chunk of data using only previously generated stats
 	bool decompress( unsigned char *in_data, size_t in_len, unsigned char *out_data, size_t &out_len);
 
+	// Number of bits compress() would turn a chunk of data into, not counting padding
+	size_t compressed_bits( const unsigned char *in_data, size_t in_len);
+
 	// For debugging, this count can be used to see if two codecs have had the same length input
 	int get_count() { return total_count; }
 	
 	// Constructor
 	huffman();
+
+	// Start out with a fixed histogram of 256 byte counts
+	explicit huffman(const unsigned short counts[256]);
 	
 	// Copying invalidates all tree pointers
 	huffman(const huffman &other) : total_count(other.total_count), fresh_histogram(true)
@@ -108,6 +114,11 @@ public:
 	} 
 };
 
+// Codec with a fixed model of typical game traffic, so packets can be
+// compressed on their own without either end tracking any state.  Its tree
+// is built up front and never changes, so it can be used from any thread.
+extern huffman protocol_huffman;
+
 #define HUFFMAN_RENEGOTIATE_DELAY	256
 
 class huffman_server
@@ -74,6 +74,14 @@ typedef int SOCKET;
 #define SETSOCKOPTCAST(x) ((const void *)(x))
 #endif
 
+// Linux can move several datagrams across the kernel boundary in a single
+// call with recvmmsg/sendmmsg.  Everybody else gets one syscall per packet,
+// as does SIMULATE_LATENCY, which sends from its own thread.
+#if defined(__linux__) && !defined(GEKKO) && !defined(SIMULATE_LATENCY)
+#define ODA_HAVE_MMSG
+#include <sched.h>
+#endif
+
 #include <google/protobuf/message.h>
 
 
@@ -439,52 +447,283 @@ bool NET_CompareAdr (netadr_t a, netadr_t b)
 typedef int socklen_t;
 #endif
 
+//
+// NET_ReportRecvError
+//
+// Complain about a failed read, unless it's one of the harmless errors.
+//
+static void NET_ReportRecvError()
+{
+#ifdef _WIN32
+	errno = WSAGetLastError();
+
+	if (errno == WSAEWOULDBLOCK)
+		return;
+
+	if (errno == WSAECONNRESET)
+		return;
+
+	if (errno == WSAEMSGSIZE)
+	{
+		 Printf (PRINT_HIGH, "Warning:  Oversize packet from %s\n",
+						 NET_AdrToString (net_from));
+		 return;
+	}
+
+	Printf (PRINT_HIGH, "NET_GetPacket: %s\n", strerror(errno));
+#else
+	if (errno == EWOULDBLOCK)
+		return;
+	if (errno == ECONNREFUSED)
+		return;
+
+	Printf (PRINT_HIGH, "NET_GetPacket: %s\n", strerror(errno));
+#endif
+}
+
+#ifdef ODA_HAVE_MMSG
+
+// Maximum number of datagrams moved by a single recvmmsg/sendmmsg call.
+static const size_t NET_BATCH_SIZE = 32;
+
+struct netBatch_t
+{
+	byte data[NET_BATCH_SIZE][MAX_UDP_PACKET];
+	struct sockaddr_in addr[NET_BATCH_SIZE];
+	struct iovec iov[NET_BATCH_SIZE];
+	struct mmsghdr msgs[NET_BATCH_SIZE];
+	size_t count;	// datagrams in the batch
+	size_t next;	// next datagram to hand out, receive only
+};
+
+static netBatch_t recv_batch;
+static netBatch_t send_batch;
+static int send_batch_depth = 0;
+static size_t send_batch_failed = 0;	// datagrams the kernel didn't take
+
+// The server sends from its worker threads while a batch is open, so
+// send_batch is only touched with this held.
+static volatile int send_batch_locked = 0;
+
+class SendBatchLock
+{
+  public:
+	SendBatchLock()
+	{
+		while (__sync_lock_test_and_set(&send_batch_locked, 1))
+			sched_yield();
+	}
+
+	~SendBatchLock()
+	{
+		__sync_lock_release(&send_batch_locked);
+	}
+
+  private:
+	SendBatchLock(const SendBatchLock&);
+	SendBatchLock& operator=(const SendBatchLock&);
+};
+
+// Cleared if the kernel turns out not to support the mmsg calls.
+static bool use_mmsg = true;
+
+static void NET_PrepareBatchSlot(netBatch_t& batch, size_t i, size_t len)
+{
+	batch.iov[i].iov_base = batch.data[i];
+	batch.iov[i].iov_len = len;
+
+	memset(&batch.msgs[i], 0, sizeof(batch.msgs[i]));
+	batch.msgs[i].msg_hdr.msg_name = &batch.addr[i];
+	batch.msgs[i].msg_hdr.msg_namelen = sizeof(batch.addr[i]);
+	batch.msgs[i].msg_hdr.msg_iov = &batch.iov[i];
+	batch.msgs[i].msg_hdr.msg_iovlen = 1;
+}
+
+//
+// NET_FillRecvBatch
+//
+// Pull as many waiting datagrams as will fit out of the socket at once.
+//
+static bool NET_FillRecvBatch()
+{
+	for (size_t i = 0; i < NET_BATCH_SIZE; i++)
+		NET_PrepareBatchSlot(recv_batch, i, MAX_UDP_PACKET);
+
+	recv_batch.count = recv_batch.next = 0;
+
+	int ret = recvmmsg(inet_socket, recv_batch.msgs, NET_BATCH_SIZE, 0, NULL);
+	if (ret == -1)
+	{
+		if (errno == ENOSYS)
+		{
+			Printf(PRINT_HIGH, "recvmmsg is not supported, falling back to recvfrom.\n");
+			use_mmsg = false;
+			return false;
+		}
+
+		NET_ReportRecvError();
+		return false;
+	}
+
+	recv_batch.count = ret;
+	return ret > 0;
+}
+
+#endif
+
 int NET_GetPacket (void)
 {
+	net_message.clear();
+
+#ifdef ODA_HAVE_MMSG
+	if (use_mmsg)
+	{
+		if (recv_batch.next >= recv_batch.count && !NET_FillRecvBatch())
+			return false;
+
+		const size_t i = recv_batch.next++;
+		const size_t len = recv_batch.msgs[i].msg_len;
+
+		memcpy(net_message.ptr(), recv_batch.data[i], len);
+		net_message.setcursize(len);
+		SockadrToNetadr(&recv_batch.addr[i], &net_from);
+
+		return len;
+	}
+#endif
+
 	int				  ret;
 	struct sockaddr_in   from;
 	socklen_t			fromlen;
 
 	fromlen = sizeof(from);
-	net_message.clear();
 	ret = recvfrom (inet_socket, (char *)net_message.ptr(), net_message.maxsize(), 0, (struct sockaddr *)&from, &fromlen);
 
 	if (ret == -1)
 	{
-#ifdef _WIN32
-		errno = WSAGetLastError();
+		NET_ReportRecvError();
+		return false;
+	}
+	net_message.setcursize(ret);
+	SockadrToNetadr (&from, &net_from);
 
-		if (errno == WSAEWOULDBLOCK)
-			return false;
+	return ret;
+}
 
-		if (errno == WSAECONNRESET)
-			return false;
+//
+// NET_PendingPackets
+//
+// Returns true if datagrams have been read off the socket but not handed
+// out by NET_GetPacket yet.
+//
+static bool NET_PendingPackets()
+{
+#ifdef ODA_HAVE_MMSG
+	return use_mmsg && recv_batch.next < recv_batch.count;
+#else
+	return false;
+#endif
+}
+
+static void NET_ReportSendError()
+{
+#ifdef _WIN32
+	int err = WSAGetLastError();
 
-		if (errno == WSAEMSGSIZE)
+	// wouldblock is silent
+	if (err == WSAEWOULDBLOCK)
+		return;
+#else
+	if (errno == EWOULDBLOCK)
+		return;
+	if (errno == ECONNREFUSED)
+		return;
+	Printf (PRINT_HIGH, "NET_SendPacket: %s\n", strerror(errno));
+#endif
+}
+
+//
+// NET_FlushSendBatch
+//
+// Hand every queued datagram to the kernel.  The caller must hold a
+// SendBatchLock.  Datagrams that couldn't be sent are added to
+// send_batch_failed.
+//
+static void NET_FlushSendBatch()
+{
+#ifdef ODA_HAVE_MMSG
+	size_t sent = 0;
+	while (sent < send_batch.count)
+	{
+		int ret = sendmmsg(inet_socket, send_batch.msgs + sent,
+		                   send_batch.count - sent, 0);
+		if (ret == -1)
 		{
-			 Printf (PRINT_HIGH, "Warning:  Oversize packet from %s\n",
-							 NET_AdrToString (net_from));
-			 return false;
+			NET_ReportSendError();
+
+			// The socket buffer is full, the rest would fail the same way.
+			if (errno == EWOULDBLOCK)
+			{
+				send_batch_failed += send_batch.count - sent;
+				break;
+			}
+
+			// Skip the datagram that failed and carry on with the rest.
+			send_batch_failed++;
+			ret = 1;
 		}
 
-		Printf (PRINT_HIGH, "NET_GetPacket: %s\n", strerror(errno));
-		return false;
-#else
-		if (errno == EWOULDBLOCK)
-			return false;
-		if (errno == ECONNREFUSED)
-			return false;
+		sent += ret;
+	}
 
-		Printf (PRINT_HIGH, "NET_GetPacket: %s\n", strerror(errno));
-		return false;
+	send_batch.count = 0;
 #endif
+}
+
+//
+// NET_BeginSendBatch
+//
+// Packets sent until the matching NET_EndSendBatch are queued and handed to
+// the kernel together.  Calls can be nested.
+//
+void NET_BeginSendBatch()
+{
+#ifdef ODA_HAVE_MMSG
+	send_batch_depth++;
+#endif
+}
+
+//
+// NET_EndSendBatch
+//
+// Returns how many of the packets sent since the outermost
+// NET_BeginSendBatch could not be handed to the kernel.  NET_SendPacket
+// can't tell while they are queued.
+//
+size_t NET_EndSendBatch()
+{
+#ifdef ODA_HAVE_MMSG
+	if (send_batch_depth > 0 && --send_batch_depth == 0)
+	{
+		SendBatchLock lock;
+		NET_FlushSendBatch();
+
+		const size_t failed = send_batch_failed;
+		send_batch_failed = 0;
+		return failed;
 	}
-	net_message.setcursize(ret);
-	SockadrToNetadr (&from, &net_from);
+#endif
 
-	return ret;
+	return 0;
 }
 
+//
+// NET_SendPacket
+//
+// Returns -1 if the packet could not be sent.  While a batch is open the
+// packet is only queued, so its size is returned and a failure is counted
+// by NET_EndSendBatch instead.
+//
 int NET_SendPacket (buf_t &buf, netadr_t &to)
 {
 	int				   ret;
@@ -498,6 +737,26 @@ int NET_SendPacket (buf_t &buf, netadr_t &to)
 		return 0;
 	}
 
+#ifdef ODA_HAVE_MMSG
+	if (use_mmsg && send_batch_depth > 0)
+	{
+		SendBatchLock lock;
+
+		if (send_batch.count >= NET_BATCH_SIZE)
+			NET_FlushSendBatch();
+
+		const size_t i = send_batch.count++;
+		ret = buf.size();
+
+		memcpy(send_batch.data[i], buf.ptr(), ret);
+		NET_PrepareBatchSlot(send_batch, i, ret);
+		NetadrToSockadr(&to, &send_batch.addr[i]);
+
+		buf.clear();
+		return ret;
+	}
+#endif
+
 	NetadrToSockadr (&to, &addr);
 
 #ifdef GEKKO
@@ -509,21 +768,7 @@ int NET_SendPacket (buf_t &buf, netadr_t &to)
 	buf.clear();
 
 	if (ret == -1)
-	{
-#ifdef _WIN32
-		  int err = WSAGetLastError();
-
-		  // wouldblock is silent
-		  if (err == WSAEWOULDBLOCK)
-			  return 0;
-#else
-		  if (errno == EWOULDBLOCK)
-			  return 0;
-		  if (errno == ECONNREFUSED)
-			  return 0;
-		  Printf (PRINT_HIGH, "NET_SendPacket: %s\n", strerror(errno));
-#endif
-	}
+		NET_ReportSendError();
 
 	return ret;
 }
@@ -587,9 +832,13 @@ void SZ_Write (buf_t *b, const byte *data, int startpos, int length)
 //      Thanks to spleen for providing good brainpower!
 //
 // [SL] 2011-07-17 - Moved back to i_net.cpp so that it can be used by
-// both client & server code.  Client has a stub function for SV_SendPackets.
+// both client & server code.  Client has a stub function for SV_FlushBuffer.
 //
-void SV_SendPackets(void);
+// When a buffer fills up, only the client that owns it has its packet sent,
+// everybody else keeps filling theirs until the end of the tic.  Returns
+// false if the client is being dropped instead.
+//
+bool SV_FlushBuffer(buf_t* b);
 
 //
 // MSG_WriteMarker
@@ -619,45 +868,117 @@ void MSG_WriteChunk (buf_t *b, const void *p, unsigned l)
 	b->WriteChunk((const char *)p, l);
 }
 
-void MSG_WriteSVC(buf_t* b, const google::protobuf::Message& msg)
+//
+// MSG_PrepareSVC
+//
+// Look up the header of a message and compute its size.  Sizes are cached
+// in the message, so it can be serialized without working them out again.
+//
+static bool MSG_PrepareSVC(svc_t& header, size_t& size,
+                           const google::protobuf::Message& msg)
 {
-	if (simulated_connection)
-		return;
-
-	static std::string buffer;
-	if (!msg.SerializeToString(&buffer))
-	{
-		Printf(
-		    PRINT_WARNING,
-		    "WARNING: Could not serialize message \"%s\".  This is most likely a bug.\n",
-		    msg.GetDescriptor()->full_name().c_str());
-		return;
-	}
-
-	// Do we actaully have room for this upcoming message?
-	const size_t MAX_HEADER_SIZE = 4; // header + 3 bytes for varint size.
-	if (b->cursize + MAX_HEADER_SIZE + msg.ByteSize() >= MAX_UDP_SIZE)
-		SV_SendPackets();
-
-	svc_t header = SVC_ResolveDescriptor(msg.GetDescriptor());
+	header = SVC_ResolveDescriptor(msg.GetDescriptor());
 	if (header == svc_noop)
 	{
 		Printf(PRINT_WARNING,
 		       "WARNING: Could not find svc header for message \"%s\".  This is most "
 		       "likely a bug.\n",
 		       msg.GetDescriptor()->full_name().c_str());
-		return;
+		return false;
 	}
 
-#if 0
-	Printf("%s (%d)\n, %s\n",
-		::svc_info[header].getName(), msg.ByteSize(),
-		msg.ShortDebugString().c_str());
-#endif
+	size = msg.ByteSizeLong();
+
+	return true;
+}
+
+//
+// MSG_EncodeSVC
+//
+// Serialize a message into its on-the-wire form, header and size included,
+// so it can be copied into any number of buffers with MSG_WriteEncodedSVC.
+//
+bool MSG_EncodeSVC(std::string& out, const google::protobuf::Message& msg)
+{
+	svc_t header;
+	size_t size;
+	if (!MSG_PrepareSVC(header, size, msg))
+		return false;
+
+	out.clear();
+	out.push_back(static_cast<char>(header));
+
+	// Size of the message as an unsigned varint.
+	unsigned int left = size;
+	for (;;)
+	{
+		byte next = left & 0x7F;
+		left >>= 7;
+		if (left == 0)
+		{
+			out.push_back(static_cast<char>(next));
+			break;
+		}
+		out.push_back(static_cast<char>(next | 0x80));
+	}
+
+	const size_t start = out.size();
+	out.resize(start + size);
+	if (size > 0)
+		msg.SerializeWithCachedSizesToArray(reinterpret_cast<byte*>(&out[start]));
+
+	return true;
+}
+
+//
+// MSG_WriteEncodedSVC
+//
+// Write a message previously serialized with MSG_EncodeSVC.
+//
+void MSG_WriteEncodedSVC(buf_t* b, const std::string& encoded)
+{
+	if (simulated_connection)
+		return;
+
+	// Do we actaully have room for this upcoming message?  Don't bother
+	// with clients that are being dropped.
+	if (b->cursize + encoded.size() >= MAX_UDP_SIZE && !SV_FlushBuffer(b))
+		return;
+
+	b->WriteChunk(encoded.data(), encoded.size());
+}
+
+//
+// MSG_WriteSVC
+//
+// Serialize a message straight into the buffer.  Nothing static is used
+// here, so different buffers can be written to from different threads.
+//
+void MSG_WriteSVC(buf_t* b, const google::protobuf::Message& msg)
+{
+	if (simulated_connection)
+		return;
+
+	svc_t header;
+	size_t size;
+	if (!MSG_PrepareSVC(header, size, msg))
+		return;
+
+	size_t varint_size = 1;
+	for (size_t left = size >> 7; left; left >>= 7)
+		varint_size++;
+
+	// Do we actaully have room for this upcoming message?  Don't bother
+	// with clients that are being dropped.
+	if (b->cursize + 1 + varint_size + size >= MAX_UDP_SIZE && !SV_FlushBuffer(b))
+		return;
 
 	b->WriteByte(header);
-	b->WriteUnVarint(buffer.size());
-	b->WriteChunk(buffer.data(), buffer.size());
+	b->WriteUnVarint(size);
+
+	byte* dest = b->SZ_GetSpace(size);
+	if (!b->overflowed && size > 0)
+		msg.SerializeWithCachedSizesToArray(dest);
 }
 
 /**
@@ -673,25 +994,9 @@ void MSG_BroadcastSVC(const clientBuf_e buf, const google::protobuf::Message& ms
 	if (simulated_connection)
 		return;
 
-	static std::string buffer;
-	if (!msg.SerializeToString(&buffer))
-	{
-		Printf(
-		    PRINT_WARNING,
-		    "WARNING: Could not serialize message \"%s\".  This is most likely a bug.\n",
-		    msg.GetDescriptor()->full_name().c_str());
-		return;
-	}
-
-	svc_t header = SVC_ResolveDescriptor(msg.GetDescriptor());
-	if (header == svc_noop)
-	{
-		Printf(PRINT_WARNING,
-		       "WARNING: Could not find svc header for message \"%s\".  This is most "
-		       "likely a bug.\n",
-		       msg.GetDescriptor()->full_name().c_str());
+	static std::string encoded;
+	if (!MSG_EncodeSVC(encoded, msg))
 		return;
-	}
 
 	for (Players::iterator it = ::players.begin(); it != ::players.end(); ++it)
 	{
@@ -703,15 +1008,7 @@ void MSG_BroadcastSVC(const clientBuf_e buf, const google::protobuf::Message& ms
 
 		// Select the correct buffer.
 		buf_t* b = buf == CLBUF_RELIABLE ? &it->client.reliablebuf : &it->client.netbuf;
-
-		// Do we actaully have room for this upcoming message?
-		const size_t MAX_HEADER_SIZE = 4; // header + 3 bytes for varint size.
-		if (b->cursize + MAX_HEADER_SIZE + msg.ByteSize() >= MAX_UDP_SIZE)
-			SV_SendPackets();
-
-		b->WriteByte(header);
-		b->WriteUnVarint(buffer.size());
-		b->WriteChunk(buffer.data(), buffer.size());
+		MSG_WriteEncodedSVC(b, encoded);
 	}
 }
 
@@ -851,9 +1148,6 @@ size_t MSG_SetOffset (const size_t &offset, const buf_t::seek_loc_t &loc)
 // Output buffer size for LZO compression, extra space in case uncompressable
 #define OUT_LEN(a)      ((a) + (a) / 16 + 64 + 3)
 
-// size above which packets get compressed (empirical), does not apply to adaptive compression
-#define MINILZO_COMPRESS_MINPACKETSIZE	0xFF
-
 //
 // MSG_DecompressMinilzo
 //
@@ -886,31 +1180,68 @@ bool MSG_DecompressMinilzo ()
 //
 // MSG_CompressMinilzo
 //
-bool MSG_CompressMinilzo (buf_t &buf, size_t start_offset, size_t write_gap)
+// Compress everything in "in" past start_offset into "out", the first
+// start_offset bytes are copied over untouched.  Returns false if the
+// packet is too small or doesn't get any smaller, in which case "out" is
+// left in an undefined state and "in" should be sent as-is.
+//
+// Callers compressing on more than one thread must each pass their own
+// LZO1X_1_MEM_COMPRESS bytes of work memory.
+//
+bool MSG_CompressMinilzo (const buf_t &in, buf_t &out, size_t start_offset, void *workmem)
 {
-	if(buf.size() < MINILZO_COMPRESS_MINPACKETSIZE)
+	if(in.size() < MINILZO_COMPRESS_MINPACKETSIZE)
 		return false;
 
-	lzo_uint outlen = OUT_LEN(buf.maxsize() - start_offset - write_gap);
-	size_t total_len = outlen + start_offset + write_gap;
+	lzo_uint outlen = OUT_LEN(in.maxsize() - start_offset);
+	size_t total_len = outlen + start_offset;
 
-	if(compressed.maxsize() < total_len)
-		compressed.resize(total_len);
+	if(out.maxsize() < total_len)
+		out.resize(total_len);
 
-	int r = lzo1x_1_compress (buf.ptr() + start_offset,
-							  buf.size() - start_offset,
-							  compressed.ptr() + start_offset + write_gap,
+	int r = lzo1x_1_compress (in.data + start_offset,
+							  in.size() - start_offset,
+							  out.ptr() + start_offset,
 							  &outlen,
-							  wrkmem);
+							  workmem ? workmem : wrkmem);
 
 	// worth the effort?
-	if(r != LZO_E_OK || outlen >= (buf.size() - start_offset - write_gap))
+	if(r != LZO_E_OK || outlen >= (in.size() - start_offset))
 		return false;
 
-	memcpy(compressed.ptr(), buf.ptr(), start_offset);
+	memcpy(out.ptr(), in.data, start_offset);
+	out.setcursize(outlen + start_offset);
 
-	SZ_Clear(&buf);
-	MSG_WriteChunk(&buf, compressed.ptr(), outlen + start_offset + write_gap);
+	return true;
+}
+
+//
+// MSG_CompressHuffman
+//
+// Compress everything in "in" past start_offset into "out" with a codec
+// whose tree doesn't change, such as protocol_huffman.  Works the same as
+// MSG_CompressMinilzo otherwise, except that there is no minimum size.
+//
+bool MSG_CompressHuffman (huffman &huff, const buf_t &in, buf_t &out, size_t start_offset)
+{
+	const size_t len = in.size() - start_offset;
+	if(len == 0)
+		return false;
+
+	size_t outlen = OUT_LEN(len);
+	size_t total_len = outlen + start_offset;
+
+	if(out.maxsize() < total_len)
+		out.resize(total_len);
+
+	bool r = huff.compress (in.data + start_offset, len, out.ptr() + start_offset, outlen);
+
+	// worth the effort?
+	if(!r || outlen >= len)
+		return false;
+
+	memcpy(out.ptr(), in.data, start_offset);
+	out.setcursize(outlen + start_offset);
 
 	return true;
 }
@@ -931,7 +1262,10 @@ bool MSG_DecompressAdaptive (huffman &huff)
 	bool r = huff.decompress (net_message.ptr() + net_message.BytesRead(), left, decompressed.ptr(), newlen);
 
 	if(!r)
+	{
+		Printf(PRINT_HIGH, "Error: huffman packet decompression failed\n");
 		return false;
+	}
 
 	net_message.clear();
 	memcpy(net_message.ptr(), decompressed.ptr(), newlen);
@@ -1157,6 +1491,7 @@ static void InitNetMessageFormats()
 	CLC_INFO(clc_netcmd);
 	CLC_INFO(clc_spy);
 	CLC_INFO(clc_privmsg);
+	CLC_INFO(clc_ackbits);
 	CLC_INFO(clc_max);
 }
 
@@ -1219,6 +1554,10 @@ void InitNetCommon(void)
 //
 bool NetWaitOrTimeout(size_t ms)
 {
+	// Datagrams from the last batched read are still waiting.
+	if (NET_PendingPackets())
+		return true;
+
 	struct timeval timeout = {0, int(1000*ms) + 1};
 	fd_set fds;
 
@@ -1243,6 +1582,16 @@ bool NetWaitOrTimeout(size_t ms)
 	return false;
 }
 
+//
+// NET_GetSocket
+//
+// The game socket, for waiting on it along with other events.
+//
+int NET_GetSocket(void)
+{
+	return inet_socket;
+}
+
 void I_SetPort(netadr_t &addr, int port)
 {
    addr.port = htons(port);
@@ -59,10 +59,47 @@ enum clientBuf_e
  */
 #define SVF_COMPRESSED BIT(0)
 
+/**
+ * @brief Packet carries several resent reliable packets, each with its own
+ *        sequence number.  Only sent to clients that use clc_ackbits.
+ */
+#define SVF_COALESCED BIT(1)
+
+/**
+ * @brief Packet is compressed with protocol_huffman instead of minilzo.  Only
+ *        sent to clients that asked for it with CLF_HUFFMAN.
+ */
+#define SVF_HUFFMAN BIT(2)
+
+/**
+ * @brief Server understands clc_ackbits.  Only set for clients that asked
+ *        with CLF_ACKBITS, which keep sending clc_ack until they see it.
+ */
+#define SVF_ACKBITS BIT(3)
+
 /**
  * @brief Unused flags - if any of these are set, we have a problem.
  */
-#define SVF_UNUSED_MASK BIT_MASK(1, 7)
+#define SVF_UNUSED_MASK BIT_MASK(4, 7)
+
+/**
+ * @brief Client can decompress packets flagged with SVF_HUFFMAN.  Sent in an
+ *        optional byte at the end of the connect request, older clients
+ *        don't send anything there.
+ */
+#define CLF_HUFFMAN BIT(0)
+
+/**
+ * @brief Client keeps actor snapshots and can apply svc_updatemobj messages
+ *        sent relative to one with delta_from.
+ */
+#define CLF_MOBJDELTA BIT(1)
+
+/**
+ * @brief Client can acknowledge packets with clc_ackbits, once the server
+ *        flags its packets with SVF_ACKBITS.
+ */
+#define CLF_ACKBITS BIT(2)
 
 /**
  * @brief svc_*: Transmit all possible data.
@@ -297,6 +334,7 @@ enum clc_t
 	clc_netcmd,  // [AM] Send a string command to the server.
 	clc_spy,     // [SL] Tell server to send info about this player
 	clc_privmsg, // [AM] Targeted chat to a specific player.
+	clc_ackbits, // Newest packet received and a bitfield of the ones before.
 };
 
 static const size_t clc_max = 255;
@@ -642,6 +680,16 @@ public:
 		overflowed = false;
 	}
 
+	// Exchange contents with another buffer without copying any data.
+	void swap(buf_t &other)
+	{
+		std::swap(data, other.data);
+		std::swap(allocsize, other.allocsize);
+		std::swap(cursize, other.cursize);
+		std::swap(readpos, other.readpos);
+		std::swap(overflowed, other.overflowed);
+	}
+
 	void resize(size_t len, bool clearbuf = true)
 	{
 		byte *olddata = data;
@@ -736,12 +784,15 @@ void CloseNetwork (void);
 void InitNetCommon(void);
 void I_SetPort(netadr_t &addr, int port);
 bool NetWaitOrTimeout(size_t ms);
+int NET_GetSocket(void);
 
 char *NET_AdrToString (netadr_t a);
 bool NET_StringToAdr (const char *s, netadr_t *a);
 bool NET_CompareAdr (netadr_t a, netadr_t b);
 int  NET_GetPacket (void);
 int NET_SendPacket (buf_t &buf, netadr_t &to);
+void NET_BeginSendBatch();
+size_t NET_EndSendBatch();
 std::string NET_GetLocalAddress (void);
 
 void SZ_Clear (buf_t *buf);
@@ -760,6 +811,8 @@ void MSG_WriteFloat(buf_t *b, float);
 void MSG_WriteString (buf_t *b, const char *s);
 void MSG_WriteHexString(buf_t *b, const char *s);
 void MSG_WriteChunk (buf_t *b, const void *p, unsigned l);
+bool MSG_EncodeSVC(std::string& out, const google::protobuf::Message& msg);
+void MSG_WriteEncodedSVC(buf_t* b, const std::string& encoded);
 void MSG_WriteSVC(buf_t* b, const google::protobuf::Message& msg);
 void MSG_BroadcastSVC(const clientBuf_e buf, const google::protobuf::Message& msg,
                       const int skipPlayer = -1);
@@ -791,8 +844,13 @@ bool MSG_ReadProto(MSG& msg)
 
 size_t MSG_SetOffset (const size_t &offset, const buf_t::seek_loc_t &loc);
 
+// size above which packets get compressed (empirical), does not apply to adaptive compression
+#define MINILZO_COMPRESS_MINPACKETSIZE	0xFF
+
 bool MSG_DecompressMinilzo ();
-bool MSG_CompressMinilzo (buf_t &buf, size_t start_offset, size_t write_gap);
+bool MSG_CompressMinilzo (const buf_t &in, buf_t &out, size_t start_offset, void *workmem = NULL);
+
+bool MSG_CompressHuffman (huffman &huff, const buf_t &in, buf_t &out, size_t start_offset);
 
 bool MSG_DecompressAdaptive (huffman &huff);
 bool MSG_CompressAdaptive (huffman &huff, buf_t &buf, size_t start_offset, size_t write_gap);
@@ -118,3 +118,138 @@ private:
 	byte**		data_block;
 	byte*		free_block;
 };
+
+
+//
+// FreeListPool
+//
+// Hands out fixed-size slots for objects of type T, one at a time.  Unlike
+// Pool, slots can be given back individually; they go on a free list and
+// are handed out again before any new memory is touched, so the most
+// recently freed (and most likely cached) slot is reused first.
+//
+// Slots are rounded up to a cache line and slabs are aligned to one, so an
+// object never straddles more cache lines than it has to.  Slabs are kept
+// until the pool is destroyed.
+//
+template <typename T>
+class FreeListPool
+{
+public:
+	FreeListPool(size_t slab_count) :
+		slab_count(slab_count), slabs(NULL), free_list(NULL),
+		num_slabs(0), num_allocs(0), num_reuses(0), num_live(0), peak_live(0)
+	{
+	}
+
+	~FreeListPool()
+	{
+		while (slabs != NULL)
+		{
+			Slab* next = slabs->next;
+			delete [] slabs->data;
+			delete slabs;
+			slabs = next;
+		}
+	}
+
+	T* alloc()
+	{
+		Slot* slot = free_list;
+		if (slot != NULL)
+		{
+			free_list = slot->next;
+			num_reuses++;
+		}
+		else
+		{
+			slot = new_slab();
+		}
+
+		num_allocs++;
+		num_live++;
+		if (num_live > peak_live)
+			peak_live = num_live;
+
+		return reinterpret_cast<T*>(slot);
+	}
+
+	void free(void* ptr)
+	{
+		if (ptr == NULL)
+			return;
+
+		Slot* slot = static_cast<Slot*>(ptr);
+		slot->next = free_list;
+		free_list = slot;
+		num_live--;
+	}
+
+	static size_t slot_size()
+	{
+		return (sizeof(T) + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+	}
+
+	size_t slabs_allocated() const { return num_slabs; }
+	size_t bytes_allocated() const { return num_slabs * slab_count * slot_size(); }
+	size_t live() const { return num_live; }
+	size_t peak() const { return peak_live; }
+	unsigned long long allocs() const { return num_allocs; }
+	unsigned long long reuses() const { return num_reuses; }
+
+	void reset_stats()
+	{
+		num_allocs = num_reuses = 0;
+		peak_live = num_live;
+	}
+
+private:
+	static const size_t CACHE_LINE = 64;
+
+	union Slot
+	{
+		Slot* next;
+		byte object[sizeof(T)];
+	};
+
+	struct Slab
+	{
+		Slab* next;
+		byte* data;
+	};
+
+	// Carve a new slab into slots, returning the first and putting the rest
+	// on the free list in address order.
+	Slot* new_slab()
+	{
+		const size_t size = slot_size();
+
+		Slab* slab = new Slab;
+		slab->data = new byte[slab_count * size + CACHE_LINE];
+		slab->next = slabs;
+		slabs = slab;
+		num_slabs++;
+
+		byte* base = reinterpret_cast<byte*>(
+			(reinterpret_cast<size_t>(slab->data) + CACHE_LINE - 1) & ~(CACHE_LINE - 1));
+
+		for (size_t i = slab_count - 1; i > 0; i--)
+		{
+			Slot* slot = reinterpret_cast<Slot*>(base + i * size);
+			slot->next = free_list;
+			free_list = slot;
+		}
+
+		return reinterpret_cast<Slot*>(base);
+	}
+
+	size_t		slab_count;
+	Slab*		slabs;
+	Slot*		free_list;
+
+	size_t		num_slabs;
+	unsigned long long	num_allocs;
+	unsigned long long	num_reuses;
+	size_t		num_live;
+	size_t		peak_live;
+};
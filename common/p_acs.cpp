@@ -1652,9 +1652,12 @@ void DLevelScript::ACS_SetLineSpecial(int* args, byte argCount)
 	SetLineSpecial(args[0], args[1], args[2], args[3], args[4], args[5], args[6]);
 }
 
+// Mirrors a SetThingSpecial the server ran, args[0] is the actor's netid and
+// not a TID.  Scripts on the server go through PCD_SETTHINGSPECIAL instead,
+// a TID looked up as a netid there would find an unrelated actor.
 void DLevelScript::ACS_SetThingSpecial(int* args, byte argCount)
 {
-	if (argCount < 7)
+	if (argCount < 7 || serverside)
 		return;
 
 	AActor* actor = P_FindThingById(args[0]);
@@ -25,6 +25,8 @@
 #include "odamex.h"
 
 #include "m_alloc.h"
+#include "m_mempool.h"
+#include "cmdlib.h"
 #include "i_system.h"
 #include "z_zone.h"
 #include "m_random.h"
@@ -95,8 +97,17 @@ int             iquetail;
 NetIDHandler ServerNetID;
 
 // denis - fast netid lookup
+//
+// netids are handed out in order from 1 and reused once freed, so a flat
+// table indexed by netid stays about as large as the number of actors.
+// The few ids past the end of it, which only servers that never reuse
+// netids get up to, go in a map instead.
+typedef std::vector<AActor::AActorPtr> netid_table_t;
 typedef std::map<uint32_t, AActor::AActorPtr> netid_map_t;
-netid_map_t actor_by_netid;
+netid_table_t actor_by_netid;
+netid_map_t actor_by_high_netid;
+
+static const uint32_t MAX_NETID_TABLE_SIZE = 1 << 20;
 
 IMPLEMENT_SERIAL(AActor, DThinker)
 
@@ -109,6 +120,44 @@ AActor::~AActor ()
     self.update_all(NULL);
 }
 
+// Actors are spawned and removed constantly, so they are kept in a pool of
+// their own.  Memory only goes back to the pool from operator delete, which
+// DThinker::Destroy holds off on until no AActorPtr counts the actor any more.
+static FreeListPool<AActor> ActorPool(256);
+
+void *AActor::operator new (size_t size)
+{
+	if (size != sizeof(AActor))
+		return DThinker::operator new (size);
+
+	return ActorPool.alloc();
+}
+
+void AActor::operator delete (void *mem, size_t size)
+{
+	if (size != sizeof(AActor))
+		DThinker::operator delete (mem);
+	else
+		ActorPool.free(mem);
+}
+
+BEGIN_COMMAND(actorpool)
+{
+	std::string buf;
+	StrFormatBytes(buf, ActorPool.bytes_allocated());
+
+	Printf(PRINT_HIGH, "Actor pool: %" PRIuSIZE " live, %" PRIuSIZE " peak\n",
+	       ActorPool.live(), ActorPool.peak());
+	Printf(PRINT_HIGH, "  %" PRIuSIZE " slabs, %s in %" PRIuSIZE "-byte slots\n",
+	       ActorPool.slabs_allocated(), buf.c_str(), ActorPool.slot_size());
+	Printf(PRINT_HIGH, "  %llu allocations, %llu from the free list\n",
+	       ActorPool.allocs(), ActorPool.reuses());
+
+	if (argc > 1 && stricmp(argv[1], "reset") == 0)
+		ActorPool.reset_stats();
+}
+END_COMMAND(actorpool)
+
 void MapThing::Serialize (FArchive &arc)
 {
 	if (arc.IsStoring ())
@@ -275,7 +324,7 @@ AActor::AActor(fixed_t ix, fixed_t iy, fixed_t iz, mobjtype_t itype)
 	rndindex = M_Random();
 
 	if (multiplayer && serverside)
-		netid = ::ServerNetID.obtainNetID();
+		P_SetThingId(this, ::ServerNetID.obtainNetID());
 
 	if (!G_GetCurrentSkill().instant_reaction)
 		reactiontime = info->reactiontime;
@@ -356,6 +405,61 @@ void P_ClearAllNetIds()
 {
 	ServerNetID.resetNetIDs();
 	actor_by_netid.clear();
+	actor_by_high_netid.clear();
+}
+
+//
+// P_ThingIdSlot
+//
+// Returns where the actor with the given netid is kept, or NULL if there is
+// no room for it and create is false.
+//
+static AActor::AActorPtr* P_ThingIdSlot(uint32_t id, bool create)
+{
+	if (id < MAX_NETID_TABLE_SIZE)
+	{
+		if (id >= actor_by_netid.size())
+		{
+			if (!create)
+				return NULL;
+
+			actor_by_netid.resize(id + 1);
+		}
+		return &actor_by_netid[id];
+	}
+
+	if (create)
+		return &actor_by_high_netid[id];
+
+	netid_map_t::iterator i = actor_by_high_netid.find(id);
+	if (i == actor_by_high_netid.end())
+		return NULL;
+
+	return &i->second;
+}
+
+//
+// P_ReleaseThingId
+//
+// Forget the actor's netid, unless another actor has taken it since, and
+// let the server hand it out again later.
+//
+static void P_ReleaseThingId(AActor* mo)
+{
+	if (!mo->netid)
+		return;
+
+	AActor::AActorPtr* slot = P_ThingIdSlot(mo->netid, false);
+	if (slot == NULL || *slot != mo)
+		return;
+
+	if (mo->netid < MAX_NETID_TABLE_SIZE)
+		*slot = AActor::AActorPtr();
+	else
+		actor_by_high_netid.erase(mo->netid);
+
+	if (serverside)
+		ServerNetID.releaseNetID(mo->netid);
 }
 
 //
@@ -364,12 +468,43 @@ void P_ClearAllNetIds()
 //
 AActor* P_FindThingById(uint32_t id)
 {
-	netid_map_t::iterator i = actor_by_netid.find(id);
+	AActor::AActorPtr* slot = P_ThingIdSlot(id, false);
+	if (slot == NULL)
+		return NULL;
 
-	if(i == actor_by_netid.end())
-		return AActor::AActorPtr();
-	else
-		return i->second;
+	// The pointer goes NULL when the actor is destroyed, and the netid check
+	// catches an actor that has been renumbered since.
+	AActor* mo = *slot;
+	if (mo == NULL || mo->netid != id)
+		return NULL;
+
+	return mo;
+}
+
+//
+// P_NextThingById
+//
+// Returns the actor with the lowest netid above the given one, or NULL if
+// there is none.  Starting from 0 walks every actor with a netid.
+//
+AActor* P_NextThingById(uint32_t id)
+{
+	for (size_t i = static_cast<size_t>(id) + 1; i < actor_by_netid.size(); i++)
+	{
+		AActor* mo = actor_by_netid[i];
+		if (mo != NULL && mo->netid == i)
+			return mo;
+	}
+
+	netid_map_t::iterator i = actor_by_high_netid.upper_bound(id);
+	for (; i != actor_by_high_netid.end(); ++i)
+	{
+		AActor* mo = i->second;
+		if (mo != NULL && mo->netid == i->first)
+			return mo;
+	}
+
+	return NULL;
 }
 
 //
@@ -377,8 +512,11 @@ AActor* P_FindThingById(uint32_t id)
 //
 void P_SetThingId(AActor *mo, uint32_t newnetid)
 {
+	if (mo->netid != newnetid)
+		P_ReleaseThingId(mo);
+
 	mo->netid = newnetid;
-	actor_by_netid[newnetid] = mo->ptr();
+	*P_ThingIdSlot(newnetid, true) = mo->ptr();
 }
 
 
@@ -410,7 +548,7 @@ void AActor::Destroy ()
 {
 	SV_SendDestroyActor(this);
 
-	actor_by_netid.erase(netid);
+	P_ReleaseThingId(this);
 
 	// Remove from health pool.
 	if (!::savegamerestore)
@@ -3170,76 +3308,93 @@ void P_SetMobjBaseline(AActor& mo)
 	if (mo.baseline_set)
 		return;
 
-	mo.baseline.pos.x = mo.x;
-	mo.baseline.pos.y = mo.y;
-	mo.baseline.pos.z = mo.z;
-	mo.baseline.mom.x = mo.momx;
-	mo.baseline.mom.y = mo.momy;
-	mo.baseline.mom.z = mo.momz;
-	mo.baseline.angle = mo.angle;
-	mo.baseline.targetid = mo.target ? mo.target->netid : 0;
-	mo.baseline.tracerid = mo.tracer ? mo.tracer->netid : 0;
-	mo.baseline.movecount = mo.movecount;
-	mo.baseline.movedir = mo.movedir;
-	mo.baseline.rndindex = mo.rndindex;
+	P_GetMobjState(mo, mo.baseline);
 
 	mo.baseline_set = true;
 }
 
+/**
+ * @brief Fill out a baseline with the current state of a mobj.
+ */
+void P_GetMobjState(AActor& mo, baseline_t& state)
+{
+	state.pos.x = mo.x;
+	state.pos.y = mo.y;
+	state.pos.z = mo.z;
+	state.mom.x = mo.momx;
+	state.mom.y = mo.momy;
+	state.mom.z = mo.momz;
+	state.angle = mo.angle;
+	state.targetid = mo.target ? mo.target->netid : 0;
+	state.tracerid = mo.tracer ? mo.tracer->netid : 0;
+	state.movecount = mo.movecount;
+	state.movedir = mo.movedir;
+	state.rndindex = mo.rndindex;
+}
+
 /**
  * @brief Generate flags that lists which fields are different
  */
 uint32_t P_GetMobjBaselineFlags(AActor& mo)
+{
+	return P_GetMobjBaselineFlags(mo, mo.baseline);
+}
+
+/**
+ * @brief Generate flags that lists which fields are different from an
+ *        arbitrary baseline.
+ */
+uint32_t P_GetMobjBaselineFlags(AActor& mo, const baseline_t& base)
 {
 	uint32_t flags = 0;
 
-	if (mo.baseline.pos.x != mo.x)
+	if (base.pos.x != mo.x)
 	{
 		flags |= baseline_t::POSX;
 	}
-	if (mo.baseline.pos.y != mo.y)
+	if (base.pos.y != mo.y)
 	{
 		flags |= baseline_t::POSY;
 	}
-	if (mo.baseline.pos.z != mo.z)
+	if (base.pos.z != mo.z)
 	{
 		flags |= baseline_t::POSZ;
 	}
 
-	if (mo.baseline.angle != mo.angle)
+	if (base.angle != mo.angle)
 	{
 		flags |= baseline_t::ANGLE;
 	}
-	if (mo.baseline.movedir != mo.movedir)
+	if (base.movedir != mo.movedir)
 	{
 		flags |= baseline_t::MOVEDIR;
 	}
-	if (mo.baseline.movecount != mo.movecount)
+	if (base.movecount != mo.movecount)
 	{
 		flags |= baseline_t::MOVECOUNT;
 	}
-	if (mo.baseline.rndindex != mo.rndindex)
+	if (base.rndindex != mo.rndindex)
 	{
 		flags |= baseline_t::RNDINDEX;
 	}
-	if (mo.baseline.targetid != (mo.target ? mo.target->netid : 0))
+	if (base.targetid != (mo.target ? mo.target->netid : 0))
 	{
 		flags |= baseline_t::TARGET;
 	}
-	if (mo.baseline.tracerid != (mo.tracer ? mo.tracer->netid : 0))
+	if (base.tracerid != (mo.tracer ? mo.tracer->netid : 0))
 	{
 		flags |= baseline_t::TRACER;
 	}
 
-	if (mo.baseline.mom.x != mo.momx)
+	if (base.mom.x != mo.momx)
 	{
 		flags |= baseline_t::MOMX;
 	}
-	if (mo.baseline.mom.y != mo.momy)
+	if (base.mom.y != mo.momy)
 	{
 		flags |= baseline_t::MOMY;
 	}
-	if (mo.baseline.mom.z != mo.momz)
+	if (base.mom.z != mo.momz)
 	{
 		flags |= baseline_t::MOMZ;
 	}
@@ -49,18 +49,35 @@
 // clients can get confused when packets are dropped.
 
 // [AM] 2021-03-05
-// Changed NetID system to not "give back" NetID's.  This was causing issues
-// when resetting the level too many times.
+// NetID's used to be given back right away, which caused issues when
+// resetting the level too many times.  They are now only given back once
+// they have been unused for NETID_REUSE_DELAY.  By then every client has long
+// since been told the old actor is gone, even if the packet saying so had to
+// be resent, and servers that run for a long time don't run out of netids.
+
+#include <queue>
 
 #include "i_system.h"
 
 #define MAX_NETID 0xFFFFFFFF
 
+// How long a freed netid is kept unused, in ms.  Reliable packets are
+// given up on well before this.
+#define NETID_REUSE_DELAY 30000
+
 class NetIDHandler
 {
   private:
 	uint32_t m_nextID;
 
+	struct FreedID
+	{
+		uint32_t netid;
+		dtime_t time;
+	};
+
+	std::queue<FreedID> m_freedIDs;
+
   public:
 	NetIDHandler() : m_nextID(1)
 	{
@@ -75,11 +92,26 @@ class NetIDHandler
 		return m_nextID;
 	}
 
+	/**
+	 * @brief Number of freed netIDs waiting to be handed out again.
+	 */
+	size_t numFreedNetIDs() const
+	{
+		return m_freedIDs.size();
+	}
+
 	/**
 	 * @brief Obtain a netID for an AActor.
 	 */
 	uint32_t obtainNetID()
 	{
+		if (!m_freedIDs.empty() && I_MSTime() - m_freedIDs.front().time >= NETID_REUSE_DELAY)
+		{
+			const uint32_t netid = m_freedIDs.front().netid;
+			m_freedIDs.pop();
+			return netid;
+		}
+
 		if (m_nextID == MAX_NETID)
 		{
 			I_Error("Exceeded maximum number of netids (%u)", MAX_NETID);
@@ -89,6 +121,16 @@ class NetIDHandler
 		return m_nextID - 1;
 	}
 
+	/**
+	 * @brief Give back the netID of an actor that is gone, to be handed out
+	 *        again once NETID_REUSE_DELAY has passed.
+	 */
+	void releaseNetID(uint32_t netid)
+	{
+		FreedID freed = {netid, I_MSTime()};
+		m_freedIDs.push(freed);
+	}
+
 	/**
 	 * @brief Reset the netID back to 1.
 	 *
@@ -98,6 +140,7 @@ class NetIDHandler
 	void resetNetIDs()
 	{
 		m_nextID = 1;
+		m_freedIDs = std::queue<FreedID>();
 	}
 };
 
@@ -129,6 +172,7 @@ const uint32_t hordeBossModMask = MFO_INFIGHTINVUL | MFO_UNFLINCHING | MFO_ARMOR
 
 void P_ClearAllNetIds();
 AActor* P_FindThingById(uint32_t id);
+AActor* P_NextThingById(uint32_t id);
 void P_SetThingId(AActor* mo, uint32_t newnetid);
 void P_ClearId(uint32_t id);
 
@@ -146,7 +190,9 @@ void P_SpawnPlayerMissile(AActor *source, mobjtype_t type);
 size_t P_GetMapThingPlayerNumber(mapthing2_t* mthing);
 bool P_VisibleToPlayers(AActor *mo);
 void P_SetMobjBaseline(AActor& mo);
+void P_GetMobjState(AActor& mo, baseline_t& state);
 uint32_t P_GetMobjBaselineFlags(AActor& mo);
+uint32_t P_GetMobjBaselineFlags(AActor& mo, const baseline_t& base);
 
 // [ML] From EE
 int P_ThingInfoHeight(mobjinfo_t *mi);
@@ -35,6 +35,7 @@
 
 // State.
 #include "r_state.h"
+#include "stats.h"
 
 //
 // P_CheckSight
@@ -888,6 +889,8 @@ static bool P_CheckSightDoom
 
 bool P_CheckSight(const AActor* t1, const AActor* t2)
 {
+	SCOPED_HOT_STAT(P_CheckSight);
+
 	if (co_zdoomphys || map_format.getZDoom())
 		return P_CheckSightZDoom(t1, t2);
 	else
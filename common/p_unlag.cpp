@@ -31,11 +31,21 @@
 //   prior position) and 'restoring' (moving players back to their proper
 //   positions).
 //
+//   The lag is measured from the client's round trip time and kept in
+//   fractions of a tic, so positions are interpolated between the two
+//   recorded tics around it.  How much history is kept follows
+//   sv_maxunlagtime.
+//
 //-----------------------------------------------------------------------------
 
 
 #include "odamex.h"
 
+#include <algorithm>
+#include <cmath>
+
+#include "c_dispatch.h"
+#include "i_system.h"
 #include "m_vectors.h"
 #include "p_unlag.h"
 #include "p_local.h"
@@ -48,32 +58,29 @@ void SV_SendDestroyActor(AActor *mo);
 
 EXTERN_CVAR(sv_maxunlagtime)
 
-Unlag::SectorHistoryRecord::SectorHistoryRecord()
-	:	sector(NULL), history_size(0),
-		history_ceilingheight(), history_floorheight(),
-		backup_ceilingheight(0), backup_floorheight(0)
+// Players that moved further than this in a tic teleported, and aren't
+// interpolated.
+static const fixed_t MAX_INTERPOLATE_DIST = 64 * FRACUNIT;
+
+//
+// UnlagLerp
+//
+// Position between the newer and older recorded values, frac of the way
+// back to the older one.
+//
+static fixed_t UnlagLerp(fixed_t newer, fixed_t older, fixed_t frac)
 {
+	return newer + static_cast<fixed_t>(
+		(static_cast<int64_t>(older) - newer) * frac >> FRACBITS);
 }
 
-Unlag::SectorHistoryRecord::SectorHistoryRecord(sector_t *sec)
-	: 	sector(sec), history_size(Unlag::MAX_HISTORY_TICS),
-		history_ceilingheight(), history_floorheight(),
-		backup_ceilingheight(0), backup_floorheight(0)
+Unlag::Unlag() : reconciled(false), history_depth(0)
 {
-	if (!sector)
-		return;
+	player_history.count = 0;
+	sector_history.recorded = 0;
 
-	fixed_t ceilingheight = P_CeilingHeight(sector);
-	fixed_t floorheight = P_FloorHeight(sector);
-
-	for (size_t i = 0; i < history_size; i++)
-	{
-		history_ceilingheight[i] = ceilingheight;
-		history_floorheight[i] = floorheight;
-	}
-
-	backup_ceilingheight = ceilingheight;
-	backup_floorheight = floorheight;
+	for (size_t i = 0; i < Unlag::MAX_UNLAG_PLAYERS; i++)
+		player_history.registered[i] = false;
 }
 
 //
@@ -105,6 +112,77 @@ bool Unlag::enabled()
 	return (serverside && multiplayer && !demoplayback);
 }
 
+//
+// Unlag::wantedHistoryDepth
+//
+// Tics of history needed to reconcile as far back as sv_maxunlagtime
+// allows, plus two to interpolate from.
+//
+
+size_t Unlag::wantedHistoryDepth() const
+{
+	const float maxtime = clamp(sv_maxunlagtime.value(), 0.0f,
+	                            static_cast<float>(Unlag::MAX_UNLAG_SECONDS));
+	return static_cast<size_t>(ceil(maxtime * TICRATE)) + 2;
+}
+
+//
+// Unlag::updateHistoryDepth
+//
+// Resizes the history when sv_maxunlagtime has changed.  What was recorded
+// so far is lost: players start over with no history, and sectors are taken
+// to have been where they are now.
+//
+
+void Unlag::updateHistoryDepth()
+{
+	const size_t depth = wantedHistoryDepth();
+	if (depth == history_depth)
+		return;
+
+	history_depth = depth;
+
+	PlayerHistory& ph = player_history;
+	ph.x.assign(depth * Unlag::MAX_UNLAG_PLAYERS, 0);
+	ph.y.assign(depth * Unlag::MAX_UNLAG_PLAYERS, 0);
+	ph.z.assign(depth * Unlag::MAX_UNLAG_PLAYERS, 0);
+
+	for (size_t i = 0; i < ph.count; i++)
+		ph.history_size[ph.ids[i]] = 0;
+
+	SectorHistory& sh = sector_history;
+	sh.ceilingheight.resize(depth);
+	sh.floorheight.resize(depth);
+	for (size_t n = 0; n < depth; n++)
+	{
+		sh.ceilingheight[n].resize(sh.sector.size());
+		sh.floorheight[n].resize(sh.sector.size());
+
+		for (size_t i = 0; i < sh.sector.size(); i++)
+		{
+			sh.ceilingheight[n][i] = P_CeilingHeight(sh.sector[i]);
+			sh.floorheight[n][i] = P_FloorHeight(sh.sector[i]);
+		}
+	}
+}
+
+//
+// Unlag::historyIndex
+//
+// Position in the history ring of the given tic.
+//
+
+size_t Unlag::historyIndex(int tic) const
+{
+	const int depth = static_cast<int>(history_depth);
+	return ((tic % depth) + depth) % depth;
+}
+
+size_t Unlag::playerIndex(int tic, byte player_id) const
+{
+	return historyIndex(tic) * Unlag::MAX_UNLAG_PLAYERS + player_id;
+}
+
 //
 // Unlag::movePlayer
 //
@@ -142,23 +220,34 @@ void Unlag::moveSector(sector_t *sector, fixed_t ceilingheight,
 // Unlag::reconcilePlayerPositions
 //
 // Moves all of the players except 'shooter' to the position they were
-// at 'ticsago' tics before.  Players who were not alive at that time
-// have their MF_SHOOTABLE flag removed so they do not take damage.
+// at 'lag' tics before, interpolating between the two recorded tics around
+// it.  Players who were not alive at that time have their MF_SHOOTABLE flag
+// removed so they do not take damage.
 //
 // If Unlag::reconcile is true, restore all player positions to their state
 // before reconciliation.  Restore the MF_SHOOTABLE flag if we changed it.
 //
-// NOTE: ticsago should be > 0 if we're reconciling and not restoring
+// NOTE: lag should be > 0 if we're reconciling and not restoring
 //
 
-void Unlag::reconcilePlayerPositions(byte shooter_id, size_t ticsago)
+void Unlag::reconcilePlayerPositions(byte shooter_id, fixed_t lag)
 {
-	for (size_t i=0; i<player_history.size(); i++)
+	PlayerHistory& ph = player_history;
+
+	const int ticsago = lag >> FRACBITS;
+	const fixed_t frac = lag & (FRACUNIT - 1);
+	const size_t needed = ticsago + (frac ? 1 : 0);
+
+	const size_t newer = playerIndex(gametic - ticsago, 0);
+	const size_t older = playerIndex(gametic - ticsago - 1, 0);
+
+	for (size_t i = 0; i < ph.count; i++)
 	{
-		player_t *player = player_history[i].player;
+		const byte id = ph.ids[i];
+		player_t *player = ph.player[id];
 
 		// skip over the player shooting and any spectators
-		if (player->id == shooter_id || player->spectator || !player->mo)
+		if (id == shooter_id || player->spectator || !player->mo)
 			continue;
 
 		fixed_t dest_x, dest_y, dest_z; // position to move player to
@@ -167,27 +256,43 @@ void Unlag::reconcilePlayerPositions(byte shooter_id, size_t ticsago)
 		{
 			// record the player's current position, which hasn't yet
 			// been saved to the history arrays
-			player_history[i].backup_x = player->mo->x;
-			player_history[i].backup_y = player->mo->y;
-			player_history[i].backup_z = player->mo->z;
+			ph.backup_x[id] = player->mo->x;
+			ph.backup_y[id] = player->mo->y;
+			ph.backup_z[id] = player->mo->z;
 
-  			size_t cur = (gametic - ticsago) % Unlag::MAX_HISTORY_TICS;
+			const fixed_t newer_x = ph.x[newer + id], older_x = ph.x[older + id];
+			const fixed_t newer_y = ph.y[newer + id], older_y = ph.y[older + id];
+			const fixed_t newer_z = ph.z[newer + id], older_z = ph.z[older + id];
 
-			dest_x = player_history[i].history_x[cur];
-			dest_y = player_history[i].history_y[cur];
-			dest_z = player_history[i].history_z[cur];
+			if (ph.history_size[id] < needed ||
+			    abs(older_x - newer_x) > MAX_INTERPOLATE_DIST ||
+			    abs(older_y - newer_y) > MAX_INTERPOLATE_DIST)
+			{
+				// nothing to interpolate from, take the nearest tic
+				const bool use_older = frac >= FRACUNIT / 2 &&
+				                       ph.history_size[id] >= needed;
+				dest_x = use_older ? older_x : newer_x;
+				dest_y = use_older ? older_y : newer_y;
+				dest_z = use_older ? older_z : newer_z;
+			}
+			else
+			{
+				dest_x = UnlagLerp(newer_x, older_x, frac);
+				dest_y = UnlagLerp(newer_y, older_y, frac);
+				dest_z = UnlagLerp(newer_z, older_z, frac);
+			}
 
-			player_history[i].offset_x = player_history[i].backup_x - dest_x;
-			player_history[i].offset_y = player_history[i].backup_y - dest_y;
-			player_history[i].offset_z = player_history[i].backup_z - dest_z;
+			ph.offset_x[id] = ph.backup_x[id] - dest_x;
+			ph.offset_y[id] = ph.backup_y[id] - dest_y;
+			ph.offset_z[id] = ph.backup_z[id] - dest_z;
 
-			if (player_history[i].history_size < ticsago)
+			if (ph.history_size[id] < static_cast<size_t>(ticsago))
 			{
 				// make the player temporarily unshootable since this player
 				// was not alive when the shot was fired.  Kind of a hack.
-				player_history[i].backup_flags = player->mo->flags;
+				ph.backup_flags[id] = player->mo->flags;
 				player->mo->flags &= ~(MF_SHOOTABLE | MF_SOLID);
-				player_history[i].changed_flags = true;
+				ph.changed_flags[id] = true;
 			}
 
 			#ifdef _UNLAG_DEBUG_
@@ -200,15 +305,15 @@ void Unlag::reconcilePlayerPositions(byte shooter_id, size_t ticsago)
 		}
 		else
 		{   // we're moving the player back to proper position
-			dest_x = player_history[i].backup_x;
-			dest_y = player_history[i].backup_y;
-			dest_z = player_history[i].backup_z;
+			dest_x = ph.backup_x[id];
+			dest_y = ph.backup_y[id];
+			dest_z = ph.backup_z[id];
 
 			// restore a player's shootability if we removed it previously
-			if (player_history[i].changed_flags)
+			if (ph.changed_flags[id])
 			{
-				player->mo->flags = player_history[i].backup_flags;
-				player_history[i].changed_flags = false;
+				player->mo->flags = ph.backup_flags[id];
+				ph.changed_flags[id] = false;
 			}
 		}
 
@@ -222,37 +327,51 @@ void Unlag::reconcilePlayerPositions(byte shooter_id, size_t ticsago)
 // Unlag::reconcileSectorPositions
 //
 // Moves the ceiling and floor of any sectors considered moveable
-// to the positions they were 'ticsago' tics before.
+// to the positions they were 'lag' tics before.
 //
 // If 'reconciled' is true, restore the ceiling and floors to where they
 // were prior to reconciliation.
 //
 
-void Unlag::reconcileSectorPositions(size_t ticsago)
+void Unlag::reconcileSectorPositions(fixed_t lag)
 {
-	for (size_t i=0; i<sector_history.size(); i++)
+	SectorHistory& sh = sector_history;
+	const size_t count = sh.sector.size();
+	if (count == 0)
+		return;
+
+	if (!reconciled)
 	{
-		sector_t *sector = sector_history[i].sector;
+		const int ticsago = lag >> FRACBITS;
+		const fixed_t frac = lag & (FRACUNIT - 1);
 
-		fixed_t dest_ceilingheight, dest_floorheight;
-		if (!reconciled)
+		// the newest record is one behind the count
+		const int newest = static_cast<int>(sh.recorded) - 1;
+		const std::vector<fixed_t>& newer_ceiling = sh.ceilingheight[historyIndex(newest - ticsago)];
+		const std::vector<fixed_t>& newer_floor = sh.floorheight[historyIndex(newest - ticsago)];
+		const std::vector<fixed_t>& older_ceiling = sh.ceilingheight[historyIndex(newest - ticsago - 1)];
+		const std::vector<fixed_t>& older_floor = sh.floorheight[historyIndex(newest - ticsago - 1)];
+
+		for (size_t i = 0; i < count; i++)
 		{
-			// record the player's current position, which hasn't yet
+			sector_t *sector = sh.sector[i];
+
+			// record the sector's current position, which hasn't yet
 			// been saved to the history arrays
-			sector_history[i].backup_ceilingheight = P_CeilingHeight(sector);
-			sector_history[i].backup_floorheight = P_FloorHeight(sector);
+			sh.backup_ceilingheight[i] = P_CeilingHeight(sector);
+			sh.backup_floorheight[i] = P_FloorHeight(sector);
 
-			size_t cur = (sector_history[i].history_size - 1 - ticsago)
-						  % Unlag::MAX_HISTORY_TICS;
-			dest_ceilingheight = sector_history[i].history_ceilingheight[cur];
-			dest_floorheight = sector_history[i].history_floorheight[cur];
+			moveSector(sector, UnlagLerp(newer_ceiling[i], older_ceiling[i], frac),
+			           UnlagLerp(newer_floor[i], older_floor[i], frac));
 		}
-		else	// restore to original positions
+	}
+	else	// restore to original positions
+	{
+		for (size_t i = 0; i < count; i++)
 		{
-			dest_ceilingheight = sector_history[i].backup_ceilingheight;
-			dest_floorheight = sector_history[i].backup_floorheight;
+			moveSector(sh.sector[i], sh.backup_ceilingheight[i],
+			           sh.backup_floorheight[i]);
 		}
-		moveSector(sector, dest_ceilingheight, dest_floorheight);
 	}
 }
 
@@ -266,9 +385,21 @@ void Unlag::reconcileSectorPositions(size_t ticsago)
 
 void Unlag::reset()
 {
-	player_history.clear();
-	sector_history.clear();
-	player_id_map.clear();
+	for (size_t i = 0; i < player_history.count; i++)
+		player_history.registered[player_history.ids[i]] = false;
+	player_history.count = 0;
+
+	SectorHistory& sh = sector_history;
+	sh.sector.clear();
+	for (size_t n = 0; n < sh.ceilingheight.size(); n++)
+	{
+		sh.ceilingheight[n].clear();
+		sh.floorheight[n].clear();
+	}
+	sh.backup_ceilingheight.clear();
+	sh.backup_floorheight.clear();
+	sh.slot_by_sector.clear();
+	sh.recorded = 0;
 }
 
 
@@ -284,19 +415,24 @@ void Unlag::recordPlayerPositions()
 	if (!Unlag::enabled())
 		return;
 
-	for (size_t i=0; i<player_history.size(); i++)
+	updateHistoryDepth();
+
+	PlayerHistory& ph = player_history;
+	const size_t cur = playerIndex(gametic, 0);
+
+	for (size_t i = 0; i < ph.count; i++)
 	{
-		player_t *player = player_history[i].player;
+		const byte id = ph.ids[i];
+		player_t *player = ph.player[id];
 
 		if (player->playerstate == PST_LIVE &&
 			!player->spectator && player->mo)
 		{
-			player_history[i].history_size++;
+			ph.history_size[id]++;
 
-			size_t cur = gametic % Unlag::MAX_HISTORY_TICS;
-			player_history[i].history_x[cur] = player->mo->x;
-			player_history[i].history_y[cur] = player->mo->y;
-			player_history[i].history_z[cur] = player->mo->z;
+			ph.x[cur + id] = player->mo->x;
+			ph.y[cur + id] = player->mo->y;
+			ph.z[cur + id] = player->mo->z;
 
 			#ifdef _UNLAG_DEBUG_
 			DPrintf("Unlag (%03d): recording player %d position (%d, %d)\n",
@@ -308,7 +444,7 @@ void Unlag::recordPlayerPositions()
 		}
 		else
 		{   // reset history for dead, spectating, etc players
-			player_history[i].history_size = 0;
+			ph.history_size[id] = 0;
 		}
 	}
 }
@@ -325,14 +461,15 @@ void Unlag::recordSectorPositions()
 	if (!Unlag::enabled())
 		return;
 
-	for (size_t i=0; i<sector_history.size(); i++)
-	{
-		sector_t *sector = sector_history[i].sector;
+	updateHistoryDepth();
 
-		size_t cur = sector_history[i].history_size++
-					 % Unlag::MAX_HISTORY_TICS;
-		sector_history[i].history_ceilingheight[cur] = P_CeilingHeight(sector);
-		sector_history[i].history_floorheight[cur] = P_FloorHeight(sector);
+	SectorHistory& sh = sector_history;
+	const size_t cur = historyIndex(static_cast<int>(sh.recorded++));
+
+	for (size_t i = 0; i < sh.sector.size(); i++)
+	{
+		sh.ceilingheight[cur][i] = P_CeilingHeight(sh.sector[i]);
+		sh.floorheight[cur][i] = P_FloorHeight(sh.sector[i]);
 	}
 }
 
@@ -342,21 +479,27 @@ void Unlag::recordSectorPositions()
 //
 // Updates the pointer to player_t in each player history record.
 // The address of a player's player_t can change when a player is added to or
-// removed from the global 'players' vector.  Also recreate the player_id_map.
+// removed from the global 'players' vector.
 //
 
 void Unlag::refreshRegisteredPlayers()
 {
-	player_id_map.clear();
-	for (size_t i=0; i<player_history.size(); i++)
+	for (size_t i = 0; i < player_history.count; i++)
 	{
-		byte id = player_history[i].player_id;
-
-		player_history[i].player = &idplayer(id);
-		player_id_map[id] = i;
+		byte id = player_history.ids[i];
+		player_history.player[id] = &idplayer(id);
 	}
 }
 
+//
+// Unlag::isRegistered
+//
+
+bool Unlag::isRegistered(byte player_id) const
+{
+	return player_history.registered[player_id];
+}
+
 //
 // Unlag::registerPlayer
 //
@@ -373,10 +516,20 @@ void Unlag::registerPlayer(byte player_id)
 	if (!validplayer(idplayer(player_id)))
 		return;
 
-	player_history.push_back(PlayerHistoryRecord());
-	player_history.back().player_id = player_id;
-	player_history.back().history_size = 0;
-	player_history.back().changed_flags = false;
+	updateHistoryDepth();
+
+	PlayerHistory& ph = player_history;
+	if (!ph.registered[player_id])
+	{
+		ph.registered[player_id] = true;
+		ph.ids[ph.count++] = player_id;
+	}
+
+	ph.history_size[player_id] = 0;
+	ph.changed_flags[player_id] = false;
+	ph.current_lag[player_id] = 0;
+	ph.reconciles[player_id] = 0;
+	ph.reconcile_time[player_id] = 0;
 
 	refreshRegisteredPlayers();
 }
@@ -397,11 +550,20 @@ void Unlag::unregisterPlayer(byte player_id)
 	if (!Unlag::enabled())
 		return;
 
-	size_t history_index = player_id_map[player_id];
-	if (history_index >= player_history.size())
+	PlayerHistory& ph = player_history;
+	if (!ph.registered[player_id])
 		return;
 
-	player_history.erase(player_history.begin() + history_index);
+	ph.registered[player_id] = false;
+	for (size_t i = 0; i < ph.count; i++)
+	{
+		if (ph.ids[i] == player_id)
+		{
+			ph.ids[i] = ph.ids[--ph.count];
+			break;
+		}
+	}
+
 	refreshRegisteredPlayers();
 }
 
@@ -416,18 +578,35 @@ void Unlag::unregisterPlayer(byte player_id)
 
 void Unlag::registerSector(sector_t *sector)
 {
-	if (!Unlag::enabled())
+	if (!Unlag::enabled() || !sector)
 		return;
 
+	updateHistoryDepth();
+
+	SectorHistory& sh = sector_history;
+	const size_t secnum = sector - ::sectors;
+	if (sh.slot_by_sector.size() <= secnum)
+		sh.slot_by_sector.resize(std::max<size_t>(secnum + 1, ::numsectors), -1);
+
 	// Check if this sector already is in sector_history
-	for (size_t i=0; i<sector_history.size(); i++)
+	if (sh.slot_by_sector[secnum] >= 0)
+		return;
+
+	sh.slot_by_sector[secnum] = static_cast<int>(sh.sector.size());
+	sh.sector.push_back(sector);
+
+	// it hasn't moved until now
+	const fixed_t ceilingheight = P_CeilingHeight(sector);
+	const fixed_t floorheight = P_FloorHeight(sector);
+
+	for (size_t n = 0; n < history_depth; n++)
 	{
-		// note: comparing the pointers to the sector_t objects
-		if (sector_history[i].sector == sector)
-			return;
+		sh.ceilingheight[n].push_back(ceilingheight);
+		sh.floorheight[n].push_back(floorheight);
 	}
 
-	sector_history.push_back(SectorHistoryRecord(sector));
+	sh.backup_ceilingheight.push_back(ceilingheight);
+	sh.backup_floorheight.push_back(floorheight);
 }
 
 
@@ -440,18 +619,35 @@ void Unlag::registerSector(sector_t *sector)
 
 void Unlag::unregisterSector(sector_t *sector)
 {
-	if (!Unlag::enabled())
+	if (!Unlag::enabled() || !sector)
 		return;
 
-	for (size_t i=0; i<sector_history.size(); i++)
+	SectorHistory& sh = sector_history;
+	const size_t secnum = sector - ::sectors;
+	if (secnum >= sh.slot_by_sector.size() || sh.slot_by_sector[secnum] < 0)
+		return;
+
+	// move the last sector into the freed slot
+	const size_t slot = sh.slot_by_sector[secnum];
+	const size_t last = sh.sector.size() - 1;
+
+	sh.sector[slot] = sh.sector[last];
+	sh.backup_ceilingheight[slot] = sh.backup_ceilingheight[last];
+	sh.backup_floorheight[slot] = sh.backup_floorheight[last];
+	for (size_t n = 0; n < history_depth; n++)
 	{
-		// note: comparing the pointers to the sector_t objects
-		if (sector_history[i].sector == sector)
-		{
-			sector_history.erase(sector_history.begin() + i);
-			return;
-		}
+		sh.ceilingheight[n][slot] = sh.ceilingheight[n][last];
+		sh.floorheight[n][slot] = sh.floorheight[n][last];
+		sh.ceilingheight[n].pop_back();
+		sh.floorheight[n].pop_back();
 	}
+
+	sh.slot_by_sector[sh.sector[slot] - ::sectors] = static_cast<int>(slot);
+	sh.slot_by_sector[secnum] = -1;
+
+	sh.sector.pop_back();
+	sh.backup_ceilingheight.pop_back();
+	sh.backup_floorheight.pop_back();
 }
 
 
@@ -469,13 +665,18 @@ void Unlag::reconcile(byte shooter_id)
 	if (!Unlag::enabled())
 		return;
 
-	size_t player_index = player_id_map[shooter_id];
+	if (!isRegistered(shooter_id))
+		return;
 
-	size_t lag = player_history[player_index].current_lag;
+	// This tic's positions aren't recorded yet, so anything under a tic of
+	// lag is reconciled against the tic before it
+	fixed_t lag = player_history.current_lag[shooter_id];
+	if (lag > 0 && lag < FRACUNIT)
+		lag = FRACUNIT;
 
 	#ifdef _UNLAG_DEBUG_
 	DPrintf("Unlag (%03d): moving players to their positions at gametic %d (%d tics ago)\n",
-			gametic & 0xFF, (gametic - lag) & 0xFF, lag);
+			gametic & 0xFF, (gametic - (lag >> FRACBITS)) & 0xFF, lag >> FRACBITS);
 
 	// remove any other debugging player markers
 	AActor *mo;
@@ -494,17 +695,19 @@ void Unlag::reconcile(byte shooter_id)
 		if (mo)
 			mo->Destroy();
 	}
-
-	if (lag > Unlag::MAX_HISTORY_TICS)
-		DPrintf("Unlag (%03d): player %d has too great of lag (%d tics)\n",
-				gametic & 0xFF, shooter_id, lag);
 	#endif	// _UNLAG_DEBUG_
 
-	if (lag > 0 && lag < Unlag::MAX_HISTORY_TICS)
+	// one more recorded tic than the lag is needed to interpolate from
+	if (lag > 0 && static_cast<size_t>(lag >> FRACBITS) + 1 < history_depth)
 	{
+		const dtime_t start = I_GetTime();
+
 		reconcileSectorPositions(lag);
 		reconcilePlayerPositions(shooter_id, lag);
 		reconciled = true;
+
+		player_history.reconciles[shooter_id]++;
+		player_history.reconcile_time[shooter_id] += I_GetTime() - start;
 	}
 }
 
@@ -523,9 +726,14 @@ void Unlag::restore(byte shooter_id)
 
 	if (reconciled)
 	{
+		const dtime_t start = I_GetTime();
+
 		reconcileSectorPositions(0);
 		reconcilePlayerPositions(shooter_id, 0);
 		reconciled = false;	 // reset after restoring original positions
+
+		if (isRegistered(shooter_id))
+			player_history.reconcile_time[shooter_id] += I_GetTime() - start;
 	}
 
 	#ifdef _UNLAG_DEBUG_
@@ -537,35 +745,44 @@ void Unlag::restore(byte shooter_id)
 //
 // Unlag::setRoundtripDelay
 //
-// Sets the current_lag member variable for this particular player based on
-// the time it takes a message from the server to reach the client and the
-// reply to be received.  Since lag can spike/have sudden changes, we only
-// care about this value at the time a player fires a weapon.  The parameter
-// svgametic is the server gametic send when the server sends a positional
-// update, which is returned to the server when the client sends a ticcmd
-// that has the attack button pressed.
+// Sets the current_lag member variable for this particular player.  Since
+// lag can spike/have sudden changes, we only care about this value at the
+// time a player fires a weapon.
+//
+// The client's round trip time as measured by the reliable channel doesn't
+// snap to whole tics, but it leaves out how far behind the client renders
+// the world.  How far behind the world index the client sent with its
+// ticcmd is covers that, so the larger of the two is used.
+//
 
-void Unlag::setRoundtripDelay(byte player_id, byte svgametic)
+void Unlag::setRoundtripDelay(byte player_id, int worldindex)
 {
 	if (!Unlag::enabled())
 		return;
 
-	size_t maxdelay = TICRATE * sv_maxunlagtime;
-	if (maxdelay > Unlag::MAX_HISTORY_TICS)
-		maxdelay = Unlag::MAX_HISTORY_TICS;
+	if (!isRegistered(player_id))
+		return;
+
+	// one tic is kept on top of the longest delay to interpolate from
+	const fixed_t maxdelay =
+		static_cast<fixed_t>((wantedHistoryDepth() - 2) << FRACBITS);
 
-	size_t delay = ((gametic & 0xFF) + 256 - svgametic) & 0xFF;
+	const int srtt = player_history.player[player_id]->client.srtt;
 
-	size_t player_index = player_id_map[player_id];
-	player_history[player_index].current_lag = MIN(delay, maxdelay);
+	int64_t delay = static_cast<int64_t>(gametic - worldindex) << FRACBITS;
+	if (srtt >= 0)
+		delay = std::max(delay, static_cast<int64_t>(srtt) * TICRATE * FRACUNIT / 1000);
+
+	player_history.current_lag[player_id] =
+		static_cast<fixed_t>(clamp<int64_t>(delay, 0, maxdelay));
 
 	#ifdef _UNLAG_DEBUG_
-	DPrintf("Unlag (%03d): received gametic %d from player %d, lag = %d\n",
-					gametic & 0xFF, svgametic, player_id, delay);
+	DPrintf("Unlag (%03d): received gametic %d from player %d, lag = %d/%d\n",
+					gametic & 0xFF, worldindex & 0xFF, player_id,
+					player_history.current_lag[player_id], FRACUNIT);
 	#endif	// _UNLAG_DEBUG
 }
 
-
 //
 // Unlag::getReconciliationOffset
 //
@@ -577,15 +794,13 @@ void Unlag::getReconciliationOffset(	byte target_id,
 {
 	x = y = z = 0;
 
-	if (!reconciled)
+	if (!reconciled || !isRegistered(target_id))
 		return;
 
-	size_t target_index  = player_id_map[target_id];
-
 	// calculate how far the target was moved during reconciliation
-	x = player_history[target_index].offset_x;
-	y = player_history[target_index].offset_y;
-	z = player_history[target_index].offset_z;
+	x = player_history.offset_x[target_id];
+	y = player_history.offset_y[target_id];
+	z = player_history.offset_z[target_id];
 }
 
 
@@ -600,17 +815,19 @@ void Unlag::getCurrentPlayerPosition(	byte player_id,
 {
 	x = y = z = 0;
 
-	size_t cur = player_id_map[player_id];
-	player_t* player = player_history[cur].player;
+	if (!isRegistered(player_id))
+		return;
+
+	player_t* player = player_history.player[player_id];
 
 	if (!player || !player->mo || player->spectator)
 		return;
 
 	if (Unlag::enabled() && reconciled)
 	{
-		x = player_history[cur].backup_x;
-		y = player_history[cur].backup_y;
-		z = player_history[cur].backup_z;
+		x = player_history.backup_x[player_id];
+		y = player_history.backup_y[player_id];
+		z = player_history.backup_z[player_id];
 	}
 	else
 	{
@@ -630,20 +847,21 @@ void Unlag::debugReconciliation(byte shooter_id)
 {
 	player_t *shooter = &(idplayer(shooter_id));
 
-	for (size_t i = 0; i < player_history.size(); i++)
+	for (size_t i = 0; i < player_history.count; i++)
 	{
-		if (player_history[i].player->id == shooter_id)
+		const byte id = player_history.ids[i];
+		if (id == shooter_id)
 			continue;
 
-		for (size_t n = 0; n < MAX_HISTORY_TICS; n++)
+		for (size_t n = 0; n < history_depth; n++)
 		{
-			if (n > player_history[i].history_size)
+			if (n > player_history.history_size[id])
 				break;
 
-			size_t cur = (gametic - n) % Unlag::MAX_HISTORY_TICS;
+			const size_t cur = playerIndex(gametic - static_cast<int>(n), id);
 
-			fixed_t x = player_history[i].history_x[cur];
-			fixed_t y = player_history[i].history_y[cur];
+			fixed_t x = player_history.x[cur];
+			fixed_t y = player_history.y[cur];
 
 			angle_t angle = P_PointToAngle(shooter->mo->x,	shooter->mo->y, x, y);
 			angle_t deltaangle = 	angle - shooter->mo->angle < ANG180 ?
@@ -653,8 +871,53 @@ void Unlag::debugReconciliation(byte shooter_id)
 			if (deltaangle < 3 * FRACUNIT)
 			{
 				DPrintf("Unlag (%03d): would have hit player %d at gametic %d (%" PRIuSIZE " tics ago)\n",
-						gametic & 0xFF, player_history[i].player->id, (gametic - static_cast<int>(n)) & 0xFF, n);
+						gametic & 0xFF, id, (gametic - static_cast<int>(n)) & 0xFF, n);
 			}
 		}
 	}
 }
+
+
+//
+// Unlag::printStats
+//
+// Prints how far back each player's shots are reconciled and what it costs.
+//
+
+void Unlag::printStats()
+{
+	const PlayerHistory& ph = player_history;
+	const size_t player_bytes = history_depth * 3 * sizeof(fixed_t);
+
+	for (size_t i = 0; i < ph.count; i++)
+	{
+		const byte id = ph.ids[i];
+		const fixed_t lag = ph.current_lag[id];
+		const unsigned int reconciles = ph.reconciles[id];
+
+		Printf(PRINT_HIGH, "%3d %-16s lag %4dms (%.2f tics), %" PRIuSIZE " bytes, "
+		       "%u reconciles (%.1fus average)\n",
+		       id, ph.player[id]->userinfo.netname.c_str(),
+		       static_cast<int>(static_cast<int64_t>(lag) * 1000 / TICRATE >> FRACBITS),
+		       FIXED2FLOAT(lag), player_bytes, reconciles,
+		       reconciles ? ph.reconcile_time[id] / 1000.0 / reconciles : 0.0);
+	}
+
+	const size_t sector_bytes =
+		sector_history.sector.size() * history_depth * 2 * sizeof(fixed_t);
+
+	Printf(PRINT_HIGH, "%" PRIuSIZE " tics of history, %" PRIuSIZE " bytes for "
+	       "players, %" PRIuSIZE " bytes for %" PRIuSIZE " sectors\n",
+	       history_depth, player_history.x.size() * 3 * sizeof(fixed_t), sector_bytes,
+	       sector_history.sector.size());
+}
+
+#if defined(SERVER_APP)
+
+BEGIN_COMMAND(unlagstats)
+{
+	Unlag::getInstance().printStats();
+}
+END_COMMAND(unlagstats)
+
+#endif
@@ -27,7 +27,7 @@
 
 #pragma once
 
-#include <map>
+#include <vector>
 #include "m_fixed.h"
 #include "actor.h"
 #include "d_player.h"
@@ -47,76 +47,101 @@ public:
 	void unregisterPlayer(byte player_id);
 	void registerSector(sector_t *sector);
 	void unregisterSector(sector_t *sector);
-	void setRoundtripDelay(byte player_id, byte svgametic);
+	void setRoundtripDelay(byte player_id, int worldindex);
 	void getReconciliationOffset(	byte target_id,
 									fixed_t &x, fixed_t &y, fixed_t &z);
 	void getCurrentPlayerPosition(	byte player_id,
 									fixed_t &x, fixed_t &y, fixed_t &z);
+	void printStats();
 	static bool enabled();
 private:
-	static const size_t MAX_HISTORY_TICS = TICRATE;
-		
-	typedef struct {
-		byte		player_id;
+	// The longest sv_maxunlagtime allowed, which bounds the history kept.
+	static const size_t MAX_UNLAG_SECONDS = 5;
+	static const size_t MAX_UNLAG_PLAYERS = MAXPLAYERS + 1;
+
+	// Player history, indexed directly by player id.  Positions are stored
+	// tic first, so every player's position at one tic sits together and
+	// reconciling is a single pass over one row.
+	struct PlayerHistory
+	{
+		std::vector<fixed_t> x;
+		std::vector<fixed_t> y;
+		std::vector<fixed_t> z;
 
 		// cached pointer to players[n].  Note: this needs to be updated
 		// EVERYTIME a player connects or disconnects.
-		player_t*	player;
-	
-		fixed_t		history_x[Unlag::MAX_HISTORY_TICS];
-		fixed_t		history_y[Unlag::MAX_HISTORY_TICS];
-		fixed_t		history_z[Unlag::MAX_HISTORY_TICS];
-		size_t		history_size;
-		
+		player_t*	player[Unlag::MAX_UNLAG_PLAYERS];
+		size_t		history_size[Unlag::MAX_UNLAG_PLAYERS];
+
 		// current position. restore this position after reconciliation.
-		fixed_t		backup_x;
-		fixed_t		backup_y;
-		fixed_t		backup_z;
-
-		fixed_t		offset_x;
-		fixed_t		offset_y;
-		fixed_t		offset_z;
-		
+		fixed_t		backup_x[Unlag::MAX_UNLAG_PLAYERS];
+		fixed_t		backup_y[Unlag::MAX_UNLAG_PLAYERS];
+		fixed_t		backup_z[Unlag::MAX_UNLAG_PLAYERS];
+
+		fixed_t		offset_x[Unlag::MAX_UNLAG_PLAYERS];
+		fixed_t		offset_y[Unlag::MAX_UNLAG_PLAYERS];
+		fixed_t		offset_z[Unlag::MAX_UNLAG_PLAYERS];
+
 		// did we change player's MF_SHOOTABLE flag during reconciliation?
-		bool		changed_flags;
-		int			backup_flags; 
+		bool		changed_flags[Unlag::MAX_UNLAG_PLAYERS];
+		int			backup_flags[Unlag::MAX_UNLAG_PLAYERS];
 
-		size_t		current_lag;
-	} PlayerHistoryRecord;
-   
-	class SectorHistoryRecord
-	{
-	public:
-		SectorHistoryRecord();
-		SectorHistoryRecord(sector_t *sec);
+		// how far back this player's shots are reconciled, in tics
+		fixed_t		current_lag[Unlag::MAX_UNLAG_PLAYERS];
+
+		// for unlagstats
+		unsigned int	reconciles[Unlag::MAX_UNLAG_PLAYERS];
+		dtime_t			reconcile_time[Unlag::MAX_UNLAG_PLAYERS];
 
-		sector_t*	sector;
-		size_t		history_size;
-		fixed_t		history_ceilingheight[Unlag::MAX_HISTORY_TICS];
-		fixed_t		history_floorheight[Unlag::MAX_HISTORY_TICS];
+		// ids of the registered players, in no particular order
+		bool		registered[Unlag::MAX_UNLAG_PLAYERS];
+		byte		ids[Unlag::MAX_UNLAG_PLAYERS];
+		size_t		count;
+	};
+
+	// Sector history, one slot per registered sector.  Heights are stored
+	// tic first like player positions, and every sector is recorded on the
+	// same tic, so a single ring position covers all of them.
+	struct SectorHistory
+	{
+		std::vector<sector_t*>	sector;
+		std::vector<std::vector<fixed_t> >	ceilingheight;
+		std::vector<std::vector<fixed_t> >	floorheight;
 
 		// current position. restore this position after reconciliation.
-		fixed_t		backup_ceilingheight;
-		fixed_t		backup_floorheight;
+		std::vector<fixed_t>	backup_ceilingheight;
+		std::vector<fixed_t>	backup_floorheight;
+
+		// slot of each sector, indexed by sector number, -1 if it has none
+		std::vector<int>		slot_by_sector;
+
+		// number of times all sectors were recorded
+		size_t					recorded;
 	};
 
-	std::vector<PlayerHistoryRecord> player_history;
-	std::vector<SectorHistoryRecord> sector_history;
-	bool reconciled;	
-    
-    // stores an index into the player_history vector, keyed by player_id
-	std::map<byte, size_t> player_id_map;
+	PlayerHistory player_history;
+	SectorHistory sector_history;
+	bool reconciled;
+
+	// tics of history kept, follows sv_maxunlagtime
+	size_t history_depth;
 
-	Unlag() : reconciled(false) {}  // private contsructor (part of Singleton)
+	Unlag();						// private contsructor (part of Singleton)
 	Unlag(const Unlag &rhs);		// private copy constructor
 	Unlag& operator=(const Unlag &rhs);	//private assignment operator
 
 	void movePlayer(player_t *player, fixed_t x, fixed_t y, fixed_t z);
 	void moveSector(sector_t *sector, 
 					fixed_t ceilingheight, fixed_t floorheight);
-	void reconcilePlayerPositions(byte shooter_id, size_t ticsago);
-	void reconcileSectorPositions(size_t ticsago);
+	void reconcilePlayerPositions(byte shooter_id, fixed_t lag);
+	void reconcileSectorPositions(fixed_t lag);
 	void refreshRegisteredPlayers();
+	bool isRegistered(byte player_id) const;
+
+	size_t wantedHistoryDepth() const;
+	void updateHistoryDepth();
+	size_t historyIndex(int tic) const;
+	size_t playerIndex(int tic, byte player_id) const;
 
 	void debugReconciliation(byte shooter_id);
 };
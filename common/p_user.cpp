@@ -69,14 +69,36 @@ static player_t nullplayer;		// used to indicate 'player not found' when searchi
 EXTERN_CVAR (sv_allowmovebob)
 EXTERN_CVAR (cl_movebob)
 
+// Players indexed by id.  Whoever adds players to or removes them from the
+// players list is responsible for keeping this up to date, if they don't
+// the lookup falls back to a full search.
+static player_t* player_id_index[MAXPLAYERS + 1];
+
+void P_AddPlayerToIndex(player_t& player)
+{
+	player_id_index[player.id] = &player;
+}
+
+void P_RemovePlayerFromIndex(player_t& player)
+{
+	if (player_id_index[player.id] == &player)
+		player_id_index[player.id] = NULL;
+}
+
+void P_ClearPlayerIndex()
+{
+	for (size_t i = 0; i < ARRAY_LENGTH(player_id_index); i++)
+		player_id_index[i] = NULL;
+}
+
 player_t &idplayer(byte id)
 {
-	// Put a cached lookup mechanism in here.
+	if (player_id_index[id] != NULL)
+		return *player_id_index[id];
 
 	// full search
 	for (Players::iterator it = players.begin();it != players.end();++it)
 	{
-		// Add to the cache while we search
 		if (it->id == id)
 			return *it;
 	}
@@ -1364,6 +1386,7 @@ player_s::player_s() :
 	hazardinterval(0),
 	LastMessage(LastMessage_s()),
 	to_spawn(std::queue<AActor::AActorPtr>()),
+	awareness_cursor(0),
 	client(player_s::client_t())
 {
 	cmd.clear();
@@ -1489,6 +1512,7 @@ player_s &player_s::operator =(const player_s &other)
 	snapshots = other.snapshots;
 
 	to_spawn = other.to_spawn;
+	awareness_cursor = other.awareness_cursor;
 
 	doreborn = other.doreborn;
 	QueuePosition = other.QueuePosition;
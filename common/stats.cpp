@@ -31,9 +31,30 @@
 #include "i_system.h"
 
 std::vector<FStat*> FStat::stats;
+std::vector<FStat*> FStat::active;
+bool FStat::frame_used = false;
+size_t FStat::frames = 0;
 
-FStat::FStat (const char *cname)
-: name(cname)
+// Every clock/unclock pair, oldest first once the buffer wraps around.
+struct TraceEvent
+{
+	FStat *stat;
+	QWORD start, elapsed;
+};
+
+static const size_t TRACE_EVENTS = 1 << 16;
+static TraceEvent trace_events[TRACE_EVENTS];
+static size_t trace_pos = 0, trace_count = 0;
+static bool trace_enabled = false;
+
+static double NanoToMs(QWORD ns)
+{
+	return ns / 1000000.0;
+}
+
+FStat::FStat (const char *cname, bool chot)
+: last_clock(0), last_elapsed(0), name(cname), hot(chot), clock_parent(NULL),
+  frame_elapsed(0), frame_calls(0), history_pos(0), history_count(0)
 {
 	stats.push_back(this);
 }
@@ -44,21 +65,114 @@ FStat::~FStat ()
 	
 	if(i != stats.end())
 		stats.erase(i);
+
+	for(i = stats.begin(); i != stats.end(); ++i)
+	{
+		std::vector<Edge> &edges = (*i)->edges;
+		for(size_t j = 0; j < edges.size(); j++)
+		{
+			if(edges[j].parent == this)
+			{
+				edges.erase(edges.begin() + j);
+				j--;
+			}
+		}
+	}
 }
 
 void FStat::clock()
 {
-	last_clock = I_MSTime();
+	clock_parent = active.empty() ? NULL : active.back();
+
+	if(!hot)
+		active.push_back(this);
+	frame_used = true;
+
+	last_clock = I_GetTime();
 }
 
 void FStat::unclock()
 {
-	last_elapsed = I_MSTime() - last_clock;
+	QWORD now = I_GetTime();
+
+	last_elapsed = now - last_clock;
+	frame_elapsed += last_elapsed;
+	frame_calls++;
+
+	size_t i = 0;
+	while(i < edges.size() && edges[i].parent != clock_parent)
+		i++;
+
+	if(i == edges.size())
+	{
+		Edge edge = { clock_parent, 0, 0 };
+		edges.push_back(edge);
+	}
+
+	edges[i].elapsed += last_elapsed;
+	edges[i].calls++;
+
+	if(hot)
+		return;
+
+	if(!active.empty() && active.back() == this)
+		active.pop_back();
+
+	if(!trace_enabled)
+		return;
+
+	TraceEvent &ev = trace_events[trace_pos];
+	ev.stat = this;
+	ev.start = last_clock;
+	ev.elapsed = last_elapsed;
+
+	trace_pos = (trace_pos + 1) % TRACE_EVENTS;
+	if(trace_count < TRACE_EVENTS)
+		trace_count++;
 }
 
 void FStat::reset()
 {
 	last_elapsed = last_clock = 0;
+	frame_elapsed = 0;
+	frame_calls = 0;
+	history_pos = history_count = 0;
+	edges.clear();
+}
+
+void FStat::resetall()
+{
+	for(size_t i = 0; i < stats.size(); i++)
+		stats[i]->reset();
+
+	frames = 0;
+	trace_pos = trace_count = 0;
+}
+
+void FStat::endframe()
+{
+	// Nothing was clocked, so this wasn't a frame worth keeping.
+	if(!frame_used)
+		return;
+
+	for(size_t i = 0; i < stats.size(); i++)
+	{
+		FStat *stat = stats[i];
+
+		stat->history[stat->history_pos] = stat->frame_elapsed;
+		stat->history_calls[stat->history_pos] = stat->frame_calls;
+		stat->history_pos = (stat->history_pos + 1) % STAT_HISTORY;
+		if(stat->history_count < STAT_HISTORY)
+			stat->history_count++;
+
+		stat->frame_elapsed = 0;
+		stat->frame_calls = 0;
+	}
+
+	// Anything still running was left by an error, don't nest under it.
+	active.clear();
+	frame_used = false;
+	frames++;
 }
 
 const char *FStat::getname()
@@ -66,10 +180,72 @@ const char *FStat::getname()
 	return name.c_str();
 }
 
+void FStat::summarize(QWORD &lo, QWORD &avg, QWORD &p99, QWORD &hi, double &calls)
+{
+	lo = avg = p99 = hi = 0;
+	calls = 0.0;
+
+	if(history_count == 0)
+		return;
+
+	std::vector<QWORD> samples(history, history + history_count);
+	QWORD total = 0;
+	unsigned long long totalcalls = 0;
+
+	for(size_t i = 0; i < history_count; i++)
+	{
+		total += history[i];
+		totalcalls += history_calls[i];
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	lo = samples.front();
+	hi = samples.back();
+	avg = total / history_count;
+	p99 = samples[(history_count * 99 + 99) / 100 - 1];
+	calls = double(totalcalls) / history_count;
+}
+
+void FStat::dumptree(FStat *parent, std::vector<FStat*> &path)
+{
+	for(size_t i = 0; i < stats.size(); i++)
+	{
+		FStat *stat = stats[i];
+
+		// Two stats can each be clocked inside the other.
+		if(std::find(path.begin(), path.end(), stat) != path.end())
+			continue;
+
+		for(size_t j = 0; j < stat->edges.size(); j++)
+		{
+			const Edge &edge = stat->edges[j];
+			if(edge.parent != parent)
+				continue;
+
+			std::string label = std::string(path.size() * 2, ' ') + stat->name;
+			Printf(PRINT_HIGH, "%-28s %8.3f %7.1f\n", label.c_str(),
+			       frames ? NanoToMs(edge.elapsed) / frames : 0.0,
+			       frames ? double(edge.calls) / frames : 0.0);
+
+			path.push_back(stat);
+			dumptree(stat, path);
+			path.pop_back();
+		}
+	}
+}
+
 void FStat::dumpstat()
 {
+	std::vector<FStat*> path;
+
+	Printf(PRINT_HIGH, "%-28s %8s %7s\n", "by caller, per frame", "avg", "calls");
+	dumptree(NULL, path);
+
+	Printf(PRINT_HIGH, "\n%-28s %8s %8s %8s %8s %8s %7s\n", "ms per frame", "last",
+	       "min", "avg", "p99", "max", "calls");
 	for(size_t i = 0; i < stats.size(); i++)
-		Printf(PRINT_HIGH, "%s\n", stats[i]->getname());
+		stats[i]->dump();
 }
 
 void FStat::dumpstat(std::string which)
@@ -81,16 +257,76 @@ void FStat::dumpstat(std::string which)
 
 void FStat::dump()
 {
-	Printf(PRINT_HIGH, "%s: %llums\n", name.c_str(), last_elapsed);
+	QWORD lo, avg, p99, hi;
+	double calls;
+	summarize(lo, avg, p99, hi, calls);
+
+	// The last full frame, or the last call if there hasn't been one.
+	QWORD last = last_elapsed;
+	if(history_count)
+		last = history[(history_pos + STAT_HISTORY - 1) % STAT_HISTORY];
+
+	Printf(PRINT_HIGH, "%-28s %8.3f %8.3f %8.3f %8.3f %8.3f %7.1f\n", name.c_str(),
+	       NanoToMs(last), NanoToMs(lo), NanoToMs(avg), NanoToMs(p99),
+	       NanoToMs(hi), calls);
+}
+
+void FStat::settracing(bool enable)
+{
+	trace_enabled = enable;
+}
+
+bool FStat::tracing()
+{
+	return trace_enabled;
+}
+
+//
+// FStat::writetrace
+//
+// Writes the trace buffer in the Chrome trace event format, which can be
+// loaded with chrome://tracing or Perfetto.
+//
+bool FStat::writetrace(const char *filename)
+{
+	FILE *fh = fopen(filename, "w");
+	if(fh == NULL)
+		return false;
+
+	size_t first = (trace_pos + TRACE_EVENTS - trace_count) % TRACE_EVENTS;
+	QWORD base = 0;
+	for(size_t i = 0; i < trace_count; i++)
+	{
+		const TraceEvent &ev = trace_events[(first + i) % TRACE_EVENTS];
+		if(i == 0 || ev.start < base)
+			base = ev.start;
+	}
+
+	fprintf(fh, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for(size_t i = 0; i < trace_count; i++)
+	{
+		const TraceEvent &ev = trace_events[(first + i) % TRACE_EVENTS];
+		fprintf(fh, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+		        "\"ts\":%.3f,\"dur\":%.3f}\n", i ? "," : "", ev.stat->getname(),
+		        (ev.start - base) / 1000.0, ev.elapsed / 1000.0);
+	}
+	fprintf(fh, "]}\n");
+
+	fclose(fh);
+	return true;
 }
 
 BEGIN_COMMAND (stat)
 {
 	if (argc != 2)
 	{
-		Printf (PRINT_HIGH, "Usage: stat <statistics>\n");
+		Printf (PRINT_HIGH, "Usage: stat [<statistics>|reset]\n");
 		FStat::dumpstat ();
 	}
+	else if (stricmp(argv[1], "reset") == 0)
+	{
+		FStat::resetall ();
+	}
 	else
 	{
 		FStat::dumpstat (argv[1]);
@@ -98,5 +334,33 @@ BEGIN_COMMAND (stat)
 }
 END_COMMAND (stat)
 
+BEGIN_COMMAND (stattrace)
+{
+	if (argc == 2 && stricmp(argv[1], "start") == 0)
+	{
+		FStat::settracing (true);
+		Printf (PRINT_HIGH, "Stat tracing started.\n");
+	}
+	else if (argc == 2 && stricmp(argv[1], "stop") == 0)
+	{
+		FStat::settracing (false);
+		Printf (PRINT_HIGH, "Stat tracing stopped.\n");
+	}
+	else if (argc == 3 && stricmp(argv[1], "write") == 0)
+	{
+		if (FStat::writetrace (argv[2]))
+			Printf (PRINT_HIGH, "Wrote stat trace to %s.\n", argv[2]);
+		else
+			Printf (PRINT_WARNING, "Could not write stat trace to %s.\n", argv[2]);
+	}
+	else
+	{
+		Printf (PRINT_HIGH, "Usage: stattrace start|stop|write <filename>\n");
+		Printf (PRINT_HIGH, "Records stat timings for chrome://tracing, tracing is %s.\n",
+		        FStat::tracing () ? "on" : "off");
+	}
+}
+END_COMMAND (stattrace)
+
 
 VERSION_CONTROL (stats_cpp, "$Id$")
@@ -25,10 +25,24 @@
 
 #include <algorithm>
 
+//
+// FStat
+//
+// A named timer.  The time spent in each one is added up over a frame
+// (a single tic on the server) and kept for the last STAT_HISTORY frames.
+// Time is also added up for each stat it was clocked inside of, so a stat
+// reached from several places shows up under each of them.
+//
+// While tracing is on, every clock/unclock pair is recorded in a buffer
+// that can be written out for chrome://tracing.  Hot stats, ones clocked
+// many times a frame, are never traced and nothing nests under them.
+//
+// Stats are meant to be clocked from the main thread only.
+//
 class FStat
 {
 public:
-	FStat (const char *cname);
+	FStat (const char *cname, bool hot = false);
 
 	virtual ~FStat ();
 
@@ -40,19 +54,79 @@ public:
 
 	static void dumpstat();
 	static void dumpstat(std::string which);
+	static void resetall();
+	static void settracing(bool enable);
+	static bool tracing();
+	static bool writetrace(const char *filename);
 	void dump();
 
+	// Ends the frame, called once per pass through D_RunTics.
+	static void endframe();
+
+	static const size_t STAT_HISTORY = 256;
+
 private:
+	void summarize(QWORD &lo, QWORD &avg, QWORD &p99, QWORD &hi, double &calls);
+	static void dumptree(FStat *parent, std::vector<FStat*> &path);
 
 	QWORD last_clock, last_elapsed;
 	std::string name;
+	bool hot;
+
+	// Time spent in this stat while another one was running, NULL for
+	// when none was.
+	struct Edge
+	{
+		FStat *parent;
+		QWORD elapsed;
+		unsigned long long calls;
+	};
+	std::vector<Edge> edges;
+	FStat *clock_parent;
+
+	// Time and calls in the current frame and in the ones before it.
+	QWORD frame_elapsed;
+	unsigned int frame_calls;
+	QWORD history[STAT_HISTORY];
+	unsigned int history_calls[STAT_HISTORY];
+	size_t history_pos, history_count;
+
 	static std::vector<FStat*> stats;
+	static std::vector<FStat*> active;
+	static bool frame_used;
+	static size_t frames;
 };
 
-#define BEGIN_STAT(n) \
+// Clocks a stat for as long as it is in scope.
+class FStatScope
+{
+public:
+	FStatScope (FStat &stat) : m_stat(stat) { m_stat.clock(); }
+	~FStatScope () { m_stat.unclock(); }
+
+private:
+	FStat &m_stat;
+
+	FStatScope (const FStatScope &);
+	FStatScope &operator= (const FStatScope &);
+};
+
+#define DEFINE_STAT(n) \
 	static class Stat_##n : public FStat { \
 		public: \
 			Stat_##n () : FStat (#n) {} \
-} Stat_var_##n; Stat_var_##n.clock();
+} Stat_var_##n;
+
+#define DEFINE_HOT_STAT(n) \
+	static class Stat_##n : public FStat { \
+		public: \
+			Stat_##n () : FStat (#n, true) {} \
+} Stat_var_##n;
+
+#define BEGIN_STAT(n) DEFINE_STAT(n) Stat_var_##n.clock();
 
 #define END_STAT(n) Stat_var_##n.unclock();
+
+#define SCOPED_STAT(n) DEFINE_STAT(n) FStatScope Stat_scope_##n(Stat_var_##n);
+
+#define SCOPED_HOT_STAT(n) DEFINE_HOT_STAT(n) FStatScope Stat_scope_##n(Stat_var_##n);
@@ -481,10 +481,19 @@ odaproto::svc::UserInfo SVC_UserInfo(player_t& player, int64_t time)
  * @brief Update mobj data on the client compared to the baseline.
  */
 odaproto::svc::UpdateMobj SVC_UpdateMobj(AActor& mobj)
+{
+	return SVC_UpdateMobj(mobj, P_GetMobjBaselineFlags(mobj));
+}
+
+/**
+ * @brief Update the given fields of mobj data on the client.
+ *
+ * @param flags baseline_t flags of the fields to send.
+ */
+odaproto::svc::UpdateMobj SVC_UpdateMobj(AActor& mobj, uint32_t flags)
 {
 	odaproto::svc::UpdateMobj msg;
 
-	uint32_t flags = P_GetMobjBaselineFlags(mobj);
 	msg.set_flags(flags);
 
 	odaproto::Actor* act = msg.mutable_actor();
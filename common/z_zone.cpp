@@ -32,6 +32,7 @@
 #include "c_dispatch.h"
 #include "hashtable.h"
 #include "cmdlib.h"
+#include "m_argv.h"
 
 struct OFileLine
 {
@@ -81,6 +82,23 @@ static const char* TagStr(const zoneTag_e tag)
 	}
 }
 
+// Tags are small numbers, so they can index arrays.
+static const int NUM_ZONE_TAGS = PU_CACHE + 1;
+
+static void DumpTagStats(const size_t* count, const size_t* bytes)
+{
+	std::string buf;
+	for (int tag = 0; tag < NUM_ZONE_TAGS; tag++)
+	{
+		if (count[tag] == 0)
+			continue;
+
+		StrFormatBytes(buf, bytes[tag]);
+		Printf("  %-14s %7" PRIuSIZE " blocks, %s\n",
+		       TagStr(static_cast<zoneTag_e>(tag)), count[tag], buf.c_str());
+	}
+}
+
 //
 // OZone
 //
@@ -248,17 +266,29 @@ class OZone
 		}
 	}
 
-	void dump()
+	void dump(const int lowtag, const int hightag)
 	{
 		size_t total = 0;
+		size_t tagcount[NUM_ZONE_TAGS] = {0}, tagbytes[NUM_ZONE_TAGS] = {0};
 		for (MemoryBlockTable::iterator it = m_heap.begin(); it != m_heap.end(); ++it)
 		{
 			total += it->second.size;
+			if (it->second.tag < NUM_ZONE_TAGS)
+			{
+				tagcount[it->second.tag]++;
+				tagbytes[it->second.tag] += it->second.size;
+			}
+
+			if (it->second.tag < lowtag || it->second.tag > hightag)
+				continue;
+
 			Printf("0x%p | size:%ui tag:%s user:0x%p %s:%d\n", it->first,
 			       it->second.size, TagStr(it->second.tag), it->second.user,
 			       it->second.fileLine.shortFile(), it->second.fileLine.line);
 		}
 
+		DumpTagStats(tagcount, tagbytes);
+
 		std::string buf;
 		Printf("  allocation count: %" PRIuSIZE "\n", m_heap.size());
 
@@ -268,7 +298,558 @@ class OZone
 		StrFormatBytes(buf, m_heap.size() * sizeof(MemoryBlockInfo));
 		Printf("  blocks size: %s\n", buf.c_str());
 	}
-} g_zone;
+} g_debugzone;
+
+
+//
+// OArenaZone
+//
+// The allocator used unless -zonedebug is given.  Every block carries a small
+// header in front of it instead of an entry in a table.
+//
+// Small blocks with a level tag come out of size-class slabs in an arena for
+// that tag, so thinkers and actors are cheap to allocate and free, and freeing
+// a level tag hands the arena's chunks back all at once.  Everything else is
+// allocated with malloc and kept in a list for its tag.
+//
+// A block that is moved out of its arena's tag with Z_ChangeTag pins the
+// chunk it lives in, which is then kept around until the block is freed.
+//
+class OArenaZone
+{
+	static const uint32_t ZONEID = 0x1d4a11;
+	static const size_t ZONE_ALIGN = 16;
+	static const size_t CHUNK_SIZE = 256 * 1024;
+	static const size_t MAX_SLAB_SIZE = 2048;
+	static const int NUM_ARENAS = PU_LEVELMAX - PU_LEVEL + 1;
+	static const BYTE NO_CLASS = 0xFF;
+
+	// Enough for the size classes built in the constructor.
+	static const int NUM_CLASSES_MAX = 32;
+
+	struct Chunk
+	{
+		Chunk* next;
+		size_t pinned;  // blocks that were moved to another tag
+		bool retired;   // the arena was freed, only pinned blocks are left
+	};
+
+	struct Block
+	{
+		Block* prev;    // tag list
+		Block* next;    // tag list, or the next free block in a slab
+		void** user;
+		Chunk* chunk;   // NULL if the block came from malloc
+		uint32_t size;
+		uint32_t id;    // ZONEID, 0 once freed
+		BYTE tag;
+		BYTE arenatag;  // tag of the arena the block came from
+		BYTE sizeclass; // NO_CLASS if the block came from malloc
+		bool listed;
+	};
+
+	struct Arena
+	{
+		Chunk* chunks;
+		char* bump;
+		char* bumpend;
+		Block* freelist[NUM_CLASSES_MAX];
+		size_t numchunks;
+	};
+
+	static size_t roundUp(size_t size)
+	{
+		return (size + ZONE_ALIGN - 1) & ~(ZONE_ALIGN - 1);
+	}
+
+	static size_t headerSize()
+	{
+		return roundUp(sizeof(Block));
+	}
+
+	static size_t chunkHeaderSize()
+	{
+		return roundUp(sizeof(Chunk));
+	}
+
+	static Block* toBlock(void* ptr)
+	{
+		return reinterpret_cast<Block*>(static_cast<char*>(ptr) - headerSize());
+	}
+
+	static void* toPtr(Block* block)
+	{
+		return reinterpret_cast<char*>(block) + headerSize();
+	}
+
+	static bool isArenaTag(int tag)
+	{
+		return tag >= PU_LEVEL && tag <= PU_LEVELMAX;
+	}
+
+	size_t m_classSize[NUM_CLASSES_MAX];
+	BYTE m_sizeToClass[MAX_SLAB_SIZE / ZONE_ALIGN + 1];
+	int m_numClasses;
+
+	Arena m_arenas[NUM_ARENAS];
+	Block* m_tagList[NUM_ZONE_TAGS];
+	Chunk* m_retired;
+
+	// Statistics
+	size_t m_tagCount[NUM_ZONE_TAGS];
+	size_t m_tagBytes[NUM_ZONE_TAGS];
+	size_t m_numChunks;
+	size_t m_numRetired;
+	size_t m_peakChunks;
+	unsigned long long m_slabAllocs;
+	unsigned long long m_slabReuses;
+	unsigned long long m_mallocs;
+	unsigned long long m_arenaReleases;
+
+	void link(Block* block)
+	{
+		Block*& head = m_tagList[block->tag];
+		block->prev = NULL;
+		block->next = head;
+		if (head)
+			head->prev = block;
+		head = block;
+		block->listed = true;
+	}
+
+	void unlink(Block* block)
+	{
+		if (!block->listed)
+			return;
+
+		if (block->prev)
+			block->prev->next = block->next;
+		else
+			m_tagList[block->tag] = block->next;
+		if (block->next)
+			block->next->prev = block->prev;
+		block->listed = false;
+	}
+
+	// Blocks from malloc are always listed, so Z_FreeTags can find them.
+	// Arena blocks only need to be if someone has to be told they're gone
+	// or they don't go away with their arena.
+	bool wantListed(const Block* block) const
+	{
+		return block->chunk == NULL || block->user != NULL ||
+		       block->tag != block->arenatag || block->chunk->retired;
+	}
+
+	Chunk* newChunk(const OFileLine& info)
+	{
+		Chunk* chunk = static_cast<Chunk*>(malloc(CHUNK_SIZE));
+		if (chunk == NULL)
+		{
+			I_Error("%s: Could not allocate a chunk at %s:%i.", __FUNCTION__,
+			        info.shortFile(), info.line);
+		}
+
+		chunk->pinned = 0;
+		chunk->retired = false;
+
+		m_numChunks++;
+		if (m_numChunks > m_peakChunks)
+			m_peakChunks = m_numChunks;
+
+		return chunk;
+	}
+
+	void freeChunk(Chunk* chunk)
+	{
+		free(chunk);
+		m_numChunks--;
+	}
+
+	Block* slabAlloc(Arena& arena, const int cls, const OFileLine& info)
+	{
+		Block* block = arena.freelist[cls];
+		if (block != NULL)
+		{
+			arena.freelist[cls] = block->next;
+			m_slabReuses++;
+			return block;
+		}
+
+		const size_t stride = headerSize() + m_classSize[cls];
+		if (arena.bump == NULL || arena.bump + stride > arena.bumpend)
+		{
+			Chunk* chunk = newChunk(info);
+			chunk->next = arena.chunks;
+			arena.chunks = chunk;
+			arena.numchunks++;
+
+			arena.bump = reinterpret_cast<char*>(chunk) + chunkHeaderSize();
+			arena.bumpend = reinterpret_cast<char*>(chunk) + CHUNK_SIZE;
+		}
+
+		block = reinterpret_cast<Block*>(arena.bump);
+		block->chunk = arena.chunks;
+		arena.bump += stride;
+
+		m_slabAllocs++;
+		return block;
+	}
+
+	// Give a block's memory back, without touching its owner.
+	void release(Block* block)
+	{
+		unlink(block);
+
+		m_tagCount[block->tag]--;
+		m_tagBytes[block->tag] -= block->size;
+		block->id = 0;
+
+		Chunk* chunk = block->chunk;
+		if (chunk == NULL)
+		{
+			free(block);
+			return;
+		}
+
+		if (chunk->retired)
+		{
+			// Every block left in a retired chunk pins it.
+			if (--chunk->pinned == 0)
+				freeRetired(chunk);
+			return;
+		}
+
+		if (block->tag != block->arenatag)
+			chunk->pinned--;
+
+		Arena& arena = m_arenas[block->arenatag - PU_LEVEL];
+		block->next = arena.freelist[block->sizeclass];
+		arena.freelist[block->sizeclass] = block;
+	}
+
+	void freeRetired(Chunk* chunk)
+	{
+		for (Chunk** it = &m_retired; *it; it = &(*it)->next)
+		{
+			if (*it == chunk)
+			{
+				*it = chunk->next;
+				break;
+			}
+		}
+
+		m_numRetired--;
+		freeChunk(chunk);
+	}
+
+	// Hand back every chunk of an arena, except those holding blocks that
+	// were moved to another tag.
+	void releaseArena(const int tag)
+	{
+		Arena& arena = m_arenas[tag - PU_LEVEL];
+
+		Chunk* chunk = arena.chunks;
+		while (chunk)
+		{
+			Chunk* next = chunk->next;
+			if (chunk->pinned > 0)
+			{
+				chunk->retired = true;
+				chunk->next = m_retired;
+				m_retired = chunk;
+				m_numRetired++;
+			}
+			else
+			{
+				freeChunk(chunk);
+			}
+			chunk = next;
+		}
+
+		memset(&arena, 0, sizeof(arena));
+		m_arenaReleases++;
+
+		// Whatever was left with this tag went away with the arena.
+		m_tagCount[tag] = 0;
+		m_tagBytes[tag] = 0;
+	}
+
+	Block* checkBlock(void* ptr, const char* func, const OFileLine& info)
+	{
+		Block* block = toBlock(ptr);
+		if (block->id != ZONEID)
+		{
+			I_Error("%s: Address 0x%p is not tracked by zone at %s:%i.", func, ptr,
+			        info.shortFile(), info.line);
+		}
+		return block;
+	}
+
+  public:
+	OArenaZone()
+	{
+		// 16 byte steps up to 256 bytes, then four steps per doubling.
+		m_numClasses = 0;
+		for (size_t size = ZONE_ALIGN; size <= 256; size += ZONE_ALIGN)
+			m_classSize[m_numClasses++] = size;
+		for (size_t base = 256; base < MAX_SLAB_SIZE; base *= 2)
+		{
+			for (size_t step = 1; step <= 4; step++)
+				m_classSize[m_numClasses++] = base + base / 4 * step;
+		}
+
+		int cls = 0;
+		for (size_t i = 0; i <= MAX_SLAB_SIZE / ZONE_ALIGN; i++)
+		{
+			while (m_classSize[cls] < i * ZONE_ALIGN)
+				cls++;
+			m_sizeToClass[i] = static_cast<BYTE>(cls);
+		}
+
+		memset(m_arenas, 0, sizeof(m_arenas));
+		memset(m_tagList, 0, sizeof(m_tagList));
+		m_retired = NULL;
+		resetStats();
+		m_numChunks = m_numRetired = m_peakChunks = 0;
+	}
+
+	~OArenaZone()
+	{
+		clear();
+	}
+
+	void resetStats()
+	{
+		memset(m_tagCount, 0, sizeof(m_tagCount));
+		memset(m_tagBytes, 0, sizeof(m_tagBytes));
+		m_slabAllocs = m_slabReuses = m_mallocs = m_arenaReleases = 0;
+	}
+
+	void clear()
+	{
+		for (int tag = 0; tag < NUM_ZONE_TAGS; tag++)
+			deallocTag(tag);
+		for (int tag = PU_LEVEL; tag <= PU_LEVELMAX; tag++)
+			releaseArena(tag);
+
+		// Blocks moved out of an arena were freed with their tag above.
+		while (m_retired)
+			freeRetired(m_retired);
+	}
+
+	void* alloc(size_t size, zoneTag_e tag, void* user, const OFileLine& info)
+	{
+		if (size == 0)
+		{
+			return NULL;
+		}
+
+		if (tag <= PU_FREE || tag >= NUM_ZONE_TAGS)
+		{
+			I_Error("%s: Bad tag %i at %s:%i.", __FUNCTION__, tag, info.shortFile(),
+			        info.line);
+		}
+
+		Block* block;
+		if (isArenaTag(tag) && size <= MAX_SLAB_SIZE)
+		{
+			const int cls = m_sizeToClass[(size + ZONE_ALIGN - 1) / ZONE_ALIGN];
+			block = slabAlloc(m_arenas[tag - PU_LEVEL], cls, info);
+			block->sizeclass = static_cast<BYTE>(cls);
+		}
+		else
+		{
+			// Our interface is malloc-like, so we use malloc and not new.
+			block = static_cast<Block*>(malloc(headerSize() + size));
+			if (block == NULL)
+			{
+				// Don't format these bytes, the byte formatter allocates.
+				I_Error("%s: Could not allocate %" PRI_SIZE_PREFIX "u bytes at %s:%i.",
+				        __FUNCTION__, size, info.shortFile(), info.line);
+			}
+			block->chunk = NULL;
+			block->sizeclass = NO_CLASS;
+			m_mallocs++;
+		}
+
+		block->size = size > MAXUINT ? MAXUINT : static_cast<uint32_t>(size);
+		block->id = ZONEID;
+		block->tag = static_cast<BYTE>(tag);
+		block->arenatag = static_cast<BYTE>(tag);
+		block->user = static_cast<void**>(user);
+		block->listed = false;
+		if (wantListed(block))
+			link(block);
+
+		m_tagCount[tag]++;
+		m_tagBytes[tag] += block->size;
+
+		void* ptr = toPtr(block);
+		if (block->user != NULL)
+		{
+			*block->user = ptr;
+		}
+
+		return ptr;
+	}
+
+	void changeTag(void* ptr, zoneTag_e tag, const OFileLine& info)
+	{
+		if (tag == PU_FREE)
+		{
+			I_Error("%s: Tried to change a tag to PU_FREE at %s:%i.", __FUNCTION__,
+			        info.shortFile(), info.line);
+		}
+
+		if (tag < PU_FREE || tag >= NUM_ZONE_TAGS)
+		{
+			I_Error("%s: Bad tag %i at %s:%i.", __FUNCTION__, tag, info.shortFile(),
+			        info.line);
+		}
+
+		Block* block = checkBlock(ptr, __FUNCTION__, info);
+
+		if (tag >= PU_PURGELEVEL && block->user == NULL)
+		{
+			I_Error("%s: Found purgable block without an owner at %s:%i.",
+			        __FUNCTION__, info.shortFile(), info.line);
+		}
+
+		if (tag == block->tag)
+			return;
+
+		if (block->chunk != NULL && !block->chunk->retired)
+		{
+			if (block->tag == block->arenatag)
+				block->chunk->pinned++;
+			else if (tag == block->arenatag)
+				block->chunk->pinned--;
+		}
+
+		unlink(block);
+
+		m_tagCount[block->tag]--;
+		m_tagBytes[block->tag] -= block->size;
+		block->tag = static_cast<BYTE>(tag);
+		m_tagCount[tag]++;
+		m_tagBytes[tag] += block->size;
+
+		if (wantListed(block))
+			link(block);
+	}
+
+	void changeOwner(void* ptr, void* user, const OFileLine& info)
+	{
+		// [AM] Nothing calls this as far as I know.
+		I_Error("%s: not implemented", __FUNCTION__);
+	}
+
+	void deallocPtr(void* ptr, const OFileLine& info)
+	{
+		if (ptr == NULL)
+			return;
+
+		Block* block = checkBlock(ptr, __FUNCTION__, info);
+
+		if (block->user)
+		{
+			*block->user = NULL;
+		}
+
+		release(block);
+	}
+
+	void deallocTag(const int tag)
+	{
+		Block* block = m_tagList[tag];
+		while (block)
+		{
+			Block* next = block->next;
+
+			if (block->user)
+			{
+				*block->user = NULL;
+			}
+
+			// Blocks still in their own arena go away with it.
+			if (block->chunk != NULL && block->tag == block->arenatag &&
+			    !block->chunk->retired)
+			{
+				unlink(block);
+				block->id = 0;
+			}
+			else
+			{
+				release(block);
+			}
+
+			block = next;
+		}
+	}
+
+	void deallocTags(const int lowtag, const int hightag)
+	{
+		const int lo = MAX(lowtag, 0);
+		const int hi = MIN(hightag, NUM_ZONE_TAGS - 1);
+
+		for (int tag = lo; tag <= hi; tag++)
+		{
+			deallocTag(tag);
+			if (isArenaTag(tag))
+				releaseArena(tag);
+		}
+	}
+
+	void dump(const int lowtag, const int hightag)
+	{
+		for (int tag = MAX(lowtag, 0); tag <= MIN(hightag, NUM_ZONE_TAGS - 1); tag++)
+		{
+			for (Block* block = m_tagList[tag]; block; block = block->next)
+			{
+				Printf("0x%p | size:%u tag:%s user:0x%p%s\n", toPtr(block),
+				       block->size, TagStr(static_cast<zoneTag_e>(block->tag)),
+				       block->user, block->chunk ? " (arena)" : "");
+			}
+		}
+
+		DumpTagStats(m_tagCount, m_tagBytes);
+
+		std::string buf;
+		size_t count = 0, total = 0;
+		for (int tag = 0; tag < NUM_ZONE_TAGS; tag++)
+		{
+			count += m_tagCount[tag];
+			total += m_tagBytes[tag];
+		}
+
+		Printf("  allocation count: %" PRIuSIZE "\n", count);
+
+		StrFormatBytes(buf, total);
+		Printf("  allocs size: %s\n", buf.c_str());
+
+		for (int i = 0; i < NUM_ARENAS; i++)
+		{
+			size_t free = 0;
+			for (int cls = 0; cls < m_numClasses; cls++)
+			{
+				for (Block* block = m_arenas[i].freelist[cls]; block; block = block->next)
+					free++;
+			}
+			Printf("  %s arena: %" PRIuSIZE " chunks, %" PRIuSIZE " free slab blocks\n",
+			       TagStr(static_cast<zoneTag_e>(PU_LEVEL + i)), m_arenas[i].numchunks,
+			       free);
+		}
+
+		StrFormatBytes(buf, m_numChunks * CHUNK_SIZE);
+		Printf("  chunks: %" PRIuSIZE " (%s), %" PRIuSIZE " retired, %" PRIuSIZE " peak\n",
+		       m_numChunks, buf.c_str(), m_numRetired, m_peakChunks);
+		Printf("  slab allocs: %llu new, %llu reused; %llu mallocs; %llu arena releases\n",
+		       m_slabAllocs, m_slabReuses, m_mallocs, m_arenaReleases);
+	}
+} g_arenazone;
+
+// -zonedebug switches to OZone, for running under valgrind and the like.
+static bool zone_debug = false;
 
 
 //
@@ -276,7 +857,8 @@ class OZone
 //
 void STACK_ARGS Z_Close()
 {
-	g_zone.clear();
+	g_debugzone.clear();
+	g_arenazone.clear();
 }
 
 //
@@ -284,7 +866,19 @@ void STACK_ARGS Z_Close()
 //
 void Z_Init()
 {
-	g_zone.clear();
+	g_debugzone.clear();
+	g_arenazone.clear();
+
+	zone_debug = Args.CheckParm("-zonedebug") != 0;
+}
+
+//
+// Z_AllocatorName
+//
+const char* Z_AllocatorName()
+{
+	return zone_debug ? "native allocator with OZone bookkeeping"
+	                  : "tagged arena allocator";
 }
 
 
@@ -293,7 +887,10 @@ void Z_Init()
 //
 void Z_Free2(void* ptr, const char* file, int line)
 {
-	g_zone.deallocPtr(ptr, OFileLine::create(file, line));
+	if (zone_debug)
+		g_debugzone.deallocPtr(ptr, OFileLine::create(file, line));
+	else
+		g_arenazone.deallocPtr(ptr, OFileLine::create(file, line));
 }
 
 
@@ -301,13 +898,13 @@ void Z_Free2(void* ptr, const char* file, int line)
 // Z_Malloc
 // You can pass a NULL user if the tag is < PU_PURGELEVEL.
 //
-#define MINFRAGMENT	64
-#define ALIGN		8
-
 void* Z_Malloc2(size_t size, const zoneTag_e tag, void* user, const char* file,
                 const int line)
 {
-	return g_zone.alloc(size, tag, user, OFileLine::create(file, line));
+	if (zone_debug)
+		return g_debugzone.alloc(size, tag, user, OFileLine::create(file, line));
+
+	return g_arenazone.alloc(size, tag, user, OFileLine::create(file, line));
 }
 
 
@@ -316,7 +913,10 @@ void* Z_Malloc2(size_t size, const zoneTag_e tag, void* user, const char* file,
 //
 void Z_FreeTags(const zoneTag_e lowtag, const zoneTag_e hightag)
 {
-	return ::g_zone.deallocTags(lowtag, hightag);
+	if (zone_debug)
+		::g_debugzone.deallocTags(lowtag, hightag);
+	else
+		::g_arenazone.deallocTags(lowtag, hightag);
 }
 
 //
@@ -324,13 +924,19 @@ void Z_FreeTags(const zoneTag_e lowtag, const zoneTag_e hightag)
 //
 void Z_ChangeTag2(void* ptr, const zoneTag_e tag, const char* file, int line)
 {
-	return ::g_zone.changeTag(ptr, tag, OFileLine::create(file, line));
+	if (zone_debug)
+		::g_debugzone.changeTag(ptr, tag, OFileLine::create(file, line));
+	else
+		::g_arenazone.changeTag(ptr, tag, OFileLine::create(file, line));
 }
 
 
 void Z_ChangeOwner2(void* ptr, void* user, const char* file, int line)
 {
-	return ::g_zone.changeOwner(ptr, user, OFileLine::create(file, line));
+	if (zone_debug)
+		::g_debugzone.changeOwner(ptr, user, OFileLine::create(file, line));
+	else
+		::g_arenazone.changeOwner(ptr, user, OFileLine::create(file, line));
 }
 
 //
@@ -339,7 +945,12 @@ void Z_ChangeOwner2(void* ptr, void* user, const char* file, int line)
 //
 void Z_DumpHeap(const zoneTag_e lowtag, const zoneTag_e hightag)
 {
-	::g_zone.dump();
+	Printf("Using the %s.\n", Z_AllocatorName());
+
+	if (zone_debug)
+		::g_debugzone.dump(lowtag, hightag);
+	else
+		::g_arenazone.dump(lowtag, hightag);
 }
 
 BEGIN_COMMAND(dumpheap)
@@ -47,6 +47,7 @@ enum zoneTag_e
 
 void Z_Init();
 void Z_Close();
+const char* Z_AllocatorName();
 void Z_FreeTags(const zoneTag_e lowtag, const zoneTag_e hightag);
 void Z_DumpHeap(const zoneTag_e lowtag, const zoneTag_e hightag);
 
@@ -32,6 +32,7 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <map>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -89,17 +90,73 @@ typedef struct server
 list<SServer> servers;
 list<SServer>::iterator ping_itr = servers.begin(); // this iterator must be updated when servers is changed
 
-bool ipReachedLimit(netadr_t addr)
+// servers by address, and how many verified servers each IP has
+typedef map<uint64_t, list<SServer>::iterator> server_index_t;
+typedef map<uint32_t, int> ip_count_t;
+
+server_index_t server_index;
+ip_count_t verified_per_ip;
+
+// the reply to launchers, rebuilt only when the list of verified servers
+// has changed
+buf_t serverlist(MAX_UDP_PACKET);
+bool serverlist_dirty = true;
+
+uint32_t ipKey(const netadr_t &addr)
 {
-	list<SServer>::iterator itr;
-	int verifiedservers = 0;
+	uint32_t key;
+	memcpy(&key, addr.ip, sizeof(key));
+	return key;
+}
 
-	// count verified servers
-	for (itr = servers.begin(); itr != servers.end(); ++itr)
-		if ((*itr).verified && memcmp(&(*itr).addr.ip, &addr.ip, 4) == 0)
-			verifiedservers++;
+uint64_t addrKey(const netadr_t &addr)
+{
+	return ((uint64_t)ipKey(addr) << 16) | addr.port;
+}
+
+list<SServer>::iterator findServer(const netadr_t &addr)
+{
+	server_index_t::iterator it = server_index.find(addrKey(addr));
+
+	if (it == server_index.end())
+		return servers.end();
+
+	return it->second;
+}
+
+void setVerified(SServer &s)
+{
+	if (s.verified)
+		return;
+
+	s.verified = true;
+	verified_per_ip[ipKey(s.addr)]++;
+	serverlist_dirty = true;
+}
+
+list<SServer>::iterator removeServer(list<SServer>::iterator itr)
+{
+	if ((*itr).verified)
+	{
+		ip_count_t::iterator count = verified_per_ip.find(ipKey((*itr).addr));
+		if (count != verified_per_ip.end() && --count->second <= 0)
+			verified_per_ip.erase(count);
+
+		serverlist_dirty = true;
+	}
 
-	return verifiedservers >= MAX_SERVERS_PER_IP;
+	if(ping_itr == itr)
+		++ping_itr;
+
+	server_index.erase(addrKey((*itr).addr));
+	return servers.erase(itr);
+}
+
+bool ipReachedLimit(netadr_t addr)
+{
+	ip_count_t::iterator count = verified_per_ip.find(ipKey(addr));
+
+	return count != verified_per_ip.end() && count->second >= MAX_SERVERS_PER_IP;
 }
 
 void addServer(netadr_t addr)
@@ -107,17 +164,12 @@ void addServer(netadr_t addr)
 	list<SServer>::iterator itr;
 	SServer temp;
 
-	for (itr = servers.begin(); itr != servers.end(); ++itr)
+	itr = findServer(addr);
+	if (itr != servers.end())
 	{
-		if (memcmp(&(*itr).addr.ip, &addr.ip, 4) == 0)
-		{
-			if ((*itr).addr.port == addr.port)
-			{
-				(*itr).age = 0;
-				(*itr).pinged = false;
-				return;
-			}
-		}
+		(*itr).age = 0;
+		(*itr).pinged = false;
+		return;
 	}
 
 	if (servers.size() < MAX_SERVERS)
@@ -127,7 +179,7 @@ void addServer(netadr_t addr)
 
 		memcpy(&temp.addr, &addr, sizeof(addr));
 		temp.age = 0;
-		servers.push_back(temp);
+		server_index[addrKey(temp.addr)] = servers.insert(servers.end(), temp);
 
 		printf("Added new server: %s, %d total\n", NET_AdrToString(temp.addr), (int)servers.size());
 		FILE *fp = fopen(LOGFILE, "a");
@@ -150,32 +202,29 @@ void addServerInfo(netadr_t addr)
 	list<SServer>::iterator itr;
 	size_t i;
 
-	for (itr = servers.begin(); itr != servers.end(); ++itr)
+	itr = findServer(addr);
+	if (itr != servers.end())
 	{
-		if (memcmp(&(*itr).addr.ip, &addr.ip, 4) != 0)
-			continue;
-
-		if ((*itr).addr.port != addr.port)
-			continue;
-
 		SServer &s = *itr;
 
 		if(!s.key_sent)
-			continue;
+			return;
 
 		net_message.ReadLong();
 
 		// check key against one we issued
 		if((unsigned)net_message.ReadLong() != s.key_sent)
-			continue;
+			return;
 
 		// do not allow too many servers
-		if(ipReachedLimit((*itr).addr))
-			continue;
+		// a verified server already counts towards its IP's limit, so with
+		// the limit reached it would refuse its own updates and age out
+		if(!s.verified && ipReachedLimit((*itr).addr))
+			return;
 
 		printf("Server info, IP = %s\n", NET_AdrToString(addr));
 
-		s.verified = true;
+		setVerified(s);
 		s.age = 0;
 
 		s.hostname = net_message.ReadString();
@@ -211,8 +260,6 @@ void addServerInfo(netadr_t addr)
 			s.playerpings[i] = net_message.ReadLong();
 			s.playerteams[i] = net_message.ReadByte();
 		}
-
-		break;
 	}
 
 	return;
@@ -233,9 +280,7 @@ void ageServers(void)
 			if ((*itr).age > MAX_SERVER_AGE)
 			{
 				printf("Remote server timed out: %s, ", NET_AdrToString((*itr).addr));
-				if(ping_itr == itr)
-					++ping_itr;
-				itr = servers.erase(itr);
+				itr = removeServer(itr);
 				printf("%d total\n", (int)servers.size());
 			}
 			else
@@ -246,9 +291,7 @@ void ageServers(void)
 			if ((*itr).age > MAX_UNVERIFIED_SERVER_AGE)
 			{
 				printf("Remote server timed out: %s, ", NET_AdrToString((*itr).addr));
-				if(ping_itr == itr)
-					++ping_itr;
-				itr = servers.erase(itr);
+				itr = removeServer(itr);
 				printf("%d total\n", (int)servers.size());
 			}
 			else
@@ -313,7 +356,7 @@ void dumpServersToFile(const char *file = "./latest")
     fclose(fp);
 }
 
-void writeServerData(void)
+void writeServerData(buf_t &buf)
 {
 	list<SServer>::iterator itr;
 	size_t num_verified = 0;
@@ -323,7 +366,7 @@ void writeServerData(void)
 		if((*itr).verified)
 			num_verified++;
 
-	message.WriteShort(num_verified);
+	buf.WriteShort(num_verified);
 
 	for (itr = servers.begin(); itr != servers.end(); ++itr)
 	{
@@ -331,11 +374,26 @@ void writeServerData(void)
 			continue;
 
 		for (int i = 0; i < 4; ++i)
-			message.WriteByte((*itr).addr.ip[i]);
-		message.WriteShort(htons((*itr).addr.port));
+			buf.WriteByte((*itr).addr.ip[i]);
+		buf.WriteShort(htons((*itr).addr.port));
 	}
 }
 
+// Returns the reply to launchers, encoding it again if servers were
+// verified or removed since the last time.
+buf_t &getServerList(void)
+{
+	if (serverlist_dirty)
+	{
+		serverlist.clear();
+		serverlist.WriteLong(LAUNCHER_CHALLENGE);
+		writeServerData(serverlist);
+		serverlist_dirty = false;
+	}
+
+	return serverlist;
+}
+
 void daemon_init(void)
 {
 #ifdef UNIX
@@ -422,10 +480,8 @@ int main()
 				else
 				{
 					printf("Client request IP = %s\n", NET_AdrToString(net_from));
-					message.clear();
-					message.WriteLong(LAUNCHER_CHALLENGE);
-					writeServerData();
-					NET_SendPacket(message.cursize, message.data, net_from);
+					buf_t &reply = getServerList();
+					NET_SendPacket(reply.cursize, reply.data, net_from);
 				}
 			    break;
 			default:
@@ -454,6 +510,8 @@ int main()
 	}
 
 	servers.clear();
+	server_index.clear();
+	verified_per_ip.clear();
 
 	CloseNetwork();
 
@@ -61,6 +61,7 @@ BufferedSocket::BufferedSocket() :  m_BadRead(false), m_BadWrite(false),
 	m_Socket(0), m_SendPing(0), m_ReceivePing(0)
 {
 	m_Broadcast = false;
+	m_Persistent = false;
 	memset(&m_RemoteAddress, 0, sizeof(struct sockaddr_in));
 
 	m_SocketBuffer = new byte[MAX_PAYLOAD];
@@ -111,6 +112,16 @@ bool BufferedSocket::CreateSocket()
 		return false;
 	}
 
+	if(m_Persistent)
+	{
+		// Lots of replies can arrive at once, make room for them
+		int optval = 512 * 1024;
+
+		// Not fatal, replies that don't fit are sent again
+		setsockopt(m_Socket, SOL_SOCKET, SO_RCVBUF, (char*)&optval,
+		           sizeof(optval));
+	}
+
 	if(m_Broadcast)
 	{
 		int optval = m_Broadcast ? 1 : 0;
@@ -152,6 +163,11 @@ void BufferedSocket::SetBroadcast(bool enabled)
 	m_Broadcast = enabled;
 }
 
+void BufferedSocket::SetPersistent(bool enabled)
+{
+	m_Persistent = enabled;
+}
+
 void BufferedSocket::DestroySocket()
 {
 	if(m_Socket != 0)
@@ -171,6 +187,7 @@ void BufferedSocket::SetRemoteAddress(const string& Address, const uint16_t& Por
     if((he = gethostbyname((const char *)Address.c_str())) == NULL)
     {
 		NET_ReportError(REPERR_NO_ARGS);
+		memset(&m_RemoteAddress, 0, sizeof(struct sockaddr_in));
         return;
     }
 
@@ -189,6 +206,8 @@ void BufferedSocket::SetRemoteAddress(const string& Address, const uint16_t& Por
 	if((getaddrinfo(Address.c_str(), NULL, &hints, &result)) != 0)
 	{
 		NET_ReportError(REPERR_NO_ARGS);
+		// Don't send to whichever address was set before
+		memset(&m_RemoteAddress, 0, sizeof(struct sockaddr_in));
 		return;
 	}
 
@@ -243,7 +262,7 @@ int32_t BufferedSocket::SendData(const int32_t& Timeout)
 	if(!m_BufferSize)
 		return 0;
 
-	if(CreateSocket() == false)
+	if((!m_Persistent || m_Socket == 0) && CreateSocket() == false)
 		return 0;
 
 	BytesSent = sendto(m_Socket, (const char*)m_SocketBuffer, m_BufferSize, 0,
@@ -79,6 +79,10 @@ public:
 	// Set network-wide broadcast ability
 	void SetBroadcast(bool enabled);
 
+	// Keep the same socket between sends, so replies to packets sent to
+	// different addresses all arrive on it
+	void SetPersistent(bool enabled);
+
 	// Set the outgoing address
 	void SetRemoteAddress(const std::string& Address, const uint16_t& Port);
 	// Set the outgoing address in "address:port" format
@@ -177,6 +181,9 @@ private:
 	// broadcast mode
 	bool m_Broadcast;
 
+	// socket is kept between sends
+	bool m_Persistent;
+
 	// local address
 	struct sockaddr_in m_LocalAddress;
 
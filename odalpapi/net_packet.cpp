@@ -30,6 +30,7 @@
 
 #include "net_packet.h"
 #include "net_error.h"
+#include "net_query.h"
 //#include "net_cvartable.h"
 
 using namespace std;
@@ -59,7 +60,7 @@ int32_t ServerBase::Query(int32_t Timeout)
 	// If we didn't get it the first time, try again
 	while(Retry)
 	{
-		Socket->Write32(challenge);
+		WriteChallenge(*Socket);
 
 		if(!Socket->SendData(Timeout))
 			return 0;
@@ -609,6 +610,26 @@ int32_t Server::Parse()
 	return 0;
 }
 
+void Server::WriteChallenge(BufferedSocket& s)
+{
+	s.Write32(challenge);
+	s.Write32(VERSION);
+	s.Write32(PROTOCOL_VERSION);
+	// bond - time
+	s.Write32(Info.PTime);
+}
+
+// Only tells whether the tag is a server response, Parse decides whether it
+// can be used
+bool Server::IsResponse(const uint32_t& Tag) const
+{
+	uint16_t TagId = ((Tag >> 20) & 0x0FFF);
+	uint8_t TagApplication = ((Tag >> 16) & 0x0F);
+	uint8_t TagQRId = ((Tag >> 12) & 0x0F);
+
+	return (TagId == TAG_ID && TagApplication == 3 && TagQRId == 2);
+}
+
 int32_t Server::Query(int32_t Timeout)
 {
 	int8_t Retry = m_RetryCount;
@@ -625,11 +646,7 @@ int32_t Server::Query(int32_t Timeout)
 	// If we didn't get it the first time, try again
 	while(Retry)
 	{
-		Socket->Write32(challenge);
-		Socket->Write32(VERSION);
-		Socket->Write32(PROTOCOL_VERSION);
-		// bond - time
-		Socket->Write32(Info.PTime);
+		WriteChallenge(*Socket);
 
 		if(!Socket->SendData(Timeout))
 			return 0;
@@ -668,6 +685,28 @@ ok:
 	return 1;
 }
 
+// Query every master server at once
+void MasterServer::QueryMasters(const uint32_t& Timeout, const bool& Broadcast,
+                                const int8_t& Retries)
+{
+	DeleteServers();
+
+	m_RetryCount = Retries;
+
+	if(Broadcast)
+		QueryBC(Timeout);
+
+	QueryEngine Engine;
+
+	// The caller holds our lock
+	Engine.SetLocking(false);
+
+	for(size_t i = 0; i < masteraddresses.size(); ++i)
+		Engine.AddTarget(this, masteraddresses[i].ip, masteraddresses[i].port);
+
+	Engine.Run(Timeout, Retries);
+}
+
 // Send network-wide broadcasts
 void MasterServer::QueryBC(const uint32_t& Timeout)
 {
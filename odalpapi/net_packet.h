@@ -234,6 +234,24 @@ public:
 		return -1;
 	}
 
+	// Write the enquiry packet
+	virtual void WriteChallenge(BufferedSocket& s)
+	{
+		s.Write32(challenge);
+	}
+
+	// Whether a packet starting with Tag is a reply to our enquiry
+	virtual bool IsResponse(const uint32_t& Tag) const
+	{
+		return Tag == response;
+	}
+
+	// Forget what the last reply said
+	virtual void ResetData()
+	{
+
+	}
+
 	// Query the server
 	int32_t Query(int32_t Timeout);
 
@@ -242,6 +260,11 @@ public:
 		Socket = s;
 	}
 
+	BufferedSocket* GetSocket() const
+	{
+		return Socket;
+	}
+
 	void SetAddress(const std::string& Address, const uint16_t& Port)
 	{
 		m_Address = Address;
@@ -267,6 +290,11 @@ public:
 		return Ping;
 	}
 
+	void SetPing(const uint64_t& p)
+	{
+		Ping = p;
+	}
+
 	void SetRetries(int8_t Count)
 	{
 		m_RetryCount = Count;
@@ -363,23 +391,7 @@ public:
 	}
 
 	void QueryMasters(const uint32_t& Timeout, const bool& Broadcast,
-	                  const int8_t& Retries)
-	{
-		DeleteServers();
-
-		m_RetryCount = Retries;
-
-		if(Broadcast)
-			QueryBC(Timeout);
-
-		for(size_t i = 0; i < masteraddresses.size(); ++i)
-		{
-			m_Address = masteraddresses[i].ip;
-			m_Port = masteraddresses[i].port;
-
-			Query(Timeout);
-		}
-	}
+	                  const int8_t& Retries);
 
 	size_t GetMasterCount()
 	{
@@ -488,6 +500,10 @@ public:
 
 	virtual  ~Server();
 
+	void WriteChallenge(BufferedSocket& s);
+
+	bool IsResponse(const uint32_t& Tag) const;
+
 	int32_t Query(int32_t Timeout);
 
 	void ReadInformation();
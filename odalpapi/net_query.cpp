@@ -0,0 +1,270 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Multiplexed server queries
+//
+//-----------------------------------------------------------------------------
+
+#include "net_query.h"
+
+#include <algorithm>
+
+#include "net_utils.h"
+
+using namespace std;
+
+namespace odalpapi
+{
+
+QueryEngine::QueryEngine() : m_Finished(0), m_Answered(0), m_Locking(true),
+	m_Callback(NULL), m_CallbackData(NULL)
+{
+	// Replies from every target arrive on this one socket
+	m_Socket.SetPersistent(true);
+}
+
+void QueryEngine::AddTarget(ServerBase* Target)
+{
+	string Address;
+	uint16_t Port;
+
+	Target->GetAddress(Address, Port);
+
+	AddTarget(Target, Address, Port);
+}
+
+void QueryEngine::AddTarget(ServerBase* Target, const string& Address,
+                            const uint16_t& Port)
+{
+	Target_t t;
+
+	t.Server = Target;
+	t.Address = Address;
+	t.Port = Port;
+	t.FirstSendTime = 0;
+	t.SendTime = 0;
+	t.LastPing = 0;
+	t.Sends = 0;
+	t.Done = false;
+
+	m_Targets.push_back(t);
+}
+
+void QueryEngine::ClearTargets()
+{
+	m_Targets.clear();
+	m_Index.clear();
+}
+
+//
+// QueryEngine::Finish()
+//
+// Stop querying a target
+void QueryEngine::Finish(Target_t& Target, const int32_t& Result)
+{
+	Target.Done = true;
+
+	++m_Finished;
+
+	if(Result)
+		++m_Answered;
+
+	if(m_Callback != NULL)
+		m_Callback(Target.Server, Result, m_CallbackData);
+}
+
+//
+// QueryEngine::Send()
+//
+// Send an enquiry to a target, targets that can't be sent to are given up on
+void QueryEngine::Send(Target_t& Target)
+{
+	string Address;
+	uint16_t Port;
+
+	if(Target.Address.empty() || !Target.Port)
+	{
+		Finish(Target, 0);
+		return;
+	}
+
+	m_Socket.SetRemoteAddress(Target.Address, Target.Port);
+	m_Socket.GetRemoteAddress(Address, Port);
+
+	// The address could not be resolved
+	if(!Port)
+	{
+		Finish(Target, 0);
+		return;
+	}
+
+	// Replies are told apart by the address they come from, so only one
+	// target can be at each address
+	size_t Index = &Target - &m_Targets[0];
+	pair<map<string, size_t>::iterator, bool> Ins =
+	    m_Index.insert(make_pair(m_Socket.GetRemoteAddress(), Index));
+
+	if(!Ins.second && Ins.first->second != Index)
+	{
+		Finish(Target, 0);
+		return;
+	}
+
+	m_Socket.ClearBuffer();
+
+	Target.Server->WriteChallenge(m_Socket);
+
+	if(m_Socket.SendData(0) <= 0)
+	{
+		Finish(Target, 0);
+		return;
+	}
+
+	Target.SendTime = GetMillisNow();
+
+	if(!Target.Sends)
+		Target.FirstSendTime = Target.SendTime;
+
+	++Target.Sends;
+}
+
+//
+// QueryEngine::Receive()
+//
+// Wait for a reply and hand it to the target it came from, returns false if
+// nothing arrived in time
+bool QueryEngine::Receive(const int32_t& Timeout)
+{
+	if(m_Socket.GetData(Timeout) <= 0)
+		return false;
+
+	uint64_t Now = GetMillisNow();
+
+	map<string, size_t>::iterator it = m_Index.find(m_Socket.GetRemoteAddress());
+
+	if(it == m_Index.end() || m_Targets[it->second].Done)
+	{
+		m_Socket.ClearBuffer();
+		return true;
+	}
+
+	Target_t& Target = m_Targets[it->second];
+
+	// Look at the tag without taking it out of the buffer
+	uint32_t Tag = 0;
+
+	m_Socket.Read32(Tag);
+	m_Socket.ResetBuffer();
+
+	if(m_Socket.BadRead() || !Target.Server->IsResponse(Tag))
+	{
+		m_Socket.ClearBuffer();
+		return true;
+	}
+
+	if(m_Locking)
+		Target.Server->GetLock();
+
+	BufferedSocket* OldSocket = Target.Server->GetSocket();
+
+	Target.Server->SetSocket(&m_Socket);
+
+	// Once an enquiry has been resent, there's no telling which one this
+	// answers, so keep the ping from the last run rather than guess.  If
+	// there wasn't one, time it from the first enquiry, which can only
+	// overstate it
+	if(Target.Sends == 1)
+		Target.Server->SetPing(Now - Target.SendTime);
+	else if(Target.LastPing)
+		Target.Server->SetPing(Target.LastPing);
+	else
+		Target.Server->SetPing(Now - Target.FirstSendTime);
+
+	int32_t Result = Target.Server->Parse();
+
+	Target.Server->SetSocket(OldSocket);
+
+	if(m_Locking)
+		Target.Server->Unlock();
+
+	Finish(Target, Result);
+
+	return true;
+}
+
+size_t QueryEngine::Run(const int32_t& Timeout, const int8_t& Retries)
+{
+	const size_t Count = m_Targets.size();
+
+	m_Finished = 0;
+	m_Answered = 0;
+	m_Index.clear();
+
+	for(size_t i = 0; i < Count; ++i)
+	{
+		m_Targets[i].FirstSendTime = 0;
+		m_Targets[i].SendTime = 0;
+		m_Targets[i].Sends = 0;
+		m_Targets[i].Done = false;
+
+		if(m_Locking)
+			m_Targets[i].Server->GetLock();
+
+		m_Targets[i].LastPing = m_Targets[i].Server->GetPing();
+		m_Targets[i].Server->ResetData();
+
+		if(m_Locking)
+			m_Targets[i].Server->Unlock();
+	}
+
+	for(int8_t Round = 0; Round < max<int8_t>(Retries, 1); ++Round)
+	{
+		if(m_Finished == Count)
+			break;
+
+		// Everything that hasn't answered yet is sent an enquiry at once
+		for(size_t i = 0; i < Count; ++i)
+		{
+			if(!m_Targets[i].Done)
+				Send(m_Targets[i]);
+		}
+
+		uint64_t Deadline = GetMillisNow() + max<int32_t>(Timeout, 1);
+
+		while(m_Finished < Count)
+		{
+			uint64_t Now = GetMillisNow();
+
+			if(Now >= Deadline)
+				break;
+
+			Receive(static_cast<int32_t>(Deadline - Now));
+		}
+	}
+
+	// Give up on the rest
+	for(size_t i = 0; i < Count; ++i)
+	{
+		if(!m_Targets[i].Done)
+			Finish(m_Targets[i], 0);
+	}
+
+	return m_Answered;
+}
+
+} // namespace
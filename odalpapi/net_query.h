@@ -0,0 +1,138 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2020 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Multiplexed server queries
+//
+//-----------------------------------------------------------------------------
+
+#ifndef NET_QUERY_H
+#define NET_QUERY_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "net_io.h"
+#include "net_packet.h"
+#include "typedefs.h"
+
+/**
+ * odalpapi namespace.
+ *
+ * All code for the odamex launcher api is contained within the odalpapi
+ * namespace.
+ */
+namespace odalpapi
+{
+
+// Called from QueryEngine::Run whenever a target is done with, Result is what
+// its Parse function returned, or 0 if it never answered
+typedef void (*QueryCallback)(ServerBase* Target, int32_t Result, void* Data);
+
+/**
+ * Queries many servers at once over a single socket.
+ *
+ * Every enquiry is sent up front, replies are matched to their target by
+ * the address they came from and the tag they start with.  Targets that
+ * haven't answered within the timeout are sent another enquiry, so a
+ * refresh takes about one timeout per retry, no matter how many servers
+ * there are.
+ *
+ * Targets are locked while they are being reset and parsed, so they can be
+ * read from other threads while Run is going.  Run itself must not be
+ * called from more than one thread at a time.
+ */
+class QueryEngine
+{
+public:
+	QueryEngine();
+
+	// Query the target at its own address
+	void AddTarget(ServerBase* Target);
+	// Query the target at another address, replies from every address are
+	// parsed by the same target
+	void AddTarget(ServerBase* Target, const std::string& Address,
+	               const uint16_t& Port);
+
+	void ClearTargets();
+
+	size_t GetTargetCount() const
+	{
+		return m_Targets.size();
+	}
+
+	// Lock targets while they are reset and parsed, turn this off when
+	// the caller holds their locks already
+	void SetLocking(bool Enabled)
+	{
+		m_Locking = Enabled;
+	}
+
+	void SetCallback(QueryCallback Callback, void* Data)
+	{
+		m_Callback = Callback;
+		m_CallbackData = Data;
+	}
+
+	// Send every enquiry and wait for the replies, Timeout is in
+	// milliseconds and Retries is the number of enquiries sent to each
+	// target.  Returns the number of targets that gave a valid reply.
+	size_t Run(const int32_t& Timeout, const int8_t& Retries);
+
+	// Targets that have been dealt with in the current or last run
+	size_t GetFinished() const
+	{
+		return m_Finished;
+	}
+
+private:
+	struct Target_t
+	{
+		ServerBase* Server;
+		std::string Address;
+		uint16_t    Port;
+		uint64_t    FirstSendTime;
+		uint64_t    SendTime;
+		uint64_t    LastPing;
+		int8_t      Sends;
+		bool        Done;
+	};
+
+	void Send(Target_t& Target);
+	void Finish(Target_t& Target, const int32_t& Result);
+	bool Receive(const int32_t& Timeout);
+
+	BufferedSocket m_Socket;
+
+	std::vector<Target_t> m_Targets;
+
+	// Resolved "address:port" of each target
+	std::map<std::string, size_t> m_Index;
+
+	size_t m_Finished;
+	size_t m_Answered;
+
+	bool m_Locking;
+
+	QueryCallback m_Callback;
+	void* m_CallbackData;
+};
+
+} // namespace
+
+#endif // NET_QUERY_H
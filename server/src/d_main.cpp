@@ -155,7 +155,7 @@ void D_Init()
 	// start the Zone memory manager
 	Z_Init();
 	if (first_time)
-		Printf("Z_Init: Using native allocator with OZone bookkeeping.\n");
+		Printf("Z_Init: Using %s.\n", Z_AllocatorName());
 
 	// Load palette and set up colormaps
 	V_InitPalette("PLAYPAL");
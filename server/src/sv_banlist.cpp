@@ -24,7 +24,9 @@
 
 #include "odamex.h"
 
+#include <algorithm>
 #include <ctime>
+#include <functional>
 #include <sstream>
 
 #include "win32inc.h"
@@ -59,7 +61,7 @@ IPRange::IPRange()
 }
 
 // Check a given address against the ip + range in the object.
-bool IPRange::check(const netadr_t &address)
+bool IPRange::check(const netadr_t &address) const
 {
 	for (byte i = 0; i < 4; i++)
 	{
@@ -155,6 +157,48 @@ bool IPRange::set(const std::string &input)
 	return true;
 }
 
+// If only trailing octets are masked, set key to the leading octets that
+// aren't and octets to how many of them there are.
+bool IPRange::prefix(uint32_t &key, size_t &octets) const
+{
+	key = 0;
+	octets = 0;
+
+	while (octets < 4 && !this->mask[octets])
+	{
+		key = (key << 8) | this->ip[octets];
+		octets++;
+	}
+
+	for (size_t i = octets; i < 4; i++)
+	{
+		if (!this->mask[i])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool IPRange::operator==(const IPRange &other) const
+{
+	for (byte i = 0; i < 4; i++)
+	{
+		if (this->mask[i] != other.mask[i])
+		{
+			return false;
+		}
+
+		if (!this->mask[i] && this->ip[i] != other.ip[i])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 // Return the range as a string, with stars representing masked octets.
 std::string IPRange::string()
 {
@@ -180,8 +224,214 @@ std::string IPRange::string()
 	return buffer.str();
 }
 
+//// IPRangeIndex ////
+
+// Add a range at the given position.  Positions are expected to be added
+// in increasing order, as entries are appended to the list.
+void IPRangeIndex::insert(const IPRange &range, size_t pos)
+{
+	uint32_t key;
+	size_t octets;
+
+	if (!range.prefix(key, octets))
+	{
+		this->other.push_back(std::make_pair(pos, range));
+		return;
+	}
+
+	positions_t &positions = this->prefix[octets][key];
+	positions.insert(std::upper_bound(positions.begin(), positions.end(), pos), pos);
+}
+
+// Remove the range at the given position.
+void IPRangeIndex::erase(const IPRange &range, size_t pos)
+{
+	uint32_t key;
+	size_t octets;
+
+	if (!range.prefix(key, octets))
+	{
+		for (size_t i = 0; i < this->other.size(); i++)
+		{
+			if (this->other[i].first == pos)
+			{
+				this->other.erase(this->other.begin() + i);
+				break;
+			}
+		}
+		return;
+	}
+
+	prefixmap_t::iterator it = this->prefix[octets].find(key);
+	if (it == this->prefix[octets].end())
+	{
+		return;
+	}
+
+	positions_t &positions = it->second;
+	positions_t::iterator pit = std::lower_bound(positions.begin(), positions.end(), pos);
+	if (pit != positions.end() && *pit == pos)
+	{
+		positions.erase(pit);
+	}
+
+	if (positions.empty())
+	{
+		this->prefix[octets].erase(it);
+	}
+}
+
+// Move every position after pos down by one, after the entry at pos was
+// removed from the list.
+void IPRangeIndex::shift(size_t pos)
+{
+	for (size_t i = 0; i < ARRAY_LENGTH(this->prefix); i++)
+	{
+		for (prefixmap_t::iterator it = this->prefix[i].begin();
+		        it != this->prefix[i].end(); ++it)
+		{
+			positions_t &positions = it->second;
+			for (positions_t::iterator pit = std::upper_bound(positions.begin(),
+			        positions.end(), pos); pit != positions.end(); ++pit)
+			{
+				(*pit)--;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < this->other.size(); i++)
+	{
+		if (this->other[i].first > pos)
+		{
+			this->other[i].first--;
+		}
+	}
+}
+
+void IPRangeIndex::clear()
+{
+	for (size_t i = 0; i < ARRAY_LENGTH(this->prefix); i++)
+	{
+		this->prefix[i].clear();
+	}
+	this->other.clear();
+}
+
+// Return the first position whose range contains the address, or npos if
+// there is none.
+size_t IPRangeIndex::find(const netadr_t &address) const
+{
+	const uint32_t ip = (static_cast<uint32_t>(address.ip[0]) << 24) |
+	                    (static_cast<uint32_t>(address.ip[1]) << 16) |
+	                    (static_cast<uint32_t>(address.ip[2]) << 8) |
+	                    static_cast<uint32_t>(address.ip[3]);
+
+	size_t found = npos;
+
+	// Everything is masked.
+	if (!this->prefix[0].empty())
+	{
+		found = this->prefix[0].begin()->second.front();
+	}
+
+	for (size_t octets = 1; octets < ARRAY_LENGTH(this->prefix); octets++)
+	{
+		if (this->prefix[octets].empty())
+		{
+			continue;
+		}
+
+		prefixmap_t::const_iterator it =
+		    this->prefix[octets].find(ip >> (32 - 8 * octets));
+		if (it != this->prefix[octets].end() && it->second.front() < found)
+		{
+			found = it->second.front();
+		}
+	}
+
+	// Kept in order, so stop at the first one that matches.
+	for (size_t i = 0; i < this->other.size(); i++)
+	{
+		if (this->other[i].first >= found)
+		{
+			break;
+		}
+
+		if (this->other[i].second.check(address))
+		{
+			found = this->other[i].first;
+			break;
+		}
+	}
+
+	return found;
+}
+
+// Number of distinct prefixes indexed.
+size_t IPRangeIndex::prefixes() const
+{
+	size_t count = 0;
+	for (size_t i = 0; i < ARRAY_LENGTH(this->prefix); i++)
+	{
+		count += this->prefix[i].size();
+	}
+	return count;
+}
+
+// Number of ranges that have to be checked one by one.
+size_t IPRangeIndex::others() const
+{
+	return this->other.size();
+}
+
 //// Banlist ////
 
+Banlist::Banlist() : lookups(0), lookup_time(0), max_lookup_time(0)
+{
+}
+
+// Add a ban to the end of the banlist and index it, unless it has already
+// run out.
+void Banlist::push_ban(const Ban &ban)
+{
+	const size_t index = this->banlist.size();
+	this->banlist.push_back(ban);
+
+	if (ban.expire != 0)
+	{
+		if (ban.expire <= time(NULL))
+		{
+			return;
+		}
+
+		this->expiry_heap.push_back(expiry_t(ban.expire, index));
+		std::push_heap(this->expiry_heap.begin(), this->expiry_heap.end(),
+		               std::greater<expiry_t>());
+	}
+
+	this->ban_index.insert(ban.range, index);
+}
+
+// Remove a ban from the index.  The expiry heap is left alone.
+void Banlist::unindex_ban(size_t index)
+{
+	this->ban_index.erase(this->banlist[index].range, index);
+}
+
+// Stop matching bans that have run out.  They are kept in the banlist
+// until they are removed.
+void Banlist::expire_bans(time_t now)
+{
+	while (!this->expiry_heap.empty() && this->expiry_heap.front().first <= now)
+	{
+		this->unindex_ban(this->expiry_heap.front().second);
+
+		std::pop_heap(this->expiry_heap.begin(), this->expiry_heap.end(),
+		              std::greater<expiry_t>());
+		this->expiry_heap.pop_back();
+	}
+}
+
 size_t Banlist::size()
 {
 	return this->banlist.size();
@@ -204,7 +454,7 @@ bool Banlist::add(const std::string &address, const time_t expire,
 	ban.reason = reason;
 
 	// Add the ban to the banlist
-	this->banlist.push_back(ban);
+	this->push_ban(ban);
 
 	return true;
 }
@@ -227,7 +477,7 @@ bool Banlist::add(player_t &player, const time_t expire,
 	ban.reason = reason;
 
 	// Add the ban to the banlist
-	this->banlist.push_back(ban);
+	this->push_ban(ban);
 
 	return true;
 }
@@ -245,6 +495,7 @@ bool Banlist::add_exception(const std::string &address, const std::string &name)
 
 	// Add the exception to the banlist.
 	exception.name = name;
+	this->exception_index.insert(exception.range, this->exceptionlist.size());
 	this->exceptionlist.push_back(exception);
 
 	return true;
@@ -265,6 +516,7 @@ bool Banlist::add_exception(player_t &player)
 	exception.range.set(player.client.address);
 
 	// Add the exception to the banlist.
+	this->exception_index.insert(exception.range, this->exceptionlist.size());
 	this->exceptionlist.push_back(exception);
 
 	return true;
@@ -275,29 +527,28 @@ bool Banlist::add_exception(player_t &player)
 // returns false.
 bool Banlist::check(const netadr_t &address, Ban &baninfo)
 {
-	// Check against exception list.
-	for (std::vector<Exception>::iterator it = this->exceptionlist.begin();
-	        it != this->exceptionlist.end(); ++it)
-	{
-		if (it->range.check(address))
-		{
-			return false;
-		}
-	}
+	const dtime_t start = I_GetTime();
+	bool banned = false;
 
-	// Check against banlist.
-	for (std::vector<Ban>::iterator it = this->banlist.begin();
-	        it != this->banlist.end(); ++it)
+	// Check against exception list, then the banlist.
+	if (this->exception_index.find(address) == IPRangeIndex::npos)
 	{
-		if (it->range.check(address) && (it->expire == 0 ||
-		                                 it->expire > time(NULL)))
+		this->expire_bans(time(NULL));
+
+		const size_t index = this->ban_index.find(address);
+		if (index != IPRangeIndex::npos)
 		{
-			baninfo = *it;
-			return true;
+			baninfo = this->banlist[index];
+			banned = true;
 		}
 	}
 
-	return false;
+	const dtime_t elapsed = I_GetTime() - start;
+	this->lookups++;
+	this->lookup_time += elapsed;
+	this->max_lookup_time = std::max(this->max_lookup_time, elapsed);
+
+	return banned;
 }
 
 // Return a complete list of bans.
@@ -412,7 +663,29 @@ bool Banlist::remove(size_t index)
 		return false;
 	}
 
+	this->unindex_ban(index);
 	this->banlist.erase(this->banlist.begin() + index);
+	this->ban_index.shift(index);
+
+	// Drop the ban from the expiry heap and renumber the ones after it.
+	size_t kept = 0;
+	for (size_t i = 0; i < this->expiry_heap.size(); i++)
+	{
+		expiry_t expiry = this->expiry_heap[i];
+		if (expiry.second == index)
+		{
+			continue;
+		}
+		if (expiry.second > index)
+		{
+			expiry.second--;
+		}
+		this->expiry_heap[kept++] = expiry;
+	}
+	this->expiry_heap.resize(kept);
+	std::make_heap(this->expiry_heap.begin(), this->expiry_heap.end(),
+	               std::greater<expiry_t>());
+
 	return true;
 }
 
@@ -431,7 +704,9 @@ bool Banlist::remove_exception(size_t index)
 		return false;
 	}
 
+	this->exception_index.erase(this->exceptionlist[index].range, index);
 	this->exceptionlist.erase(this->exceptionlist.begin() + index);
+	this->exception_index.shift(index);
 	return true;
 }
 
@@ -439,12 +714,15 @@ bool Banlist::remove_exception(size_t index)
 void Banlist::clear()
 {
 	this->banlist.clear();
+	this->ban_index.clear();
+	this->expiry_heap.clear();
 }
 
 // Clear the exceptionlist.
 void Banlist::clear_exceptions()
 {
 	this->exceptionlist.clear();
+	this->exception_index.clear();
 }
 
 // Fills a JSON array with bans.
@@ -478,7 +756,15 @@ bool Banlist::json(Json::Value &json_bans)
 	return true;
 }
 
-// Replace the current banlist with the contents of a JSON array.
+static bool SameBan(const Ban &a, const Ban &b)
+{
+	return a.expire == b.expire && a.range == b.range && a.name == b.name &&
+	       a.reason == b.reason;
+}
+
+// Replace the current banlist with the contents of a JSON array.  Only bans
+// that differ from the current banlist are indexed again, so reloading an
+// unchanged or appended-to banfile is cheap.
 bool Banlist::json_replace(const Json::Value &json_bans)
 {
 	tm tmp;
@@ -487,11 +773,14 @@ bool Banlist::json_replace(const Json::Value &json_bans)
 	if (!(json_bans.isArray() || json_bans.isNull()))
 		return false;
 
-	this->clear();
+	std::vector<Ban> bans;
 
 	// No bans to parse?
 	if (json_bans.isNull() || json_bans.empty())
+	{
+		this->clear();
 		return true;
+	}
 
 	Json::ValueConstIterator it;
 	for (it = json_bans.begin(); it != json_bans.end(); ++it)
@@ -524,12 +813,60 @@ bool Banlist::json_replace(const Json::Value &json_bans)
 		if (!value.isNull())
 			ban.reason = value.asString();
 
-		this->banlist.push_back(ban);
+		bans.push_back(ban);
+	}
+
+	// Keep the bans that haven't changed.
+	size_t same = 0;
+	while (same < bans.size() && same < this->banlist.size() &&
+	       SameBan(bans[same], this->banlist[same]))
+	{
+		same++;
+	}
+
+	for (size_t i = this->banlist.size(); i > same; i--)
+	{
+		this->unindex_ban(i - 1);
+	}
+	this->banlist.resize(same);
+
+	size_t kept = 0;
+	for (size_t i = 0; i < this->expiry_heap.size(); i++)
+	{
+		if (this->expiry_heap[i].second < same)
+		{
+			this->expiry_heap[kept++] = this->expiry_heap[i];
+		}
+	}
+	this->expiry_heap.resize(kept);
+	std::make_heap(this->expiry_heap.begin(), this->expiry_heap.end(),
+	               std::greater<expiry_t>());
+
+	for (size_t i = same; i < bans.size(); i++)
+	{
+		this->push_ban(bans[i]);
 	}
 
 	return true;
 }
 
+// Print the size of the ban index and how long lookups take.
+void Banlist::print_stats()
+{
+	Printf(PRINT_HIGH, "%" PRIuSIZE " bans, %" PRIuSIZE " prefixes indexed, "
+	       "%" PRIuSIZE " checked one by one, %" PRIuSIZE " expiring\n",
+	       this->banlist.size(), this->ban_index.prefixes(),
+	       this->ban_index.others(), this->expiry_heap.size());
+	Printf(PRINT_HIGH, "%" PRIuSIZE " exceptions, %" PRIuSIZE " prefixes indexed, "
+	       "%" PRIuSIZE " checked one by one\n",
+	       this->exceptionlist.size(), this->exception_index.prefixes(),
+	       this->exception_index.others());
+	Printf(PRINT_HIGH, "%" PRIuSIZE " lookups, %.2fus average, %.2fus max\n",
+	       this->lookups,
+	       this->lookups ? this->lookup_time / 1000.0 / this->lookups : 0.0,
+	       this->max_lookup_time / 1000.0);
+}
+
 //// Console commands ////
 
 // Ban bans a player by player id.
@@ -949,6 +1286,12 @@ BEGIN_COMMAND(exceptionlist)
 }
 END_COMMAND(exceptionlist)
 
+BEGIN_COMMAND(banliststats)
+{
+	banlist.print_stats();
+}
+END_COMMAND(banliststats)
+
 BEGIN_COMMAND(clearexceptionlist)
 {
 	banlist.clear_exceptions();
@@ -24,6 +24,7 @@
 #pragma once
 
 #include <ctime>
+#include <map>
 #include <sstream>
 
 #include "json/json.h"
@@ -38,13 +39,39 @@ private:
 	bool mask[4];
 public:
 	IPRange(void);
-	bool check(const netadr_t &address);
+	bool check(const netadr_t &address) const;
 	bool check(const std::string &input);
 	void set(const netadr_t &address);
 	bool set(const std::string &input);
+	bool prefix(uint32_t &key, size_t &octets) const;
+	bool operator==(const IPRange &other) const;
 	std::string string(void);
 };
 
+// Lookup of IP ranges by their position in a list.  Ranges that only mask
+// trailing octets are indexed by their prefix, so an address is found with
+// one lookup per prefix length.  Anything else is checked one by one.
+class IPRangeIndex
+{
+public:
+	static const size_t npos = static_cast<size_t>(-1);
+
+	void insert(const IPRange &range, size_t pos);
+	void erase(const IPRange &range, size_t pos);
+	void shift(size_t pos);
+	void clear();
+	size_t find(const netadr_t &address) const;
+	size_t prefixes() const;
+	size_t others() const;
+private:
+	typedef std::vector<size_t> positions_t;
+	typedef std::map<uint32_t, positions_t> prefixmap_t;
+
+	// Indexed by how many leading octets are not masked.
+	prefixmap_t prefix[5];
+	std::vector<std::pair<size_t, IPRange> > other;
+};
+
 struct Ban
 {
 	Ban(void) : expire(0) { };
@@ -68,6 +95,7 @@ typedef std::vector<exceptionlist_result_t> exceptionlist_results_t;
 class Banlist
 {
 public:
+	Banlist();
 	size_t size();
 	bool add(const std::string &address, const time_t expire = 0,
 	         const std::string &name = std::string(),
@@ -90,9 +118,26 @@ public:
 	bool json(Json::Value &json_bans);
 	bool json_replace(const Json::Value &json_bans);
 	void json_exceptions();
+	void print_stats();
 private:
+	typedef std::pair<time_t, size_t> expiry_t;
+
 	std::vector<Ban> banlist;
 	std::vector<Exception> exceptionlist;
+
+	// Bans that can still match, and when the ones that aren't permanent
+	// run out, soonest first.
+	IPRangeIndex ban_index;
+	IPRangeIndex exception_index;
+	std::vector<expiry_t> expiry_heap;
+
+	size_t lookups;
+	dtime_t lookup_time;
+	dtime_t max_lookup_time;
+
+	void push_ban(const Ban &ban);
+	void unindex_ban(size_t index);
+	void expire_bans(time_t now);
 };
 
 void SV_InitBanlist();
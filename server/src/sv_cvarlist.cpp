@@ -110,9 +110,21 @@ CVAR_RANGE(		sv_natport,	"0", "NAT firewall workaround, this is a port number",
 CVAR_RANGE(		sv_flooddelay, "1.5", "Chat flood protection time (in seconds)",
 				CVARTYPE_FLOAT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 10.0f)
 
+CVAR_RANGE(		sv_querylimit, "10", "Launcher queries answered per second from a single address " \
+				"(0 means unlimited)",
+				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 1000.0f)
+
 CVAR_RANGE_FUNC_DECL(sv_maxrate, "200", "Forces clients to be on or below this rate",
 				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 7.0f, 100000.0f)
 
+CVAR_RANGE(		sv_updaterange, "0", "Distance in map units around a client's point of view " \
+				"within which monsters and missiles get periodic position updates (0 means unlimited)",
+				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 32767.0f)
+
+CVAR_RANGE(		sv_workerthreads, "0", "Number of extra threads used to build and compress " \
+				"packets for clients (0 means everything is done on the main thread)",
+				CVARTYPE_INT, CVAR_SERVERARCHIVE | CVAR_NOENABLEDISABLE, 0.0f, 16.0f)
+
 #ifdef ODA_HAVE_MINIUPNP
 CVAR(			sv_upnp, "1", "Enable UPnP support",
 				CVARTYPE_BOOL, CVAR_SERVERARCHIVE)
@@ -0,0 +1,278 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2024 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Serverside interest management.  Monsters and missiles that are due
+//  for a periodic position update are gathered once per tic and bucketed
+//  by blockmap cell, so each client only visits the actors that concern
+//  it instead of walking every thinker.
+//
+//-----------------------------------------------------------------------------
+
+
+#include "odamex.h"
+
+#include "sv_interest.h"
+
+#include "p_local.h"
+#include "sv_main.h"
+#include "sv_mobjdelta.h"
+
+EXTERN_CVAR(sv_updaterange)
+
+namespace
+{
+
+struct InterestEntry
+{
+	AActor* mo;
+	int cell;           // blockmap cell, or -1 if outside of the blockmap
+	bool needs_target;  // monsters are only updated while they're chasing,
+	                    // everything else is a missile
+};
+
+// Actors due for an update this tic, in thinker order.
+std::vector<InterestEntry> due;
+
+// The same actors sorted by blockmap cell.  Cell N occupies the range
+// [cellstart[N], cellstart[N + 1]); actors outside of the blockmap are
+// kept in a final bucket that every client visits.
+std::vector<InterestEntry> bycell;
+std::vector<size_t> cellstart;
+int numcells = 0;
+
+} // namespace
+
+//
+// SV_MissileDueForUpdate
+//
+static bool SV_MissileDueForUpdate(const AActor* mo)
+{
+	if (!(mo->flags & MF_MISSILE) || mo->flags & MF_SKULLFLY)
+		return false;
+
+	if (mo->type == MT_PLASMA)
+		return false;
+
+	// Revenant tracers and Mancubus fireballs need to be updated more often
+	// (and custom tracers), everything else gets updated every 30 tics.
+	if (mo->type == MT_TRACER || mo->type == MT_FATSHOT ||
+	    mo->flags2 & MF2_SEEKERMISSILE)
+		return ((gametic + mo->netid) % 5) == 0;
+
+	return ((gametic + mo->netid) % 30) == 0;
+}
+
+//
+// SV_MonsterDueForUpdate
+//
+static bool SV_MonsterDueForUpdate(const AActor* mo)
+{
+	// Ignore corpses.
+	if (mo->flags & MF_CORPSE)
+		return false;
+
+	// We don't handle updating non-monsters here.
+	if (!(mo->flags & MF_COUNTKILL || mo->type == MT_SKULL))
+		return false;
+
+	// update monster position every 7 tics
+	return ((gametic + mo->netid) % 7) == 0;
+}
+
+static int SV_BlockmapCell(const AActor* mo)
+{
+	const int bx = (mo->x - bmaporgx) >> MAPBLOCKSHIFT;
+	const int by = (mo->y - bmaporgy) >> MAPBLOCKSHIFT;
+
+	if (bx < 0 || by < 0 || bx >= bmapwidth || by >= bmapheight)
+		return -1;
+
+	return by * bmapwidth + bx;
+}
+
+//
+// SV_BucketInterestLists
+//
+// Counting sort of the due actors into blockmap cells.
+//
+static void SV_BucketInterestLists()
+{
+	numcells = bmapwidth * bmapheight;
+
+	// One extra bucket for actors outside of the blockmap, one extra slot
+	// for the end of the last bucket.
+	cellstart.assign(numcells + 2, 0);
+	for (size_t i = 0; i < due.size(); i++)
+	{
+		const int bucket = due[i].cell < 0 ? numcells : due[i].cell;
+		cellstart[bucket + 1]++;
+	}
+
+	for (int i = 1; i < numcells + 2; i++)
+		cellstart[i] += cellstart[i - 1];
+
+	std::vector<size_t> cursor(cellstart.begin(), cellstart.end() - 1);
+	bycell.resize(due.size());
+	for (size_t i = 0; i < due.size(); i++)
+	{
+		const int bucket = due[i].cell < 0 ? numcells : due[i].cell;
+		bycell[cursor[bucket]++] = due[i];
+	}
+}
+
+//
+// SV_BuildInterestLists
+//
+// Walk the thinker list once per tic and collect every monster and
+// missile whose update cadence falls on this tic.
+//
+void SV_BuildInterestLists()
+{
+	due.clear();
+
+	AActor* mo;
+	TThinkerIterator<AActor> iterator;
+	while ((mo = iterator.Next()))
+	{
+		InterestEntry entry;
+
+		if (SV_MissileDueForUpdate(mo))
+			entry.needs_target = false;
+		else if (SV_MonsterDueForUpdate(mo))
+			entry.needs_target = true;
+		else
+			continue;
+
+		entry.mo = mo;
+		entry.cell = SV_BlockmapCell(mo);
+		due.push_back(entry);
+	}
+
+	// Only needed when sv_updaterange limits what a client visits.  Done
+	// here rather than on demand, since clients may be updated in parallel.
+	if (sv_updaterange.asInt() > 0 && !due.empty())
+		SV_BucketInterestLists();
+}
+
+//
+// SV_UpdateInterestingMobj
+//
+// Nothing is flushed here, the buffer goes out with the rest of the tic's
+// messages so that SV_SendPacket can keep the higher priority ones.
+//
+static void SV_UpdateInterestingMobj(player_t& pl, const InterestEntry& entry,
+                                     const AActor* viewer, fixed_t range)
+{
+	AActor* mo = entry.mo;
+
+	if (mo->WasDestroyed())
+		return;
+
+	if (entry.needs_target && !mo->target)
+		return;
+
+	if (viewer && P_AproxDistance(mo->x - viewer->x, mo->y - viewer->y) > range)
+		return;
+
+	if (!SV_IsPlayerAllowedToSee(pl, mo))
+		return;
+
+	SV_WriteMobjDelta(pl, *mo);
+}
+
+//
+// SV_VisitInterestingMobjs
+//
+// Update either the monsters or the missiles that concern the client.  If
+// sv_updaterange is set, only the blockmap cells around the client's point
+// of view are visited.
+//
+static void SV_VisitInterestingMobjs(player_t& pl, const AActor* viewer, bool monsters)
+{
+	if (sv_updaterange.asInt() <= 0 || !viewer || due.empty())
+	{
+		for (size_t i = 0; i < due.size(); i++)
+		{
+			if (due[i].needs_target != monsters)
+				continue;
+
+			SV_UpdateInterestingMobj(pl, due[i], NULL, 0);
+		}
+		return;
+	}
+
+	const fixed_t range = sv_updaterange.asInt() << FRACBITS;
+
+	// Find the viewer's cell before adding the range, so that it can't
+	// overflow near the edge of a large map.
+	const int cells = (sv_updaterange.asInt() + MAPBLOCKUNITS - 1) / MAPBLOCKUNITS;
+	const int cx = (viewer->x - bmaporgx) >> MAPBLOCKSHIFT;
+	const int cy = (viewer->y - bmaporgy) >> MAPBLOCKSHIFT;
+
+	int x1 = cx - cells;
+	int x2 = cx + cells;
+	int y1 = cy - cells;
+	int y2 = cy + cells;
+
+	x1 = clamp(x1, 0, bmapwidth - 1);
+	x2 = clamp(x2, 0, bmapwidth - 1);
+	y1 = clamp(y1, 0, bmapheight - 1);
+	y2 = clamp(y2, 0, bmapheight - 1);
+
+	// Cells in the same row are contiguous in the sorted list.
+	for (int by = y1; by <= y2; by++)
+	{
+		const size_t start = cellstart[by * bmapwidth + x1];
+		const size_t end = cellstart[by * bmapwidth + x2 + 1];
+
+		for (size_t i = start; i < end; i++)
+		{
+			if (bycell[i].needs_target != monsters)
+				continue;
+
+			SV_UpdateInterestingMobj(pl, bycell[i], viewer, range);
+		}
+	}
+
+	// Actors outside of the blockmap are always visited.
+	for (size_t i = cellstart[numcells]; i < cellstart[numcells + 1]; i++)
+	{
+		if (bycell[i].needs_target != monsters)
+			continue;
+
+		SV_UpdateInterestingMobj(pl, bycell[i], viewer, range);
+	}
+}
+
+//
+// SV_UpdateInterestingMobjs
+//
+// Keep tabs on monster and missile positions.  Monsters are written first,
+// so missiles are what gets left out when the client is over its rate.
+//
+void SV_UpdateInterestingMobjs(player_t& pl)
+{
+	// Use the point of view of whoever the client is spying on.
+	AActor* viewer = pl.mo;
+	player_t& target = idplayer(pl.spying);
+	if (validplayer(target) && &target != &pl && P_CanSpy(pl, target))
+		viewer = target.mo;
+
+	SV_VisitInterestingMobjs(pl, viewer, true);
+	SV_VisitInterestingMobjs(pl, viewer, false);
+}
@@ -0,0 +1,31 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2024 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Serverside interest management.  Monsters and missiles that are due
+//  for a periodic position update are gathered once per tic and bucketed
+//  by blockmap cell, so each client only visits the actors that concern
+//  it instead of walking every thinker.
+//
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include "d_player.h"
+
+void SV_BuildInterestLists();
+void SV_UpdateInterestingMobjs(player_t& pl);
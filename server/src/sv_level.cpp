@@ -48,6 +48,8 @@
 #include "s_sound.h"
 #include "sv_main.h"
 #include "sv_maplist.h"
+#include "sv_mobjdelta.h"
+#include "sv_sqp.h"
 #include "w_wad.h"
 #include "z_zone.h"
 #include "g_levelstate.h"
@@ -679,7 +681,7 @@ void G_DoResetLevel(bool full_reset)
 			// any weird destruction of any items post-reset.
 			if (mo->netid && mo->type != MT_PLAYER)
 			{
-				mo->netid = ::ServerNetID.obtainNetID();
+				P_SetThingId(mo, ::ServerNetID.obtainNetID());
 			}
 		}
 	}
@@ -780,6 +782,7 @@ void G_DoLoadLevel (int position)
 		lastposition = position;
 
 	G_InitLevelLocals ();
+	SV_QryInvalidate ();
 
 	if (firstmapinit) {
 		Printf_Bold ("--- %s: \"%s\" ---\n", level.mapname.c_str(), level.level_name);
@@ -818,6 +821,9 @@ void G_DoLoadLevel (int position)
 		if (it->ingame() && (::g_resetinvonexit || it->playerstate == PST_DEAD))
 			it->playerstate = PST_REBORN;
 
+		// Actors are about to be respawned on every client.
+		SV_ClearMobjDeltas(*it);
+
 		// Properly reset Cards, Powerups, and scores.
 		P_ClearPlayerCards(*it);
 		P_ClearPlayerPowerups(*it);
@@ -44,6 +44,10 @@
 #include "p_inter.h"
 #include "sv_main.h"
 #include "sv_sqp.h"
+#include "sv_ticloop.h"
+#include "sv_interest.h"
+#include "sv_mobjdelta.h"
+#include "sv_msgcache.h"
 #include "sv_sqpold.h"
 #include "sv_master.h"
 #include "i_system.h"
@@ -69,6 +73,9 @@
 #include "m_wdlstats.h"
 #include "svc_message.h"
 #include "m_cheat.h"
+#include "hashtable.h"
+#include "sv_workers.h"
+#include "stats.h"
 
 #include <algorithm>
 #include <sstream>
@@ -97,6 +104,11 @@ bool step_mode = false;
 
 std::set<byte> free_player_ids;
 
+// Connected players indexed by address, so every incoming packet doesn't
+// need to walk the player list to find its sender.
+typedef OHashTable<unsigned long long, player_t*> PlayerAddressIndex;
+static PlayerAddressIndex players_by_address;
+
 bool keysfound[NUMCARDS];		// Ch0wW : Found keys
 
 // General server settings
@@ -249,6 +261,8 @@ CVAR_FUNC_IMPL (join_password)
 		Printf("Join password set.");
 	else
 		Printf("Join password cleared.");
+
+	SV_QryInvalidate();
 }
 
 CVAR_FUNC_IMPL (rcon_password) // Remote console password.
@@ -519,6 +533,7 @@ Players::iterator SV_GetFreeClient(void)
 	std::set<byte>::iterator id = free_player_ids.begin();
 	players.back().id = *id;
 	free_player_ids.erase(id);
+	P_AddPlayerToIndex(players.back());
 
 	// update tracking cvar
 	sv_clientcount.ForceSet(players.size());
@@ -528,13 +543,45 @@ Players::iterator SV_GetFreeClient(void)
 	return --it;
 }
 
+static unsigned long long SV_AddressKey(const netadr_t& adr)
+{
+	return (static_cast<unsigned long long>(adr.ip[0]) << 40) |
+	       (static_cast<unsigned long long>(adr.ip[1]) << 32) |
+	       (static_cast<unsigned long long>(adr.ip[2]) << 24) |
+	       (static_cast<unsigned long long>(adr.ip[3]) << 16) | adr.port;
+}
+
+static void SV_AddPlayerAddress(player_t& player)
+{
+	players_by_address.insert(
+	    std::make_pair(SV_AddressKey(player.client.address), &player));
+}
+
+static void SV_RemovePlayerAddress(player_t& player)
+{
+	PlayerAddressIndex::iterator it =
+	    players_by_address.find(SV_AddressKey(player.client.address));
+	if (it != players_by_address.end() && it->second == &player)
+		players_by_address.erase(it);
+}
+
+//
+// SV_ClearPlayerIndexes
+//
+// Must be called whenever the players list is cleared.
+//
+static void SV_ClearPlayerIndexes()
+{
+	players_by_address.clear();
+	P_ClearPlayerIndex();
+}
+
 player_t &SV_FindPlayerByAddr(void)
 {
-	for (Players::iterator it = players.begin();it != players.end();++it)
-	{
-		if (NET_CompareAdr(it->client.address, net_from))
-		   return *it;
-	}
+	PlayerAddressIndex::iterator it =
+	    players_by_address.find(SV_AddressKey(net_from));
+	if (it != players_by_address.end())
+		return *it->second;
 
 	return idplayer(0);
 }
@@ -596,6 +643,10 @@ Players::iterator SV_RemoveDisconnectedPlayer(Players::iterator it)
 	}
 
 	// remove this player from the global players vector
+	SV_RemovePlayerAddress(*it);
+	P_RemovePlayerFromIndex(*it);
+	SV_ClearMobjDeltas(*it);
+
 	Players::iterator next;
 	next = players.erase(it);
 	free_player_ids.insert(player_id);
@@ -613,6 +664,9 @@ Players::iterator SV_RemoveDisconnectedPlayer(Players::iterator it)
 //
 void SV_GetPackets()
 {
+	// Replies to launchers and resent reliable packets go out together.
+	NET_BeginSendBatch();
+
 	while (NET_GetPacket())
 	{
 		player_t &player = SV_FindPlayerByAddr();
@@ -634,6 +688,8 @@ void SV_GetPackets()
 			}
 		}
 	}
+
+	SV_CountUnsentPackets(NET_EndSendBatch());
 }
 
 // Print a midscreen message to a client
@@ -993,6 +1049,8 @@ bool SV_SetupUserInfo(player_t &player)
 		}
 	}
 
+	SV_QryInvalidate();
+
 	return true;
 }
 
@@ -1124,6 +1182,7 @@ bool SV_AwarenessUpdate(player_t &player, AActor *mo)
 		mo->players_aware.unset(player.id);
 
 		MSG_WriteSVC(&cl->reliablebuf, SVC_RemoveMobj(*mo));
+		SV_MobjDeltaRemoved(player, *mo);
 
 		return true;
 	}
@@ -1134,6 +1193,7 @@ bool SV_AwarenessUpdate(player_t &player, AActor *mo)
 		if(!mo->player || mo->player->playerstate != PST_LIVE)
 		{
 			SV_SendMobjToClient(mo, cl);
+			SV_MobjDeltaSpawned(player, *mo);
 		}
 		else
 		{
@@ -1184,14 +1244,24 @@ bool SV_IsPlayerAllowedToSee(player_t &p, AActor *mo)
 
 #define HARDWARE_CAPABILITY 1000
 
+// Awareness changes sent to a client per tic, at most.
+static const int MAX_AWARENESS_UPDATES = 16;
+
+// Actors checked per client per tic.  Every actor gets checked again within
+// actors / AWARENESS_SCAN_BUDGET tics, no matter how many clients there are.
+static const int AWARENESS_SCAN_BUDGET = 256;
+
 //
 // SV_UpdateHiddenMobj
 //
+// Bring each client's view of which actors it knows about up to date a
+// little at a time.  Every client walks the actors in netid order from where
+// it left off last tic, so each one gets its fair share no matter where it
+// is in the player list.
+//
 void SV_UpdateHiddenMobj(void)
 {
-	// denis - todo - throttle this
 	AActor *mo;
-	TThinkerIterator<AActor> iterator;
 
 	for (Players::iterator it = players.begin(); it != players.end(); ++it)
 	{
@@ -1202,7 +1272,7 @@ void SV_UpdateHiddenMobj(void)
 
 		int updated = 0;
 
-		while (!pl.to_spawn.empty())
+		while (!pl.to_spawn.empty() && updated < MAX_AWARENESS_UPDATES)
 		{
 			mo = pl.to_spawn.front();
 
@@ -1210,17 +1280,22 @@ void SV_UpdateHiddenMobj(void)
 
 			if (mo && !mo->WasDestroyed())
 				updated += SV_AwarenessUpdate(pl, mo);
-
-			if (updated > 16)
-				break;
 		}
 
-		while ((mo = iterator.Next()))
+		for (int scanned = 0;
+		     scanned < AWARENESS_SCAN_BUDGET && updated < MAX_AWARENESS_UPDATES;
+		     scanned++)
 		{
-			updated += SV_AwarenessUpdate(pl, mo);
-
-			if (updated > 16)
+			mo = P_NextThingById(pl.awareness_cursor);
+			if (!mo)
+			{
+				// Went through all of them, start over next tic.
+				pl.awareness_cursor = 0;
 				break;
+			}
+
+			pl.awareness_cursor = mo->netid;
+			updated += SV_AwarenessUpdate(pl, mo);
 		}
 	}
 }
@@ -1759,9 +1834,13 @@ void SV_ConnectClient()
 
 	// clear and reinitialize client network info
 	cl->address = net_from;
+	SV_AddPlayerAddress(*player);
 	cl->last_received = gametic;
 	cl->reliable_bps = 0;
 	cl->unreliable_bps = 0;
+	cl->rate_tokens = 0;
+	cl->rate_refilled = 0;
+	cl->throttled_bytes = 0;
 	cl->lastcmdtic = 0;
 	cl->lastclientcmdtic = 0;
 	cl->allow_rcon = false;
@@ -1770,15 +1849,10 @@ void SV_ConnectClient()
 	SZ_Clear(&cl->netbuf);
 	SZ_Clear(&cl->reliablebuf);
 
-	for (size_t i = 0; i < ARRAY_LENGTH(cl->oldpackets); i++)
-	{
-		cl->oldpackets[i].sequence = -1;
-		SZ_Clear(&cl->oldpackets[i].data);
-	}
+	SV_ClearReliable(*cl);
 
-	cl->sequence = 0;
-	cl->last_sequence = -1;
-	cl->packetnum = 0;
+	SV_ClearMobjDeltas(*player);
+	player->awareness_cursor = 0;
 
 	// generate a random string
 	std::stringstream ss;
@@ -1827,6 +1901,13 @@ void SV_ConnectClient()
 
 	// Check if the user entered a good password (if any)
 	std::string passhash = MSG_ReadString();
+
+	// Optional features the client supports, older clients stop here.
+	const byte features = MSG_BytesLeft() > 0 ? MSG_ReadByte() : 0;
+	cl->huffman_packets = (features & CLF_HUFFMAN) != 0;
+	cl->mobj_deltas = (features & CLF_MOBJDELTA) != 0;
+	cl->ackbits_capable = (features & CLF_ACKBITS) != 0;
+
 	if (strlen(join_password.cstring()) && MD5SUM(join_password.cstring()) != passhash)
 	{
 		Printf("%s disconnected (password failed).\n", NET_AdrToString(net_from));
@@ -2023,6 +2104,7 @@ void SV_SendDisconnectSignal()
 	}
 
 	players.clear();
+	SV_ClearPlayerIndexes();
 }
 
 //
@@ -2042,6 +2124,7 @@ void SV_SendReconnectSignal()
 	}
 
 	players.clear();
+	SV_ClearPlayerIndexes();
 }
 
 //
@@ -2724,43 +2807,6 @@ bool SV_PrivMsg(player_t &player)
 	return true;
 }
 
-//
-// SV_UpdateMissiles
-// Updates missiles position sometimes.
-//
-void SV_UpdateMissiles(player_t &pl)
-{
-    AActor *mo;
-
-    TThinkerIterator<AActor> iterator;
-    while ( (mo = iterator.Next() ) )
-    {
-		if (!(mo->flags & MF_MISSILE) || mo->flags & MF_SKULLFLY)
-			continue;
-
-		if (mo->type == MT_PLASMA)
-			continue;
-
-		// update missile position every 30 tics
-		if (((gametic+mo->netid) % 30) && (mo->type != MT_TRACER) && (mo->type != MT_FATSHOT) && !(mo->flags2 & MF2_SEEKERMISSILE))
-			continue;
-		// Revenant tracers and Mancubus fireballs need to be updated more often (and custom tracers)
-		else if (((gametic+mo->netid) % 5) && (mo->type == MT_TRACER || mo->type == MT_FATSHOT || mo->flags2 & MF2_SEEKERMISSILE))
-			continue;
-
-		if(SV_IsPlayerAllowedToSee(pl, mo))
-		{
-			client_t *cl = &pl.client;
-
-			MSG_WriteSVC(&cl->netbuf, SVC_UpdateMobj(*mo));
-
-            if (cl->netbuf.cursize >= 1024)
-                if(!SV_SendPacket(pl))
-                    return;
-		}
-    }
-}
-
 // Update the given actors data immediately.
 void SV_UpdateMobj(AActor* mo)
 {
@@ -2768,6 +2814,8 @@ void SV_UpdateMobj(AActor* mo)
 	if (mo->player)
 		return;
 
+	// Serialize the update once for every player that can see it.
+	std::string encoded;
 	for (Players::iterator it = players.begin(); it != players.end(); ++it)
 	{
 		if (!(it->ingame()))
@@ -2775,8 +2823,11 @@ void SV_UpdateMobj(AActor* mo)
 
 		if (SV_IsPlayerAllowedToSee(*it, mo))
 		{
+			if (encoded.empty() && !MSG_EncodeSVC(encoded, SVC_UpdateMobj(*mo)))
+				return;
+
 			client_t* cl = &(it->client);
-			MSG_WriteSVC(&cl->reliablebuf, SVC_UpdateMobj(*mo));
+			MSG_WriteEncodedSVC(&cl->reliablebuf, encoded);
 		}
 	}
 }
@@ -2784,6 +2835,8 @@ void SV_UpdateMobj(AActor* mo)
 // Update the given actors state immediately.
 void SV_UpdateMobjState(AActor* mo)
 {
+	// Serialize the state once for every player that can see it.
+	std::string encoded;
 	for (Players::iterator it = players.begin(); it != players.end(); ++it)
 	{
 		if (!(it->ingame()))
@@ -2791,42 +2844,36 @@ void SV_UpdateMobjState(AActor* mo)
 
 		if (SV_IsPlayerAllowedToSee(*it, mo))
 		{
+			if (encoded.empty() && !MSG_EncodeSVC(encoded, SVC_MobjState(mo)))
+				return;
+
 			client_t* cl = &(it->client);
-			MSG_WriteSVC(&cl->reliablebuf, SVC_MobjState(mo));
+			MSG_WriteEncodedSVC(&cl->reliablebuf, encoded);
 		}
 	}
 }
 
-// Keep tabs on monster positions and angles.
-void SV_UpdateMonsters(player_t &pl)
-{
-	AActor *mo;
+static hordeInfo_t lastHordeInfo = {HS_STARTING, -1, -1, -1, 0, 0, -1, -1, -1, -1, -1};
+static int hordeInfoTic;
 
-	TThinkerIterator<AActor> iterator;
-	while ((mo = iterator.Next()))
+//
+// SV_CheckGametype
+//
+// Note gametype state that changed this tic.  Called once before clients
+// are updated, since SV_UpdateGametype can run on several threads at once.
+//
+static void SV_CheckGametype()
+{
+	if (G_IsHordeMode())
 	{
-		// Ignore corpses.
-		if (mo->flags & MF_CORPSE)
-			continue;
-
-		// We don't handle updating non-monsters here.
-		if (!(mo->flags & MF_COUNTKILL || mo->type == MT_SKULL))
-			continue;
-
-		// update monster position every 7 tics
-		if ((gametic+mo->netid) % 7)
-			continue;
-
-		if (SV_IsPlayerAllowedToSee(pl, mo) && mo->target)
+		// If the hordeinfo has changed since last tic, save it.
+		if (hordeInfoTic != ::gametic)
 		{
-			client_t *cl = &pl.client;
-
-			MSG_WriteSVC(&cl->netbuf, SVC_UpdateMobj(*mo));
-
-			if (cl->netbuf.cursize >= 1024)
+			const hordeInfo_t info = P_HordeInfo();
+			if (!info.equals(lastHordeInfo))
 			{
-				if (!SV_SendPacket(pl))
-					return;
+				memcpy(&lastHordeInfo, &info, sizeof(hordeInfo_t));
+				hordeInfoTic = ::gametic;
 			}
 		}
 	}
@@ -2836,24 +2883,10 @@ void SV_UpdateGametype(player_t& pl)
 {
 	if (G_IsHordeMode())
 	{
-		static hordeInfo_t lastInfo = {HS_STARTING, -1, -1, -1, 0, 0, -1, -1, -1, -1, -1};
-		static int ticsent;
-
-		// If the hordeinfo has changed since last tic, save and send it.
-		if (ticsent != ::gametic)
-		{
-			const hordeInfo_t info = P_HordeInfo();
-			if (!info.equals(lastInfo))
-			{
-				memcpy(&lastInfo, &info, sizeof(hordeInfo_t));
-				ticsent = ::gametic;
-			}
-		}
-
 		// Send it if we're on the tic it mutated on or to a fresh player.
-		if (ticsent == ::gametic || (pl.GameTime == 0 && pl.ingame()))
+		if (hordeInfoTic == ::gametic || (pl.GameTime == 0 && pl.ingame()))
 		{
-			MSG_WriteSVC(&pl.client.netbuf, SVC_HordeInfo(lastInfo));
+			MSG_WriteSVC(&pl.client.netbuf, SVC_HordeInfo(lastHordeInfo));
 		}
 	}
 }
@@ -3036,6 +3069,27 @@ void SV_ClearClientsBPS(void)
 	}
 }
 
+//
+// SV_DropOverflowedClients
+//
+// Clients whose reliable buffer overflowed while player jobs were running
+// are only dropped afterwards, on the main thread.
+//
+static void SV_DropOverflowedClients(const std::vector<player_t*>& jobplayers)
+{
+	for (size_t i = 0; i < jobplayers.size(); i++)
+	{
+		if (jobplayers[i]->client.reliablebuf.overflowed)
+			SV_SendPacket(*jobplayers[i]);
+	}
+}
+
+static void SV_SendPlayerPacket(player_t& player)
+{
+	SV_ResendReliable(player);
+	SV_SendPacket(player);
+}
+
 //
 // SV_SendPackets
 //
@@ -3057,12 +3111,15 @@ void SV_SendPackets()
 		++begin;
 
 	// Loop through all players in a staggered fashion.
+	std::vector<player_t*> jobplayers;
+	jobplayers.reserve(num_players);
+
 	Players::iterator it = begin;
 	do
 	{
 		// [AM] Don't send packets to players who haven't acked packet 0
 		if (it->playerstate != PST_CONTACT)
-			SV_SendPacket(*it);
+			jobplayers.push_back(&*it);
 
 		++it;
 		if (it == players.end())
@@ -3070,10 +3127,45 @@ void SV_SendPackets()
 	}
 	while (it != begin);
 
+	// Queue every client's datagram and hand them to the kernel together.
+	NET_BeginSendBatch();
+
+	SV_RunPlayerJobs(SV_SendPlayerPacket, jobplayers);
+
+	SV_CountUnsentPackets(NET_EndSendBatch());
+
+	SV_DropOverflowedClients(jobplayers);
+
 	// Advance the send index.
 	fair_send++;
 }
 
+//
+// SV_FlushBuffer
+//
+// Called when a message won't fit into a client's buffer.  Seals the
+// current datagram for the client that owns the buffer so the message
+// starts a new one, without disturbing anybody else's packets.  Returns
+// false if the client overflowed its reliable buffer and is being dropped.
+//
+bool SV_FlushBuffer(buf_t* b)
+{
+	for (Players::iterator it = players.begin(); it != players.end(); ++it)
+	{
+		client_t* cl = &it->client;
+		if (b != &cl->netbuf && b != &cl->reliablebuf)
+			continue;
+
+		// [AM] Don't send packets to players who haven't acked packet 0
+		if (it->playerstate != PST_CONTACT)
+			return SV_SendPacket(*it);
+
+		return true;
+	}
+
+	return true;
+}
+
 void SV_SendPlayerStateUpdate(client_t *client, player_t *player)
 {
 	if (!client || !player || !player->mo)
@@ -3094,62 +3186,131 @@ void SV_SpyPlayer(player_t &viewer)
 	SV_SendPlayerStateUpdate(&viewer.client, &other);
 }
 
+struct PlayerDistance
+{
+	fixed_t distance;
+	player_t* player;
+
+	bool operator<(const PlayerDistance& other) const
+	{
+		return distance < other.distance;
+	}
+};
+
 //
-// SV_WriteCommands
+// SV_UpdateOtherPlayers
 //
-void SV_WriteCommands(void)
+// Send the client the positions of the other players it can see, closest
+// to its point of view first.
+//
+static void SV_UpdateOtherPlayers(player_t& player, const AActor* viewer)
 {
-	// [SL] 2011-05-11 - Save player positions and moving sector heights so
-	// they can be reconciled later for unlagging
-	Unlag::getInstance().recordPlayerPositions();
-	Unlag::getInstance().recordSectorPositions();
+	std::vector<PlayerDistance> visible;
 
-	for (Players::iterator it = players.begin(); it != players.end(); ++it)
+	for (Players::iterator pit = players.begin();pit != players.end();++pit)
 	{
-		client_t *cl = &(it->client);
+		if (!(pit->ingame()) || !(pit->mo))
+			continue;
 
-		// [SL] 2011-05-11 - Send the client the server's gametic
-		// this gametic is returned to the server with the client's
-		// next cmd
-		if (it->ingame())
-			SV_SendGametic(cl);
+		// a player is updated about their own position elsewhere
+		if (&player == &*pit)
+			continue;
 
-		for (Players::iterator pit = players.begin();pit != players.end();++pit)
-		{
-			if (!(pit->ingame()) || !(pit->mo))
-				continue;
+		// GhostlyDeath -- Screw spectators
+		if (pit->spectator)
+			continue;
 
-			// a player is updated about their own position elsewhere
-			if (&*it == &*pit)
-				continue;
+		if(!SV_IsPlayerAllowedToSee(player, pit->mo))
+			continue;
 
-			// GhostlyDeath -- Screw spectators
-			if (pit->spectator)
-				continue;
+		PlayerDistance pd;
+		pd.distance = viewer ? P_AproxDistance(pit->mo->x - viewer->x,
+		                                       pit->mo->y - viewer->y)
+		                     : 0;
+		pd.player = &*pit;
+		visible.push_back(pd);
+	}
 
-			if(!SV_IsPlayerAllowedToSee(*it, pit->mo))
-				continue;
+	std::stable_sort(visible.begin(), visible.end());
 
-			MSG_WriteSVC(&cl->netbuf, SVC_MovePlayer(*pit, it->tic));
-		}
+	for (size_t i = 0; i < visible.size(); i++)
+		MSG_WriteSVC(&player.client.netbuf, SVC_MovePlayer(*visible[i].player, player.tic));
+}
 
-		// [SL] Send client info about player he is spying on
-		player_t *target = &idplayer(it->spying);
-		if (validplayer(*target) && &(*it) != target && P_CanSpy(*it, *target))
-			SV_SendPlayerStateUpdate(&(it->client), target);
+//
+// SV_WritePlayerCommands
+//
+// Write the periodic updates for a single client.  May run on a worker
+// thread, so it must only write to this client's buffers.
+//
+// Unreliable updates are written most important first, since whatever
+// doesn't fit into the client's rate is cut off the end: the client's own
+// player, the player being spied on, nearby players, then monsters and
+// missiles.
+//
+static void SV_WritePlayerCommands(player_t& player)
+{
+	client_t *cl = &player.client;
+
+	// [SL] 2011-05-11 - Send the client the server's gametic
+	// this gametic is returned to the server with the client's
+	// next cmd
+	if (player.ingame())
+		SV_SendGametic(cl);
+
+	SV_UpdateConsolePlayer(player);
 
-		SV_UpdateConsolePlayer(*it);
+	// [SL] Send client info about player he is spying on
+	AActor* viewer = player.mo;
+	player_t *target = &idplayer(player.spying);
+	if (validplayer(*target) && &player != target && P_CanSpy(player, *target))
+	{
+		SV_SendPlayerStateUpdate(cl, target);
+		viewer = target->mo;
+	}
 
-		SV_UpdateMissiles(*it);
+	SV_UpdateOtherPlayers(player, viewer);
 
-		SV_UpdateMonsters(*it);
+	SV_UpdateGametype(player);  // update gametype stuff
 
-		SV_UpdateGametype(*it);     // update gametype stuff
+	SV_UpdateInterestingMobjs(player);
 
-		SV_SendPingRequest(cl);     // request ping reply
+	SV_SendPingRequest(cl);     // request ping reply
 
-		SV_UpdatePing(cl);          // send the ping value of all cients to this client
-	}
+	SV_UpdatePing(cl);          // send the ping value of all cients to this client
+}
+
+//
+// SV_WriteCommands
+//
+void SV_WriteCommands(void)
+{
+	SCOPED_STAT(SV_WriteCommands);
+
+	// [SL] 2011-05-11 - Save player positions and moving sector heights so
+	// they can be reconciled later for unlagging
+	Unlag::getInstance().recordPlayerPositions();
+	Unlag::getInstance().recordSectorPositions();
+
+	// Gather the monsters and missiles due for an update once for everyone.
+	SV_BuildInterestLists();
+
+	SV_CheckGametype();
+
+	std::vector<player_t*> jobplayers;
+	jobplayers.reserve(players.size());
+	for (Players::iterator it = players.begin(); it != players.end(); ++it)
+		jobplayers.push_back(&*it);
+
+	// The world doesn't change while packets are written, so actor updates
+	// only need to be serialized once.
+	SV_BeginMessageCache();
+
+	SV_RunPlayerJobs(SV_WritePlayerCommands, jobplayers);
+
+	SV_EndMessageCache();
+
+	SV_DropOverflowedClients(jobplayers);
 
 	SV_UpdateHiddenMobj();
 
@@ -3254,7 +3415,7 @@ void SV_ProcessPlayerCmd(player_t &player)
 		player.tic = netcmd->getTic();
 
 		// Set the latency amount for Unlagging
-		Unlag::getInstance().setRoundtripDelay(player.id, netcmd->getWorldIndex() & 0xFF);
+		Unlag::getInstance().setRoundtripDelay(player.id, netcmd->getWorldIndex());
 
 		if ((netcmd->hasForwardMove() && abs(netcmd->getForwardMove()) > max_forward_move) ||
 		    (netcmd->hasSideMove() && abs(netcmd->getSideMove()) > max_sr50_side_move))
@@ -3954,6 +4115,10 @@ void SV_ParseCommands(player_t &player)
 			SV_AcknowledgePacket(player);
 			break;
 
+		case clc_ackbits:
+			SV_AcknowledgePackets(player);
+			break;
+
 		case clc_rcon:
 			{
 				std::string str(MSG_ReadString());
@@ -4105,8 +4270,11 @@ void SV_GameTics (void)
 		break;
 	}
 
+	// Player bodies are ticked here instead of in DThinker::RunThinkers.
+	BEGIN_STAT(PlayerThinkCycles);
 	for (Players::iterator it = players.begin(); it != players.end(); ++it)
 		SV_ProcessPlayerCmd(*it);
+	END_STAT(PlayerThinkCycles);
 }
 
 void SV_TouchSpecial(AActor *special, player_t *player)
@@ -4191,6 +4359,10 @@ void SV_DisplayTics()
 //
 void SV_RunTics()
 {
+	SCOPED_STAT(SV_RunTics);
+
+	SV_TicStarted();
+
 	SV_GetPackets();
 
 	std::string cmd = I_ConsoleInput();
@@ -4249,6 +4421,8 @@ void SV_RunTics()
 		}
 	}
 	last_player_count = players.size();
+
+	SV_TicFinished();
 }
 
 
@@ -4440,6 +4614,13 @@ BEGIN_COMMAND (players)
 }
 END_COMMAND (players)
 
+BEGIN_COMMAND(netidstats)
+{
+	Printf(PRINT_HIGH, "Next new netid %u, %" PRIuSIZE " freed netids waiting to be reused\n",
+	       ServerNetID.peekNetID(), ServerNetID.numFreedNetIDs());
+}
+END_COMMAND(netidstats)
+
 void OnChangedSwitchTexture (line_t *line, int useAgain)
 {
 	unsigned state = 0, time = 0;
@@ -4529,6 +4710,7 @@ void SV_SendDestroyActor(AActor *mo)
 				// objects, as a flood of destroyed things could easily overflow a
 				// buffer
 				MSG_WriteSVC(&cl->reliablebuf, SVC_RemoveMobj(*mo));
+				SV_MobjDeltaRemoved(*it, *mo);
 			}
 		}
 	}
@@ -62,6 +62,10 @@ void SV_WriteCommands(void);
 void SV_ClearClientsBPS(void);
 bool SV_SendPacket(player_t &pl);
 void SV_AcknowledgePacket(player_t &player);
+void SV_AcknowledgePackets(player_t &player);
+void SV_ResendReliable(player_t &player);
+void SV_CountUnsentPackets(size_t count);
+void SV_ClearReliable(client_t &cl);
 void SV_DisplayTics();
 void SV_RunTics();
 void SV_ParseCommands(player_t &player);
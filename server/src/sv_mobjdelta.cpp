@@ -0,0 +1,414 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2024 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Delta-compressed actor updates.  Periodic actor updates only carry the
+//  fields that changed since the last state the client acknowledged.
+//
+//  Every tracked update carries a small snapshot id, and the client
+//  remembers the last few states it was sent under those ids.  Once the
+//  packet containing a snapshot is acknowledged, later updates are sent
+//  relative to it.  Updates are only tracked once the client has
+//  acknowledged the actor's spawn, everything else is sent relative to
+//  the spawn baseline like before.  Clients that don't send CLF_MOBJDELTA
+//  when they connect only get full updates.
+//
+//-----------------------------------------------------------------------------
+
+
+#include "odamex.h"
+
+#include "sv_mobjdelta.h"
+
+#include "c_dispatch.h"
+#include "hashtable.h"
+#include "p_mobj.h"
+#include "sv_msgcache.h"
+#include "svc_message.h"
+
+#include "server.pb.h"
+
+namespace
+{
+
+// Unacknowledged snapshots kept per actor.  One less than the client
+// remembers, so the acknowledged snapshot is never pushed out on the
+// client before an update that refers to it arrives.
+const size_t MAX_PENDING = baseline_t::MAX_SNAPSHOTS - 1;
+
+// Send a full update every so often, so a client that lost track of an
+// actor can't stay out of sync for long.
+const int MAX_DELTA_CHAIN = 16;
+
+// Past this many actors per client, updates are no longer tracked.
+const unsigned int MAX_TRACKED_MOBJS = 32768;
+
+const size_t PACKET_RECORD_MASK = 0xFF;
+
+struct PendingSnapshot
+{
+	uint32_t id;
+	baseline_t state;
+};
+
+struct MobjDelta
+{
+	int spawn_sequence; // packet that spawned the actor on the client
+	bool ready;         // client has acknowledged the spawn
+	uint32_t base_id;   // acknowledged snapshot, 0 if there is none yet
+	baseline_t base;
+	uint32_t last_id;
+	int chain;          // deltas sent since the last full update
+	PendingSnapshot pending[MAX_PENDING];
+	size_t num_pending;
+
+	MobjDelta()
+	    : spawn_sequence(-1), ready(false), base_id(0), last_id(0), chain(0),
+	      num_pending(0)
+	{
+	}
+};
+
+// Snapshots that were sent in a packet.  An id of 0 marks the spawn.
+struct PacketSnapshot
+{
+	uint32_t netid;
+	uint32_t id;
+};
+
+struct PacketRecord
+{
+	int sequence;
+	std::vector<PacketSnapshot> snapshots;
+
+	PacketRecord() : sequence(-1)
+	{
+	}
+};
+
+typedef OHashTable<uint32_t, MobjDelta> MobjDeltaTable;
+
+struct DeltaStats
+{
+	unsigned long long full, delta, untracked, full_bytes, delta_bytes;
+
+	DeltaStats() : full(0), delta(0), untracked(0), full_bytes(0), delta_bytes(0)
+	{
+	}
+
+	void add(const DeltaStats& other)
+	{
+		full += other.full;
+		delta += other.delta;
+		untracked += other.untracked;
+		full_bytes += other.full_bytes;
+		delta_bytes += other.delta_bytes;
+	}
+};
+
+// Everything here is only touched on behalf of a single client, so packets
+// for different clients can be built on different threads.
+struct ClientDeltas
+{
+	MobjDeltaTable mobjs;
+	PacketRecord packets[PACKET_RECORD_MASK + 1];
+	DeltaStats stats;
+};
+
+ClientDeltas* client_deltas[MAXPLAYERS + 1];
+
+// Statistics of clients that are gone.
+DeltaStats retired_stats;
+
+} // namespace
+
+static ClientDeltas& SV_GetClientDeltas(player_t& pl)
+{
+	if (client_deltas[pl.id] == NULL)
+		client_deltas[pl.id] = new ClientDeltas;
+
+	return *client_deltas[pl.id];
+}
+
+static MobjDelta* SV_FindMobjDelta(player_t& pl, uint32_t netid)
+{
+	if (client_deltas[pl.id] == NULL)
+		return NULL;
+
+	MobjDeltaTable& mobjs = client_deltas[pl.id]->mobjs;
+	MobjDeltaTable::iterator it = mobjs.find(netid);
+	if (it == mobjs.end())
+		return NULL;
+
+	return &it->second;
+}
+
+static void SV_RecordSnapshot(player_t& pl, int sequence, uint32_t netid, uint32_t id)
+{
+	PacketRecord& rec = SV_GetClientDeltas(pl).packets[sequence & PACKET_RECORD_MASK];
+	if (rec.sequence != sequence)
+	{
+		rec.sequence = sequence;
+		rec.snapshots.clear();
+	}
+
+	PacketSnapshot snap = {netid, id};
+	rec.snapshots.push_back(snap);
+}
+
+// Forget the oldest count pending snapshots.
+static void SV_PopPendingSnapshots(MobjDelta& md, size_t count)
+{
+	for (size_t i = count; i < md.num_pending; i++)
+		md.pending[i - count] = md.pending[i];
+
+	md.num_pending -= count;
+}
+
+//
+// SV_WriteMobjDelta
+//
+// Write a periodic update about an actor to the client's unreliable
+// buffer, relative to the last state of it the client acknowledged.
+//
+void SV_WriteMobjDelta(player_t& pl, AActor& mo)
+{
+	client_t* cl = &pl.client;
+	DeltaStats& stats = SV_GetClientDeltas(pl).stats;
+
+	// Older clients would take a delta for a full update.
+	if (!cl->mobj_deltas)
+	{
+		SV_WriteCachedUpdateMobj(&cl->netbuf, mo);
+		return;
+	}
+
+	MobjDelta* md = SV_FindMobjDelta(pl, mo.netid);
+	if (md == NULL || !md->ready)
+	{
+		// The client might not have the actor yet.
+		stats.untracked++;
+		SV_WriteCachedUpdateMobj(&cl->netbuf, mo);
+		return;
+	}
+
+	odaproto::svc::UpdateMobj msg;
+
+	const bool delta =
+	    md->base_id && md->num_pending < MAX_PENDING && md->chain < MAX_DELTA_CHAIN;
+	if (delta)
+	{
+		msg = SVC_UpdateMobj(mo, P_GetMobjBaselineFlags(mo, md->base));
+		msg.set_delta_from(md->base_id);
+		md->chain++;
+	}
+	else
+	{
+		msg = SVC_UpdateMobj(mo);
+		md->chain = 0;
+	}
+
+	// Make room by giving up on the oldest unacknowledged snapshot.
+	if (md->num_pending == MAX_PENDING)
+		SV_PopPendingSnapshots(*md, 1);
+
+	md->last_id = md->last_id % baseline_t::MAX_SNAPSHOT_ID + 1;
+
+	PendingSnapshot& snap = md->pending[md->num_pending++];
+	snap.id = md->last_id;
+	P_GetMobjState(mo, snap.state);
+
+	msg.set_snapshot(snap.id);
+
+	const uint32_t netid = mo.netid;
+	const size_t size = msg.ByteSizeLong();
+	if (delta)
+	{
+		stats.delta++;
+		stats.delta_bytes += size;
+	}
+	else
+	{
+		stats.full++;
+		stats.full_bytes += size;
+	}
+
+	// Writing can flush the buffer, so the packet sequence is only known
+	// afterwards.
+	MSG_WriteSVC(&cl->netbuf, msg);
+	SV_RecordSnapshot(pl, cl->sequence, netid, snap.id);
+}
+
+//
+// SV_MobjDeltaSpawned
+//
+// The actor was just sent to the client, start tracking it over again.
+//
+void SV_MobjDeltaSpawned(player_t& pl, AActor& mo)
+{
+	if (!mo.netid || !pl.client.mobj_deltas)
+		return;
+
+	ClientDeltas& cd = SV_GetClientDeltas(pl);
+	if (cd.mobjs.size() >= MAX_TRACKED_MOBJS && cd.mobjs.count(mo.netid) == 0)
+		return;
+
+	MobjDelta& md = cd.mobjs[mo.netid];
+	md = MobjDelta();
+	md.spawn_sequence = pl.client.sequence;
+
+	SV_RecordSnapshot(pl, pl.client.sequence, mo.netid, 0);
+}
+
+//
+// SV_MobjDeltaRemoved
+//
+void SV_MobjDeltaRemoved(player_t& pl, AActor& mo)
+{
+	if (client_deltas[pl.id] != NULL)
+		client_deltas[pl.id]->mobjs.erase(mo.netid);
+}
+
+//
+// SV_AcknowledgeMobjDeltas
+//
+// The client received the given packet, so the snapshots in it can be used
+// as a base for later updates.
+//
+void SV_AcknowledgeMobjDeltas(player_t& pl, int sequence)
+{
+	ClientDeltas* cd = client_deltas[pl.id];
+	if (cd == NULL)
+		return;
+
+	PacketRecord& rec = cd->packets[sequence & PACKET_RECORD_MASK];
+	if (rec.sequence != sequence)
+		return;
+
+	for (size_t i = 0; i < rec.snapshots.size(); i++)
+	{
+		const PacketSnapshot& snap = rec.snapshots[i];
+
+		MobjDeltaTable::iterator it = cd->mobjs.find(snap.netid);
+		if (it == cd->mobjs.end())
+			continue;
+
+		MobjDelta& md = it->second;
+
+		if (snap.id == 0)
+		{
+			if (sequence == md.spawn_sequence)
+				md.ready = true;
+			continue;
+		}
+
+		// Ignore anything sent before the actor was last spawned.
+		if (sequence <= md.spawn_sequence)
+			continue;
+
+		for (size_t j = 0; j < md.num_pending; j++)
+		{
+			if (md.pending[j].id != snap.id)
+				continue;
+
+			md.base_id = md.pending[j].id;
+			md.base = md.pending[j].state;
+
+			// Anything older is no use as a base anymore.
+			SV_PopPendingSnapshots(md, j + 1);
+			break;
+		}
+	}
+
+	rec.sequence = -1;
+	rec.snapshots.clear();
+}
+
+//
+// SV_DropMobjDeltas
+//
+// The unreliable part of the given packet was dropped before it was sent,
+// so the snapshots in it never reach the client.
+//
+void SV_DropMobjDeltas(player_t& pl, int sequence)
+{
+	ClientDeltas* cd = client_deltas[pl.id];
+	if (cd == NULL)
+		return;
+
+	PacketRecord& rec = cd->packets[sequence & PACKET_RECORD_MASK];
+	if (rec.sequence != sequence)
+		return;
+
+	// Spawns are sent reliably, keep those.
+	size_t kept = 0;
+	for (size_t i = 0; i < rec.snapshots.size(); i++)
+	{
+		if (rec.snapshots[i].id == 0)
+			rec.snapshots[kept++] = rec.snapshots[i];
+	}
+	rec.snapshots.resize(kept);
+}
+
+//
+// SV_ClearMobjDeltas
+//
+// Forget everything about the client, for when it connects, disconnects or
+// the level changes.
+//
+void SV_ClearMobjDeltas(player_t& pl)
+{
+	if (client_deltas[pl.id] != NULL)
+		retired_stats.add(client_deltas[pl.id]->stats);
+
+	delete client_deltas[pl.id];
+	client_deltas[pl.id] = NULL;
+}
+
+static void PrintDeltaStats(const char* label, unsigned long long count,
+                            unsigned long long bytes)
+{
+	Printf(PRINT_HIGH, "%s: %llu updates, %llu bytes (%.1f bytes average)\n", label,
+	       count, bytes, count ? static_cast<double>(bytes) / count : 0.0);
+}
+
+BEGIN_COMMAND(mobjdeltastats)
+{
+	if (argc > 1 && stricmp(argv[1], "reset") == 0)
+	{
+		retired_stats = DeltaStats();
+		for (size_t i = 0; i < ARRAY_LENGTH(client_deltas); i++)
+		{
+			if (client_deltas[i] != NULL)
+				client_deltas[i]->stats = DeltaStats();
+		}
+		Printf(PRINT_HIGH, "Actor delta statistics reset.\n");
+		return;
+	}
+
+	DeltaStats stats = retired_stats;
+	for (size_t i = 0; i < ARRAY_LENGTH(client_deltas); i++)
+	{
+		if (client_deltas[i] != NULL)
+			stats.add(client_deltas[i]->stats);
+	}
+
+	PrintDeltaStats("Delta", stats.delta, stats.delta_bytes);
+	PrintDeltaStats("Full", stats.full, stats.full_bytes);
+	Printf(PRINT_HIGH, "Untracked: %llu updates\n", stats.untracked);
+}
+END_COMMAND(mobjdeltastats)
@@ -0,0 +1,35 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2024 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Delta-compressed actor updates.  Periodic actor updates only carry the
+//  fields that changed since the last state the client acknowledged.
+//
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include "actor.h"
+#include "d_player.h"
+
+void SV_WriteMobjDelta(player_t& pl, AActor& mo);
+
+void SV_MobjDeltaSpawned(player_t& pl, AActor& mo);
+void SV_MobjDeltaRemoved(player_t& pl, AActor& mo);
+void SV_AcknowledgeMobjDeltas(player_t& pl, int sequence);
+void SV_DropMobjDeltas(player_t& pl, int sequence);
+void SV_ClearMobjDeltas(player_t& pl);
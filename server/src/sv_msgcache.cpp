@@ -0,0 +1,199 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2024 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Per-tic cache of serialized actor messages.  While clients' packets are
+//  being written the world doesn't change, so a message about an actor is
+//  serialized once and copied into every interested client's buffer.
+//
+//-----------------------------------------------------------------------------
+
+
+#include "odamex.h"
+
+#include "sv_msgcache.h"
+
+#include <deque>
+
+#include "c_dispatch.h"
+#include "hashtable.h"
+#include "sv_workers.h"
+#include "svc_message.h"
+
+#include "server.pb.h"
+
+namespace
+{
+
+// OHashTable can't grow past 65536 buckets, so stop caching well before the
+// table fills up and fall back to serializing directly.
+const size_t MAX_CACHED_MESSAGES = 32768;
+
+typedef OHashTable<unsigned long long, size_t> MessageIndex;
+
+// Cache lookup, keyed on netid and svc header.
+MessageIndex message_index;
+
+// Encoded messages.  The strings are reused between tics so their storage
+// doesn't need to be reallocated.  A deque keeps them in place as it grows,
+// since other threads may be copying from them.
+std::deque<std::string> encoded_messages;
+size_t num_cached = 0;
+bool active = false;
+
+struct CacheStats
+{
+	unsigned long long hits, misses, uncached, bytes_saved;
+};
+
+CacheStats tic_stats = {0, 0, 0, 0};
+CacheStats total_stats = {0, 0, 0, 0};
+
+} // namespace
+
+static unsigned long long CacheKey(uint32_t netid, svc_t header)
+{
+	return (static_cast<unsigned long long>(netid) << 8) | header;
+}
+
+//
+// SV_FindCachedSVC
+//
+// Returns the encoded message for the given actor, or NULL if it hasn't been
+// serialized yet this tic.
+//
+static const std::string* SV_FindCachedSVC(uint32_t netid, svc_t header)
+{
+	MessageIndex::const_iterator it = message_index.find(CacheKey(netid, header));
+	if (it == message_index.end())
+		return NULL;
+
+	const std::string* str = &encoded_messages[it->second];
+
+	tic_stats.hits++;
+	tic_stats.bytes_saved += str->size();
+	return str;
+}
+
+//
+// SV_CacheSVC
+//
+// Serialize a message and remember it for the rest of the tic.  Returns
+// NULL if the message could not be serialized or the cache is full.
+//
+static const std::string* SV_CacheSVC(uint32_t netid, svc_t header,
+                                      const google::protobuf::Message& msg)
+{
+	if (num_cached >= MAX_CACHED_MESSAGES)
+	{
+		tic_stats.uncached++;
+		return NULL;
+	}
+
+	if (num_cached >= encoded_messages.size())
+		encoded_messages.resize(num_cached + 1);
+
+	std::string& str = encoded_messages[num_cached];
+	if (!MSG_EncodeSVC(str, msg))
+		return NULL;
+
+	message_index.insert(std::make_pair(CacheKey(netid, header), num_cached));
+	num_cached++;
+
+	tic_stats.misses++;
+	return &str;
+}
+
+//
+// SV_BeginMessageCache
+//
+// Start caching messages.  The world must not change until
+// SV_EndMessageCache is called.
+//
+void SV_BeginMessageCache()
+{
+	message_index.clear();
+	num_cached = 0;
+	active = true;
+
+	tic_stats.hits = tic_stats.misses = 0;
+	tic_stats.uncached = tic_stats.bytes_saved = 0;
+}
+
+//
+// SV_EndMessageCache
+//
+void SV_EndMessageCache()
+{
+	active = false;
+
+	total_stats.hits += tic_stats.hits;
+	total_stats.misses += tic_stats.misses;
+	total_stats.uncached += tic_stats.uncached;
+	total_stats.bytes_saved += tic_stats.bytes_saved;
+}
+
+void SV_WriteCachedUpdateMobj(buf_t* b, AActor& mo)
+{
+	if (!active)
+	{
+		MSG_WriteSVC(b, SVC_UpdateMobj(mo));
+		return;
+	}
+
+	// Cached messages are never changed until the next tic, so they can be
+	// copied from without holding the lock.
+	const std::string* str;
+	{
+		WorkerLock lock;
+
+		str = SV_FindCachedSVC(mo.netid, svc_updatemobj);
+		if (str == NULL)
+			str = SV_CacheSVC(mo.netid, svc_updatemobj, SVC_UpdateMobj(mo));
+	}
+
+	if (str != NULL)
+		MSG_WriteEncodedSVC(b, *str);
+	else
+		MSG_WriteSVC(b, SVC_UpdateMobj(mo));
+}
+
+static void PrintCacheStats(const char* label, const CacheStats& stats)
+{
+	const unsigned long long lookups = stats.hits + stats.misses;
+	const double ratio = lookups ? 100.0 * stats.hits / lookups : 0.0;
+
+	Printf(PRINT_HIGH, "%s: %llu hits, %llu misses (%.1f%% hit rate), "
+	       "%llu uncached, %llu bytes not reserialized\n",
+	       label, stats.hits, stats.misses, ratio, stats.uncached,
+	       stats.bytes_saved);
+}
+
+BEGIN_COMMAND(msgcachestats)
+{
+	if (argc > 1 && stricmp(argv[1], "reset") == 0)
+	{
+		total_stats.hits = total_stats.misses = 0;
+		total_stats.uncached = total_stats.bytes_saved = 0;
+		Printf(PRINT_HIGH, "Message cache statistics reset.\n");
+		return;
+	}
+
+	PrintCacheStats("Last tic", tic_stats);
+	PrintCacheStats("Total", total_stats);
+}
+END_COMMAND(msgcachestats)
@@ -0,0 +1,33 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2024 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Per-tic cache of serialized actor messages.  While clients' packets are
+//  being written the world doesn't change, so a message about an actor is
+//  serialized once and copied into every interested client's buffer.
+//
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include "actor.h"
+#include "i_net.h"
+
+void SV_BeginMessageCache();
+void SV_EndMessageCache();
+
+void SV_WriteCachedUpdateMobj(buf_t* b, AActor& mo);
@@ -24,31 +24,122 @@
 
 #include "odamex.h"
 
+#include <algorithm>
+
+#include "c_dispatch.h"
+#include "cmdlib.h"
+#include "i_system.h"
 #include "p_local.h"
 #include "sv_main.h"
+#include "sv_mobjdelta.h"
+#include "sv_workers.h"
 #include "huffman.h"
 #include "i_net.h"
+#include "minilzo.h"
 
 #ifdef SIMULATE_LATENCY
 #include <thread>
 #include <chrono>
 #endif
 
-QWORD I_MSTime (void);
-
 EXTERN_CVAR (log_packetdebug)
 #ifdef SIMULATE_LATENCY
 EXTERN_CVAR (sv_latency)
 #endif
 
-buf_t plain(MAX_UDP_PACKET); // denis - todo - call_terms destroys these statics on quit
-buf_t sendd(MAX_UDP_PACKET);
-
 const static size_t PACKET_FLAG_INDEX = sizeof(uint32_t);
 const static size_t PACKET_MESSAGE_INDEX = PACKET_FLAG_INDEX + 1;
 const static size_t PACKET_HEADER_SIZE = PACKET_MESSAGE_INDEX;
 const static size_t PACKET_OLD_MASK = 0xFF;
 
+// Retransmission timeouts, in ms.  Clients acknowledge once per tic, so
+// the timeout is never less than a tic on top of the round trip time.
+const static int INITIAL_RTO = 250;
+const static int MIN_RTO = 1000 / TICRATE;
+const static int MAX_RTO = 2000;
+
+// The timeout doubles with every resend of the same packet, up to this
+// many times.
+const static int MAX_RTO_BACKOFF = 3;
+
+// Unused rate that can be saved up, in tics.
+const static int RATE_BURST_TICS = 4;
+
+// Bytes each packet adds to a coalesced datagram, for its sequence number
+// and size.
+const static size_t COALESCED_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint16_t);
+
+// Space to build and compress packets in.  Packets can be built on
+// several threads at once, so each one gets its own.
+struct PacketScratch
+{
+	buf_t packet;
+	buf_t compressed;
+	std::vector<byte> workmem;
+};
+
+static PacketScratch packet_scratch[MAX_WORKER_THREADS + 1];
+
+static PacketScratch& GetPacketScratch()
+{
+	PacketScratch& scratch = packet_scratch[SV_WorkerIndex()];
+	if (scratch.packet.maxsize() < MAX_UDP_PACKET)
+	{
+		scratch.packet.resize(MAX_UDP_PACKET);
+		scratch.compressed.resize(MAX_UDP_PACKET);
+		scratch.workmem.resize(LZO1X_1_MEM_COMPRESS);
+	}
+	return scratch;
+}
+
+// Packets the socket refused, shown by reliablestats.
+static unsigned long long unsent_packets = 0;
+
+// One packet in this many is copied for netcodecbench and netcodecmodel.
+const static unsigned int CODEC_SAMPLE_INTERVAL = 16;
+const static size_t MAX_CODEC_SAMPLES = 256;
+
+static std::vector<std::string> codec_samples;
+static unsigned int codec_packets = 0;
+static unsigned long long codec_histogram[256];
+
+//
+// SV_SampleCodecPacket
+//
+// Keep a copy of some of the packets sent, to see how well they compress.
+// Only the sampled packets take the worker lock.
+//
+static void SV_SampleCodecPacket(const buf_t& packet, const size_t reserved)
+{
+	const unsigned int index = __sync_fetch_and_add(&codec_packets, 1);
+	if (index % CODEC_SAMPLE_INTERVAL != 0)
+		return;
+
+	WorkerLock lock;
+
+	const byte* data = packet.data + reserved;
+	const size_t len = packet.size() - reserved;
+
+	for (size_t i = 0; i < len; i++)
+		codec_histogram[data[i]]++;
+
+	const size_t slot = (index / CODEC_SAMPLE_INTERVAL) % MAX_CODEC_SAMPLES;
+	if (slot >= codec_samples.size())
+		codec_samples.resize(slot + 1);
+
+	codec_samples[slot].assign(reinterpret_cast<const char*>(data), len);
+}
+
+//
+// PacketFlags
+//
+// Header flags every packet to the client carries, before compression.
+//
+static byte PacketFlags(const client_t& cl)
+{
+	return cl.ackbits_capable ? SVF_ACKBITS : 0;
+}
+
 //
 // CompressPacket
 //
@@ -58,25 +149,57 @@ const static size_t PACKET_OLD_MASK = 0xFF;
 //
 // [AM] Cleaned the old huffman calls for code clarity sake.
 //
-static void CompressPacket(buf_t& send, const size_t reserved, client_t* cl)
+// Compresses into a separate buffer instead of back into the packet, and
+// returns whichever of the two should go on the wire.
+//
+// Clients that support it can also get packets compressed with the fixed
+// protocol model, which needs no warmup and so does well on the small
+// packets minilzo skips.  Its output size is known up front, so minilzo is
+// only kept when it does better.
+//
+static buf_t& CompressPacket(PacketScratch& scratch, const size_t reserved, client_t* cl)
 {
-	if (plain.maxsize() < send.maxsize())
+	buf_t* out = &scratch.packet;
+	const size_t len = scratch.packet.size() - reserved;
+
+	size_t huffman_len = len;
+	if (cl->huffman_packets)
 	{
-		plain.resize(send.maxsize());
+		const size_t bits =
+		    protocol_huffman.compressed_bits(scratch.packet.data + reserved, len);
+		huffman_len = (bits + 7) / 8;
 	}
 
-	plain.setcursize(send.size());
-	memcpy(plain.ptr(), send.ptr(), send.size());
-
 	byte method = 0;
-	if (MSG_CompressMinilzo(send, reserved, 0))
+	if (MSG_CompressMinilzo(scratch.packet, scratch.compressed, reserved,
+	                        &scratch.workmem[0]) &&
+	    scratch.compressed.size() - reserved <= huffman_len)
 	{
 		// Successful compression, set the compression flag bit.
 		method |= SVF_COMPRESSED;
+		out = &scratch.compressed;
 	}
+	else if (huffman_len < len &&
+	         MSG_CompressHuffman(protocol_huffman, scratch.packet, scratch.compressed,
+	                             reserved))
+	{
+		method |= SVF_HUFFMAN;
+		out = &scratch.compressed;
+	}
+
+	out->ptr()[PACKET_FLAG_INDEX] |= method;
+
+	SV_SampleCodecPacket(scratch.packet, reserved);
 
-	send.ptr()[PACKET_FLAG_INDEX] |= method;
-	DPrintf("CompressPacket %x %lu\n", method, send.size());
+	// The console isn't safe to print to from the worker threads, so only
+	// lock when there's something to print.
+	if (developer || devparm)
+	{
+		WorkerLock lock;
+		DPrintf("CompressPacket %x %lu\n", method, out->size());
+	}
+
+	return *out;
 }
 
 #ifdef SIMULATE_LATENCY
@@ -128,17 +251,93 @@ void SV_SendPacketDelayed(buf_t& packet, player_t& pl)
 }
 #endif
 
+//
+// SV_RefillRate
+//
+// Top up the bytes the client may be sent, at cl->rate kilobytes per
+// second.  A few tics worth can be saved up for bursts.
+//
+static void SV_RefillRate(client_t* cl)
+{
+	const dtime_t now = I_MSTime();
+	const int burst = std::max(cl->rate * 1000 / TICRATE * RATE_BURST_TICS, MAX_UDP_SIZE);
+
+	// Kilobytes per second are bytes per ms.  A long enough wait fills it
+	// up anyway, which also keeps the multiplication from overflowing.
+	const dtime_t elapsed = now - cl->rate_refilled;
+	if (cl->rate_refilled == 0 || elapsed >= static_cast<dtime_t>(burst))
+		cl->rate_tokens = burst;
+	else
+		cl->rate_tokens = std::min(cl->rate_tokens + cl->rate * static_cast<int>(elapsed), burst);
+
+	cl->rate_refilled = now;
+}
+
+//
+// UnreliableCutoff
+//
+// Returns how much of the unreliable buffer fits into budget bytes without
+// splitting a message.  Messages are written most important first, so
+// whatever is left out matters least.
+//
+static size_t UnreliableCutoff(const buf_t& buf, size_t budget)
+{
+	size_t pos = 0;
+	while (pos < buf.cursize)
+	{
+		// svc header, then the size of the message as an unsigned varint
+		size_t next = pos + 1;
+		size_t size = 0;
+		for (int shift = 0;; shift += 7)
+		{
+			if (next >= buf.cursize || shift > 28)
+				return pos;
+
+			const byte b = buf.data[next++];
+			size |= static_cast<size_t>(b & 0x7F) << shift;
+			if (!(b & 0x80))
+				break;
+		}
+
+		next += size;
+		if (next > buf.cursize || next > budget)
+			break;
+
+		pos = next;
+	}
+
+	return pos;
+}
+
 //
 // SV_SendPacket
 //
 bool SV_SendPacket(player_t &pl)
 {
-	int				bps = 0; // bytes per second, not bits per second
-
 	client_t *cl = &pl.client;
 
+	// This packet goes into the resend slot of the packet a whole ring
+	// before it.  If that one still hasn't been acknowledged, its reliable
+	// data can never be sent again and the client can't be caught up, so it
+	// is dropped the same way as one that overflowed.
+	client_t::oldPacket_t& old = cl->oldpackets[cl->sequence & PACKET_OLD_MASK];
+	if (old.sequence >= 0 && !old.acked && old.data.cursize && !cl->reliablebuf.overflowed)
+	{
+		cl->dropped_packets++;
+		cl->reliablebuf.overflowed = true;
+
+		WorkerLock lock;
+		Printf(PRINT_HIGH, "%s stopped acknowledging reliable packets, dropping client.\n",
+		       NET_AdrToString(cl->address));
+	}
+
 	if (cl->reliablebuf.overflowed)
-	{ 
+	{
+		// Dropping a client touches the whole server, leave it for the
+		// main thread to do once the player jobs are done.
+		if (SV_InPlayerJobs())
+			return false;
+
 		SZ_Clear(&cl->netbuf);
 		SZ_Clear(&cl->reliablebuf);
 	    SV_DropClient(pl);
@@ -152,22 +351,27 @@ bool SV_SendPacket(player_t &pl)
 	if (cl->reliablebuf.cursize + cl->netbuf.cursize == 0)
 		return true;
 
+	PacketScratch& scratch = GetPacketScratch();
+	buf_t& sendd = scratch.packet;
 	sendd.clear();
 
-	// save the reliable message 
+	// save the reliable message
 	// it will be retransmited, if it's missed
-	client_t::oldPacket_t& old = cl->oldpackets[cl->sequence & PACKET_OLD_MASK];
+	//
+	// The reliable buffer is swapped into the resend slot instead of being
+	// copied, and the slot's previous storage becomes the new reliable buffer.
+	old.sequence = cl->sequence;
+	old.sent = I_MSTime();
+	old.resends = 0;
+	old.acked = false;
 
 	old.data.clear();
 	if (cl->reliablebuf.cursize)
 	{
-		// copy the reliable data into the buffer.
-		old.sequence = cl->sequence;
-		SZ_Write(&old.data, cl->reliablebuf.data, cl->reliablebuf.cursize);
-	}
-	else
-	{
-		old.sequence = -1;
+		old.data.swap(cl->reliablebuf);
+
+		if (cl->reliablebuf.maxsize() < MAX_UDP_PACKET)
+			cl->reliablebuf.resize(MAX_UDP_PACKET);
 	}
 
 	cl->packetnum++; // packetnum will never be more than 255
@@ -176,62 +380,82 @@ bool SV_SendPacket(player_t &pl)
 
 	// copy sequence
 	MSG_WriteLong(&sendd, cl->sequence++);
-	MSG_WriteByte(&sendd, 0); // Flags, filled out later.
+	MSG_WriteByte(&sendd, PacketFlags(*cl)); // Compression is filled out later.
 
 	// copy the reliable message to the packet first
-    if (cl->reliablebuf.cursize)
-    {
-		SZ_Write (&sendd, cl->reliablebuf.data, cl->reliablebuf.cursize);
-		cl->reliable_bps += cl->reliablebuf.cursize;
-    }
-
-	// add the unreliable part if space is available and rate value
-	// allows it
-	if (gametic % 35)
-	    bps = (int)((double)( (cl->unreliable_bps + cl->reliable_bps) * TICRATE)/(double)(gametic%35));
-
-    if (bps < cl->rate*1000)
-
-	  if (cl->netbuf.cursize && (sendd.maxsize() - sendd.cursize > cl->netbuf.cursize) )
-	  {
-         SZ_Write (&sendd, cl->netbuf.data, cl->netbuf.cursize);
-	     cl->unreliable_bps += cl->netbuf.cursize;
-	  }
-    
+	if (old.data.cursize)
+	{
+		SZ_Write (&sendd, old.data.data, old.data.cursize);
+		cl->reliable_bps += old.data.cursize;
+	}
+
+	// reliable data always goes out, the unreliable part gets whatever is
+	// left of the client's rate
+	SV_RefillRate(cl);
+	cl->rate_tokens -= old.data.cursize;
+
+	size_t unreliable = 0;
+	if (cl->netbuf.cursize)
+	{
+		const size_t space = sendd.maxsize() - sendd.cursize - 1;
+		const size_t budget = std::min(space, static_cast<size_t>(std::max(cl->rate_tokens, 0)));
+
+		unreliable = cl->netbuf.cursize <= budget ? cl->netbuf.cursize
+		                                          : UnreliableCutoff(cl->netbuf, budget);
+	}
+
+	if (unreliable)
+	{
+		SZ_Write (&sendd, cl->netbuf.data, unreliable);
+		cl->unreliable_bps += unreliable;
+		cl->rate_tokens -= unreliable;
+	}
+
+	// actor snapshots in the unreliable part never make it to the client
+	if (unreliable < cl->netbuf.cursize)
+	{
+		cl->throttled_bytes += cl->netbuf.cursize - unreliable;
+		SV_DropMobjDeltas(pl, cl->sequence - 1);
+	}
+
 	SZ_Clear(&cl->netbuf);
 	SZ_Clear(&cl->reliablebuf);
-	
+
 	// compress the packet, but not the sequence id
-	if (sendd.size() > PACKET_HEADER_SIZE)
-	{
-		CompressPacket(sendd, PACKET_HEADER_SIZE, cl);
-	}
+	buf_t& packet = sendd.size() > PACKET_HEADER_SIZE
+	                    ? CompressPacket(scratch, PACKET_HEADER_SIZE, cl)
+	                    : sendd;
+
+	// the socket and the console are shared between threads
+	WorkerLock lock;
 
 	if (log_packetdebug)
 	{
 		Printf(PRINT_HIGH, "ply %03u, pkt %06u, size %04lu, tic %07u, time %011llu\n",
-			   pl.id, cl->sequence - 1, sendd.cursize, gametic, I_MSTime());
+			   pl.id, cl->sequence - 1, packet.cursize, gametic, I_MSTime());
 	}
 
 #ifdef SIMULATE_LATENCY
-	SV_SendPacketDelayed(sendd, pl);
+	SV_SendPacketDelayed(packet, pl);
 #else
 
-	NET_SendPacket(sendd, cl->address);
+	if (NET_SendPacket(packet, cl->address) < 0)
+		unsent_packets++;
 #endif
 	return true;
 }
 
 /**
  * @brief Send an old reliable packet with old data on the wire.
- * 
+ *
  * @param pl Player to send to.
  * @param sequence Sequence number to send.  This assumss
 */
 static void SendOldPacket(player_t& pl, const int sequence)
 {
 	// Send buffer.
-	static buf_t send(MAX_UDP_PACKET);
+	PacketScratch& scratch = GetPacketScratch();
+	buf_t& send = scratch.packet;
 	send.clear();
 
 	client_t& cl = pl.client;
@@ -241,60 +465,445 @@ static void SendOldPacket(player_t& pl, const int sequence)
 	// have saved out.
 
 	MSG_WriteLong(&send, old.sequence);
-	MSG_WriteByte(&send, 0); // Flags, filled out later.
+	MSG_WriteByte(&send, PacketFlags(cl)); // Compression is filled out later.
 
 	// copy the reliable message to the packet
 	if (old.data.cursize)
 	{
 		SZ_Write(&send, old.data.data, old.data.cursize);
 		cl.reliable_bps += old.data.cursize;
+		cl.rate_tokens -= old.data.cursize;
 	}
 
 	// compress the packet, but not the sequence id
-	if (send.size() > PACKET_HEADER_SIZE)
+	buf_t& packet = send.size() > PACKET_HEADER_SIZE
+	                    ? CompressPacket(scratch, PACKET_HEADER_SIZE, &cl)
+	                    : send;
+
+	WorkerLock lock;
+	if (NET_SendPacket(packet, cl.address) < 0)
+		unsent_packets++;
+}
+
+/**
+ * @brief Send the packets gathered by SV_ResendReliable.  A lone packet is
+ *        sent the old way, under its own sequence number.
+ */
+static void SendCoalescedPacket(player_t& pl, const int first, const size_t count)
+{
+	if (count == 0)
+		return;
+
+	if (count == 1)
 	{
-		CompressPacket(send, PACKET_HEADER_SIZE, &cl);
+		SendOldPacket(pl, first);
+		return;
 	}
 
-	NET_SendPacket(send, cl.address);
+	PacketScratch& scratch = GetPacketScratch();
+
+	// compress the packet, but not the header
+	buf_t& packet = CompressPacket(scratch, PACKET_HEADER_SIZE, &pl.client);
+
+	WorkerLock lock;
+	if (NET_SendPacket(packet, pl.client.address) < 0)
+		unsent_packets++;
 }
 
 //
-// SV_AcknowledgePacket
+// SV_ResendReliable
 //
-void SV_AcknowledgePacket(player_t &player)
+// Send reliable data the client hasn't acknowledged again, if a newer
+// packet made it there or the retransmission timeout ran out.  Clients
+// that acknowledge with clc_ackbits get everything that is due in as few
+// datagrams as possible.
+//
+void SV_ResendReliable(player_t &pl)
 {
-	client_t *cl = &player.client;
+	client_t* cl = &pl.client;
 
-	int sequence = MSG_ReadLong();
+	// Slots before this have been reused already.
+	const int oldest = cl->sequence - static_cast<int>(PACKET_OLD_MASK);
+	if (cl->oldest_unacked < oldest)
+		cl->oldest_unacked = oldest;
 
-	cl->compressor.packet_acked(sequence);
+	const dtime_t now = I_MSTime();
+
+	PacketScratch& scratch = GetPacketScratch();
+	buf_t& bundle = scratch.packet;
+	int first = -1;
+	size_t count = 0;
 
-	// packet is missed
-	if (sequence - cl->last_sequence > 1)
+	bool pending = false;
+	for (int seq = cl->oldest_unacked; seq < cl->sequence; seq++)
 	{
-		// resend
-		for (int seq = cl->last_sequence+1; seq < sequence; seq++)
+		client_t::oldPacket_t& old = cl->oldpackets[seq & PACKET_OLD_MASK];
+		if (old.sequence != seq || old.acked || old.data.cursize == 0)
+		{
+			if (!pending)
+				cl->oldest_unacked = seq + 1;
+			continue;
+		}
+
+		pending = true;
+
+		// A newer packet made it, so this one most likely didn't.  Otherwise
+		// give it until the timeout runs out.
+		const bool lost = old.resends == 0 && seq < cl->last_sequence;
+		const dtime_t timeout =
+		    static_cast<dtime_t>(cl->rto) << std::min(old.resends, MAX_RTO_BACKOFF);
+		if (!lost && now - old.sent < timeout)
+			continue;
+
+		old.sent = now;
+		old.resends++;
+		cl->resent_packets++;
+
+		if (!cl->selective_acks)
+		{
+			SendOldPacket(pl, seq);
+			continue;
+		}
+
+		// Start over with a new datagram once this one is full.
+		if (count > 0 &&
+		    bundle.cursize + COALESCED_HEADER_SIZE + old.data.cursize > MAX_UDP_SIZE)
+		{
+			SendCoalescedPacket(pl, first, count);
+			count = 0;
+		}
+
+		if (count == 0)
 		{
-			if (cl->oldpackets[seq & PACKET_OLD_MASK].sequence != seq)
-			{
-				// do full update
-				DPrintf("need full update\n");
-				cl->last_sequence = sequence;
-				return;
-			}
-
-			SendOldPacket(player, seq);
+			first = seq;
+			bundle.clear();
+			MSG_WriteLong(&bundle, seq);
+			MSG_WriteByte(&bundle, PacketFlags(*cl) | SVF_COALESCED);
 		}
+
+		MSG_WriteLong(&bundle, seq);
+		MSG_WriteShort(&bundle, old.data.cursize);
+		SZ_Write(&bundle, old.data.data, old.data.cursize);
+		cl->reliable_bps += old.data.cursize;
+		cl->rate_tokens -= old.data.cursize;
+		count++;
 	}
 
-	cl->last_sequence = sequence;
+	SendCoalescedPacket(pl, first, count);
+}
 
-	if (cl->last_sequence == 0)
+//
+// SV_UpdateRTT
+//
+// Fold a round trip time sample into the client's estimate, the same way
+// TCP does.
+//
+static void SV_UpdateRTT(client_t* cl, int rtt)
+{
+	if (cl->srtt < 0)
+	{
+		cl->srtt = rtt;
+		cl->rttvar = rtt / 2;
+	}
+	else
+	{
+		cl->rttvar = (3 * cl->rttvar + abs(cl->srtt - rtt)) / 4;
+		cl->srtt = (7 * cl->srtt + rtt) / 8;
+	}
+
+	cl->rto = clamp(cl->srtt + std::max(MIN_RTO, 4 * cl->rttvar), MIN_RTO, MAX_RTO);
+}
+
+//
+// SV_AcknowledgeSequence
+//
+static void SV_AcknowledgeSequence(player_t& player, int sequence, dtime_t now)
+{
+	client_t* cl = &player.client;
+
+	// Unused slots have a sequence of -1.
+	if (sequence < 0)
+		return;
+
+	client_t::oldPacket_t& old = cl->oldpackets[sequence & PACKET_OLD_MASK];
+	if (old.sequence != sequence || old.acked)
+		return;
+
+	old.acked = true;
+
+	// Only packets that were sent once tell how long the round trip was.
+	if (old.resends == 0)
+		SV_UpdateRTT(cl, static_cast<int>(now - old.sent));
+
+	cl->compressor.packet_acked(sequence);
+	SV_AcknowledgeMobjDeltas(player, sequence);
+
+	if (sequence > cl->last_sequence)
+		cl->last_sequence = sequence;
+}
+
+//
+// SV_AcknowledgePacket
+//
+// A single packet was received, older clients acknowledge every packet this
+// way.  Missing packets are sent again by SV_ResendReliable.
+//
+void SV_AcknowledgePacket(player_t &player)
+{
+	int sequence = MSG_ReadLong();
+
+	SV_AcknowledgeSequence(player, sequence, I_MSTime());
+
+	// Packet 0 can be acknowledged again when it was resent, or arrive late,
+	// only the first time finishes connecting.
+	if (sequence == 0 && player.playerstate == PST_CONTACT)
 	{
 		// [AM] Finish our connection sequence.
 		SV_ConnectClient2(player);
 	}
 }
 
+//
+// SV_AcknowledgePackets
+//
+// The newest packet received, and a bitfield of which of the 32 packets
+// before it were received too.
+//
+void SV_AcknowledgePackets(player_t &player)
+{
+	const int sequence = MSG_ReadLong();
+	const uint32_t bits = MSG_ReadLong();
+
+	player.client.selective_acks = true;
+
+	const dtime_t now = I_MSTime();
+	SV_AcknowledgeSequence(player, sequence, now);
+
+	for (int i = 0; i < 32; i++)
+	{
+		if (bits & (1U << i))
+			SV_AcknowledgeSequence(player, sequence - i - 1, now);
+	}
+}
+
+//
+// SV_ClearReliable
+//
+// Start the reliable channel over, for a newly connected client.
+//
+void SV_ClearReliable(client_t &cl)
+{
+	for (size_t i = 0; i < ARRAY_LENGTH(cl.oldpackets); i++)
+	{
+		cl.oldpackets[i].sequence = -1;
+		cl.oldpackets[i].resends = 0;
+		cl.oldpackets[i].acked = false;
+		SZ_Clear(&cl.oldpackets[i].data);
+	}
+
+	cl.sequence = 0;
+	cl.last_sequence = -1;
+	cl.oldest_unacked = 0;
+	cl.packetnum = 0;
+
+	cl.selective_acks = false;
+	cl.srtt = -1;
+	cl.rttvar = 0;
+	cl.rto = INITIAL_RTO;
+
+	cl.resent_packets = 0;
+	cl.dropped_packets = 0;
+}
+
+//
+// SV_CountUnsentPackets
+//
+// Packets the socket wouldn't take.  Their reliable part is still waiting
+// to be acknowledged, so it goes out again once its timeout runs out.
+//
+void SV_CountUnsentPackets(size_t count)
+{
+	unsent_packets += count;
+}
+
+BEGIN_COMMAND(reliablestats)
+{
+	unsigned long long resent = 0, dropped = 0;
+
+	for (Players::iterator it = players.begin(); it != players.end(); ++it)
+	{
+		const client_t& cl = it->client;
+		Printf(PRINT_HIGH,
+		       "%3d %-16s rtt %4dms rto %4dms, %u resent, %u dropped, "
+		       "%u bytes over rate%s\n",
+		       it->id, it->userinfo.netname.c_str(), std::max(cl.srtt, 0), cl.rto,
+		       cl.resent_packets, cl.dropped_packets, cl.throttled_bytes,
+		       cl.selective_acks ? "" : " (no selective acks)");
+
+		resent += cl.resent_packets;
+		dropped += cl.dropped_packets;
+	}
+
+	Printf(PRINT_HIGH, "Total: %llu resent, %llu dropped, %llu not sent\n", resent,
+	       dropped, unsent_packets);
+}
+END_COMMAND(reliablestats)
+
 VERSION_CONTROL (sv_rproto_cpp, "$Id$")
+
+struct CodecResult
+{
+	unsigned long long in_bytes, out_bytes, small_in, small_out;
+	dtime_t compress_time, decompress_time;
+	bool failed;
+
+	CodecResult()
+	    : in_bytes(0), out_bytes(0), small_in(0), small_out(0), compress_time(0),
+	      decompress_time(0), failed(false)
+	{
+	}
+
+	void add(size_t in, size_t out)
+	{
+		in_bytes += in;
+		out_bytes += out;
+		if (in < MINILZO_COMPRESS_MINPACKETSIZE)
+		{
+			small_in += in;
+			small_out += out;
+		}
+	}
+};
+
+static void PrintCodecResult(const char* name, const CodecResult& res, int rounds)
+{
+	const double bytes = static_cast<double>(res.in_bytes) * rounds;
+
+	Printf(PRINT_HIGH, "%-8s %6.1f%% %6.1f%% %7.2f ns/byte %7.2f ns/byte%s\n", name,
+	       res.in_bytes ? 100.0 * res.out_bytes / res.in_bytes : 0.0,
+	       res.small_in ? 100.0 * res.small_out / res.small_in : 0.0,
+	       res.compress_time / bytes, res.decompress_time / bytes,
+	       res.failed ? " (round trip FAILED)" : "");
+}
+
+//
+// netcodecbench
+//
+// Compress the sampled packets with both codecs, without the minimum size
+// minilzo is normally held to.  Ratios are compressed size over original
+// size, lower is better.
+//
+BEGIN_COMMAND(netcodecbench)
+{
+	if (codec_samples.empty())
+	{
+		Printf(PRINT_HIGH, "No packets have been sampled yet.\n");
+		return;
+	}
+
+	const int rounds = argc > 1 ? clamp(atoi(argv[1]), 1, 1000) : 20;
+
+	std::vector<byte> packed(MAX_UDP_PACKET * 2), unpacked(MAX_UDP_PACKET * 2);
+	std::vector<byte> workmem(LZO1X_1_MEM_COMPRESS);
+
+	CodecResult lzo, huff;
+	size_t total = 0;
+
+	for (size_t i = 0; i < codec_samples.size(); i++)
+	{
+		byte* data = reinterpret_cast<byte*>(&codec_samples[i][0]);
+		const size_t len = codec_samples[i].size();
+		if (len == 0)
+			continue;
+
+		total += len;
+
+		lzo_uint lzo_len = 0;
+		dtime_t start = I_GetTime();
+		for (int r = 0; r < rounds; r++)
+			lzo1x_1_compress(data, len, &packed[0], &lzo_len, &workmem[0]);
+		lzo.compress_time += I_GetTime() - start;
+		lzo.add(len, lzo_len);
+
+		lzo_uint lzo_out = 0;
+		start = I_GetTime();
+		for (int r = 0; r < rounds; r++)
+		{
+			lzo_out = unpacked.size();
+			lzo1x_decompress_safe(&packed[0], lzo_len, &unpacked[0], &lzo_out, NULL);
+		}
+		lzo.decompress_time += I_GetTime() - start;
+		if (lzo_out != len || memcmp(&unpacked[0], data, len) != 0)
+			lzo.failed = true;
+
+		size_t huff_len = 0;
+		start = I_GetTime();
+		for (int r = 0; r < rounds; r++)
+		{
+			huff_len = packed.size();
+			protocol_huffman.compress(data, len, &packed[0], huff_len);
+		}
+		huff.compress_time += I_GetTime() - start;
+		huff.add(len, huff_len);
+
+		size_t huff_out = 0;
+		start = I_GetTime();
+		for (int r = 0; r < rounds; r++)
+		{
+			huff_out = unpacked.size();
+			protocol_huffman.decompress(&packed[0], huff_len, &unpacked[0], huff_out);
+		}
+		huff.decompress_time += I_GetTime() - start;
+		if (huff_out != len || memcmp(&unpacked[0], data, len) != 0)
+			huff.failed = true;
+	}
+
+	Printf(PRINT_HIGH, "%" PRIuSIZE " packets, %" PRIuSIZE " bytes, %d rounds\n",
+	       codec_samples.size(), total, rounds);
+	Printf(PRINT_HIGH, "Codec     Ratio  Small  Compress         Decompress\n");
+	PrintCodecResult("minilzo", lzo, rounds);
+	PrintCodecResult("huffman", huff, rounds);
+}
+END_COMMAND(netcodecbench)
+
+//
+// netcodecmodel
+//
+// Print the byte frequencies of the sampled packets in the layout of the
+// protocol model in huffman.cpp.
+//
+BEGIN_COMMAND(netcodecmodel)
+{
+	if (argc > 1 && stricmp(argv[1], "reset") == 0)
+	{
+		codec_samples.clear();
+		codec_packets = 0;
+		memset(codec_histogram, 0, sizeof(codec_histogram));
+		Printf(PRINT_HIGH, "Sampled packets cleared.\n");
+		return;
+	}
+
+	unsigned long long most = 0;
+	for (size_t i = 0; i < ARRAY_LENGTH(codec_histogram); i++)
+		most = std::max(most, codec_histogram[i]);
+
+	if (most == 0)
+	{
+		Printf(PRINT_HIGH, "No packets have been sampled yet.\n");
+		return;
+	}
+
+	for (size_t i = 0; i < ARRAY_LENGTH(codec_histogram); i += 16)
+	{
+		std::string line, entry;
+		for (size_t j = i; j < i + 16; j++)
+		{
+			const unsigned long long count =
+			    std::max(codec_histogram[j] * 65535 / most, 1ULL);
+			StrFormat(entry, "%llu%s", count, j == 255 ? "" : ", ");
+			line += entry;
+		}
+		Printf(PRINT_HIGH, "%s\n", line.c_str());
+	}
+}
+END_COMMAND(netcodecmodel)
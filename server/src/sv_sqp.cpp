@@ -26,8 +26,14 @@
 
 #include "sv_sqp.h"
 
+#include <algorithm>
+#include <list>
+#include <map>
+
+#include "c_dispatch.h"
 #include "d_main.h"
 #include "d_player.h"
+#include "i_system.h"
 #include "md5.h"
 #include "p_ctf.h"
 #include "g_gametype.h"
@@ -37,6 +43,7 @@ static buf_t ml_message(MAX_UDP_PACKET);
 EXTERN_CVAR(join_password)
 EXTERN_CVAR(sv_timelimit)
 EXTERN_CVAR(sv_teamsinplay)
+EXTERN_CVAR(sv_querylimit)
 
 struct CvarField_t
 {
@@ -68,18 +75,191 @@ struct CvarField_t
 #define QRYRANGEINFO(INTRODUCED,REMOVED) \
     if (EqProtocolVersion >= INTRODUCED && EqProtocolVersion < REMOVED)
 
+// Built responses are kept per enquirer protocol version.  A response is
+// reused until SV_QryInvalidate is called or the scoreboard changes.
+struct QueryCache_t
+{
+	bool valid;
+	unsigned int version;
+	DWORD state;
+	std::vector<byte> data;
+};
+
+static QueryCache_t query_cache[PROTOCOL_VERSION + 1];
+static unsigned int query_version = 0;
+
+// Addresses in the order they last sent a query, most recent last.
+typedef std::list<DWORD> QuerySources;
+
+// Queries allowed from one address, refilled at sv_querylimit per second.
+struct QueryBucket_t
+{
+	int tokens;         // thousandths of a query
+	dtime_t refilled;   // in ms
+	QuerySources::iterator source;
+};
+
+typedef std::map<DWORD, QueryBucket_t> QueryBuckets;
+
+// Past this many addresses, the one that has been quiet the longest is
+// forgotten to make room for a new one.
+static const size_t MAX_QUERY_SOURCES = 4096;
+
+static QueryBuckets query_buckets;
+static QuerySources query_sources;
+
+static struct
+{
+	unsigned long long hits, builds, dropped;
+} query_stats = {0, 0, 0};
+
+//
+// IntQryTimeLeft()
+//
+static int IntQryTimeLeft()
+{
+	int timeleft = (int)(sv_timelimit - level.time/(TICRATE*60));
+
+	if(timeleft < 0)
+		timeleft = 0;
+
+	return timeleft;
+}
+
+//
+// IntQryTimeInGame()
+//
+static int IntQryTimeInGame(const player_t &player)
+{
+	int timeingame = (time(NULL) - player.JoinTime) / 60;
+
+	if(timeingame < 0)
+		timeingame = 0;
+
+	return timeingame;
+}
+
+//
+// IntQryIsSpectator()
+//
+static bool IntQryIsSpectator(const player_t &player)
+{
+	// FIXME - Treat non-players (downloaders/others) as spectators too for now
+	return (player.spectator ||
+	        ((player.playerstate != PST_LIVE) &&
+	         (player.playerstate != PST_DEAD) &&
+	         (player.playerstate != PST_REBORN)));
+}
+
+//
+// IntQryState()
+//
+// Hash of the parts of a response that change during play without going
+// through SV_QryInvalidate, such as scores and pings.
+static DWORD IntQryState()
+{
+	DWORD hash = 2166136261u;
+
+#define QRYHASH(X) hash = (hash ^ (DWORD)(X)) * 16777619u
+
+	QRYHASH(IntQryTimeLeft());
+
+	if(G_IsTeamGame())
+	{
+		int teams = sv_teamsinplay.asInt();
+		for (int i = 0; i < teams; i++)
+			QRYHASH(GetTeamInfo((team_t)i)->Points);
+	}
+
+	QRYHASH(players.size());
+
+	for(Players::iterator it = players.begin(); it != players.end(); ++it)
+	{
+		QRYHASH(it->id);
+		QRYHASH(it->userinfo.team);
+		QRYHASH(it->ping);
+		QRYHASH(IntQryTimeInGame(*it));
+		QRYHASH(IntQryIsSpectator(*it));
+		QRYHASH(it->fragcount);
+		QRYHASH(it->killcount);
+		QRYHASH(it->deathcount);
+	}
+
+#undef QRYHASH
+
+	return hash;
+}
+
+//
+// IntQryAllowQuery()
+//
+// Token bucket per source address, so a flood of queries can't take up the
+// server's time.
+static bool IntQryAllowQuery(const netadr_t &address)
+{
+	const int limit = sv_querylimit.asInt();
+	if (limit <= 0)
+		return true;
+
+	// Up to two seconds worth of queries may come in at once.
+	const int capacity = limit * 2000;
+	const dtime_t now = I_MSTime();
+
+	const DWORD ip = (static_cast<uint32_t>(address.ip[0]) << 24) |
+	                 (static_cast<uint32_t>(address.ip[1]) << 16) |
+	                 (static_cast<uint32_t>(address.ip[2]) << 8) |
+	                 static_cast<uint32_t>(address.ip[3]);
+
+	QueryBuckets::iterator it = query_buckets.find(ip);
+	if (it == query_buckets.end())
+	{
+		// A flood from many addresses only pushes out the quietest ones,
+		// it can't lock anybody out.
+		if (query_buckets.size() >= MAX_QUERY_SOURCES)
+		{
+			query_buckets.erase(query_sources.front());
+			query_sources.pop_front();
+		}
+
+		QueryBucket_t bucket = {capacity, now,
+		                        query_sources.insert(query_sources.end(), ip)};
+		it = query_buckets.insert(std::make_pair(ip, bucket)).first;
+	}
+	else
+	{
+		query_sources.splice(query_sources.end(), query_sources, it->second.source);
+	}
+
+	QueryBucket_t &bucket = it->second;
+	const dtime_t elapsed = now - bucket.refilled;
+	bucket.tokens = (int)std::min<dtime_t>(capacity, bucket.tokens + elapsed * limit);
+	bucket.refilled = now;
+
+	if (bucket.tokens < 1000)
+		return false;
+
+	bucket.tokens -= 1000;
+	return true;
+}
+
+//
+// SV_QryInvalidate()
+//
+// Server info, cvars or player details changed, so launchers need to be
+// sent a new response.
+void SV_QryInvalidate()
+{
+	query_version++;
+}
+
 //
 // IntQryBuildInformation()
 //
 // Protocol building routine, the passed parameter is the enquirer version
-static void IntQryBuildInformation(const DWORD& EqProtocolVersion,
-                                   const DWORD& EqTime)
+static void IntQryBuildInformation(const DWORD& EqProtocolVersion)
 {
 	std::vector<CvarField_t> Cvars;
 
-	// bond - time
-	MSG_WriteLong(&ml_message, EqTime);
-
 	// The servers real protocol version
 	// bond - real protocol
 	MSG_WriteLong(&ml_message, PROTOCOL_VERSION);
@@ -172,10 +352,7 @@ next:
 
 	MSG_WriteString(&ml_message, level.mapname.c_str());
 
-	int timeleft = (int)(sv_timelimit - level.time/(TICRATE*60));
-
-	if(timeleft < 0)
-		timeleft = 0;
+	int timeleft = IntQryTimeLeft();
 
 	// TODO: Remove guard on next release and reset protocol version
 	// TODO: Incorporate code above into block
@@ -238,22 +415,9 @@ next:
 
 		MSG_WriteShort(&ml_message, it->ping);
 
-		int timeingame = (time(NULL) - it->JoinTime) / 60;
-
-		if(timeingame < 0)
-			timeingame = 0;
-
-		MSG_WriteShort(&ml_message, timeingame);
+		MSG_WriteShort(&ml_message, IntQryTimeInGame(*it));
 
-		// FIXME - Treat non-players (downloaders/others) as spectators too for now
-		bool spectator;
-
-		spectator = (it->spectator ||
-					 ((it->playerstate != PST_LIVE) &&
-					  (it->playerstate != PST_DEAD) &&
-					  (it->playerstate != PST_REBORN)));
-
-		MSG_WriteBool(&ml_message, spectator);
+		MSG_WriteBool(&ml_message, IntQryIsSpectator(*it));
 
 		MSG_WriteShort(&ml_message, it->fragcount);
 		MSG_WriteShort(&ml_message, it->killcount);
@@ -391,7 +555,30 @@ static DWORD IntQrySendResponse(const WORD& TagId,
 	else
 		MSG_WriteLong(&ml_message, EqProtocolVersion);
 
-	IntQryBuildInformation(EqProtocolVersion, EqTime);
+	// bond - time
+	MSG_WriteLong(&ml_message, EqTime);
+
+	// Everything after the time can be reused
+	QueryCache_t &cache = query_cache[EqProtocolVersion];
+	const DWORD state = IntQryState();
+
+	if (cache.valid && cache.version == query_version && cache.state == state)
+	{
+		SZ_Write(&ml_message, &cache.data[0], cache.data.size());
+		query_stats.hits++;
+	}
+	else
+	{
+		const size_t start = ml_message.size();
+
+		IntQryBuildInformation(EqProtocolVersion);
+
+		cache.data.assign(ml_message.data + start, ml_message.data + ml_message.size());
+		cache.valid = !ml_message.overflowed;
+		cache.version = query_version;
+		cache.state = state;
+		query_stats.builds++;
+	}
 
 	NET_SendPacket(ml_message, net_from);
 
@@ -419,7 +606,30 @@ DWORD SV_QryParseEnquiry(const DWORD& Tag)
 		return 1;
 	}
 
+	// Too many queries from this address, ignore it
+	if(!IntQryAllowQuery(net_from))
+	{
+		query_stats.dropped++;
+		return 0;
+	}
+
 	return IntQrySendResponse(TagId, TagApplication, TagQRId, TagPacketType);
 }
 
+BEGIN_COMMAND(querystats)
+{
+	if (argc > 1 && stricmp(argv[1], "reset") == 0)
+	{
+		query_stats.hits = query_stats.builds = query_stats.dropped = 0;
+		Printf(PRINT_HIGH, "Query statistics reset.\n");
+		return;
+	}
+
+	Printf(PRINT_HIGH, "%llu responses reused, %llu built, %llu queries dropped, "
+	       "%" PRIuSIZE " addresses tracked\n",
+	       query_stats.hits, query_stats.builds, query_stats.dropped,
+	       query_buckets.size());
+}
+END_COMMAND(querystats)
+
 VERSION_CONTROL(sv_sqp_cpp, "$Id$")
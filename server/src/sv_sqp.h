@@ -23,3 +23,4 @@
 #pragma once
 
 DWORD SV_QryParseEnquiry(const DWORD &Tag);
+void SV_QryInvalidate();
@@ -0,0 +1,350 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2024 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Waiting between tics.  On Linux the server sleeps in epoll on the game
+//  socket and stdin, with a timerfd set to when the next tic is due, so
+//  packets are read as soon as they arrive and the tic starts on time no
+//  matter how busy the socket is.  Elsewhere it sleeps in 1ms steps like
+//  before.
+//
+//-----------------------------------------------------------------------------
+
+
+#include "odamex.h"
+
+#include "sv_ticloop.h"
+
+#ifdef ODA_HAVE_EPOLL
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+#include "c_dispatch.h"
+#include "i_net.h"
+#include "i_system.h"
+
+void SV_GetPackets();
+
+namespace
+{
+
+// Upper bounds of the tic start lateness buckets, in microseconds.
+const dtime_t jitter_bounds[] = {50, 100, 250, 500, 1000, 2000, 5000, 10000};
+const size_t NUM_JITTER_BUCKETS = ARRAY_LENGTH(jitter_bounds) + 1;
+
+// Upper bounds of the tic duration buckets, in percent of a tic.
+const dtime_t load_bounds[] = {10, 25, 50, 75, 100, 150, 200};
+const size_t NUM_LOAD_BUCKETS = ARRAY_LENGTH(load_bounds) + 1;
+
+struct TicStats
+{
+	unsigned long long jitter[NUM_JITTER_BUCKETS];
+	unsigned long long load[NUM_LOAD_BUCKETS];
+	unsigned long long tics, overruns, early_wakes;
+	dtime_t max_jitter, max_tic_time, total_tic_time;
+};
+
+TicStats stats;
+dtime_t tic_start = 0;
+
+#ifdef ODA_HAVE_EPOLL
+
+enum
+{
+	EVENT_TIMER,
+	EVENT_SOCKET,
+	EVENT_CONSOLE
+};
+
+bool epoll_tried = false;
+int epoll_fd = -1;
+int timer_fd = -1;
+bool console_polled = false;
+
+#endif
+
+} // namespace
+
+static size_t SV_HistogramBucket(const dtime_t* bounds, size_t count, dtime_t value)
+{
+	size_t i = 0;
+	while (i < count && value > bounds[i])
+		i++;
+	return i;
+}
+
+static void SV_RecordJitter(dtime_t late)
+{
+	const dtime_t us = late / 1000;
+	stats.jitter[SV_HistogramBucket(jitter_bounds, ARRAY_LENGTH(jitter_bounds), us)]++;
+	stats.max_jitter = std::max(stats.max_jitter, late);
+}
+
+#ifdef ODA_HAVE_EPOLL
+
+static bool SV_AddEpollFd(int fd, int event)
+{
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = event;
+	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+static void SV_CloseEpoll()
+{
+	if (timer_fd != -1)
+		close(timer_fd);
+	if (epoll_fd != -1)
+		close(epoll_fd);
+
+	timer_fd = epoll_fd = -1;
+}
+
+//
+// SV_InitEpoll
+//
+// Returns false if the server has to fall back to sleeping.
+//
+static bool SV_InitEpoll()
+{
+	if (epoll_tried)
+		return epoll_fd != -1;
+
+	epoll_tried = true;
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	const int sock = NET_GetSocket();
+	if (epoll_fd == -1 || timer_fd == -1 || !SV_AddEpollFd(timer_fd, EVENT_TIMER) ||
+	    !SV_AddEpollFd(sock, EVENT_SOCKET))
+	{
+		Printf(PRINT_WARNING, "Could not set up epoll (%s), sleeping between tics "
+		       "instead.\n", strerror(errno));
+		SV_CloseEpoll();
+		return false;
+	}
+
+	// Regular files can't be added to epoll, their input is read every tic
+	// anyway.  Nor can stdin if it's the socket we're already waiting on.
+	struct stat st;
+	const bool regular = fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode);
+	if (!regular && sock != STDIN_FILENO)
+		console_polled = SV_AddEpollFd(STDIN_FILENO, EVENT_CONSOLE);
+
+	atterm(SV_CloseEpoll);
+	return true;
+}
+
+//
+// SV_HandleConsoleEvent
+//
+static void SV_HandleConsoleEvent()
+{
+	int available = 0;
+	if (ioctl(STDIN_FILENO, FIONREAD, &available) == -1 || available == 0)
+	{
+		// End of input, stop waking up for it.
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+		console_polled = false;
+		return;
+	}
+
+	std::string cmd = I_ConsoleInput();
+	if (cmd.length())
+		AddCommandString(cmd);
+}
+
+//
+// SV_WaitWithEpoll
+//
+// Returns false if waiting went wrong and the server should fall back to
+// sleeping.
+//
+static bool SV_WaitWithEpoll(dtime_t wake_time)
+{
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = wake_time / (1000LL * 1000LL * 1000LL);
+	its.it_value.tv_nsec = wake_time % (1000LL * 1000LL * 1000LL);
+
+	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+		return false;
+
+	for (;;)
+	{
+		struct epoll_event events[4];
+		const int count = epoll_wait(epoll_fd, events, ARRAY_LENGTH(events), -1);
+		if (count == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		bool tic_due = false;
+		for (int i = 0; i < count; i++)
+		{
+			switch (events[i].data.u32)
+			{
+			case EVENT_TIMER:
+			{
+				uint64_t expirations;
+				if (read(timer_fd, &expirations, sizeof(expirations)) > 0)
+					tic_due = true;
+				break;
+			}
+			case EVENT_SOCKET:
+				stats.early_wakes++;
+				SV_GetPackets();
+				break;
+			case EVENT_CONSOLE:
+				SV_HandleConsoleEvent();
+				break;
+			}
+		}
+
+		if (tic_due || I_GetTime() >= wake_time)
+			return true;
+	}
+}
+
+#endif
+
+//
+// SV_WaitForNextTic
+//
+// Sleep until wake_time, which is on the same clock as I_GetTime.
+//
+void SV_WaitForNextTic(dtime_t wake_time)
+{
+	// Already past the wake time, so the next tic starts this late.
+	const dtime_t start = I_GetTime();
+	if (start >= wake_time)
+	{
+		SV_RecordJitter(start - wake_time);
+		return;
+	}
+
+#ifdef ODA_HAVE_EPOLL
+	if (SV_InitEpoll())
+	{
+		if (SV_WaitWithEpoll(wake_time))
+		{
+			SV_RecordJitter(I_GetTime() - wake_time);
+			return;
+		}
+
+		Printf(PRINT_WARNING, "Waiting in epoll failed (%s), sleeping between tics "
+		       "instead.\n", strerror(errno));
+		SV_CloseEpoll();
+	}
+#endif
+
+	const dtime_t max_sleep_amount = 1000LL * 1000LL;	// 1ms
+
+	// Sleep in 1ms increments until the next scheduled task
+	dtime_t now;
+	for (now = I_GetTime(); wake_time > now; now = I_GetTime())
+	{
+		dtime_t sleep_amount = std::min<dtime_t>(max_sleep_amount, wake_time - now);
+		I_Sleep(sleep_amount);
+	}
+
+	SV_RecordJitter(now - wake_time);
+}
+
+//
+// SV_TicStarted
+//
+void SV_TicStarted()
+{
+	tic_start = I_GetTime();
+}
+
+//
+// SV_TicFinished
+//
+// Record how much of its time slot the tic took up.
+//
+void SV_TicFinished()
+{
+	const dtime_t elapsed = I_GetTime() - tic_start;
+	const dtime_t budget = I_ConvertTimeFromMs(1000) / TICRATE;
+	const dtime_t percent = elapsed * 100 / budget;
+
+	stats.load[SV_HistogramBucket(load_bounds, ARRAY_LENGTH(load_bounds), percent)]++;
+	stats.tics++;
+	stats.total_tic_time += elapsed;
+	stats.max_tic_time = std::max(stats.max_tic_time, elapsed);
+
+	if (elapsed > budget)
+		stats.overruns++;
+}
+
+static void PrintHistogram(const char* unit, const dtime_t* bounds, size_t count,
+                           const unsigned long long* buckets, unsigned long long total)
+{
+	for (size_t i = 0; i <= count; i++)
+	{
+		const double share = total ? 100.0 * buckets[i] / total : 0.0;
+
+		if (i < count)
+			Printf(PRINT_HIGH, "  <= %5llu%-2s %10llu (%5.1f%%)\n",
+			       (unsigned long long)bounds[i], unit, buckets[i], share);
+		else
+			Printf(PRINT_HIGH, "   > %5llu%-2s %10llu (%5.1f%%)\n",
+			       (unsigned long long)bounds[i - 1], unit, buckets[i], share);
+	}
+}
+
+BEGIN_COMMAND(ticstats)
+{
+	if (argc > 1 && stricmp(argv[1], "reset") == 0)
+	{
+		memset(&stats, 0, sizeof(stats));
+		Printf(PRINT_HIGH, "Tic statistics reset.\n");
+		return;
+	}
+
+	unsigned long long woken = 0;
+	for (size_t i = 0; i < NUM_JITTER_BUCKETS; i++)
+		woken += stats.jitter[i];
+
+#ifdef ODA_HAVE_EPOLL
+	const char* method = epoll_fd != -1 ? "epoll" : "sleep";
+#else
+	const char* method = "sleep";
+#endif
+
+	Printf(PRINT_HIGH, "Tic start lateness (%s, %llu early wakeups, %.3fms max):\n",
+	       method, stats.early_wakes, stats.max_jitter / 1000000.0);
+	PrintHistogram("us", jitter_bounds, ARRAY_LENGTH(jitter_bounds), stats.jitter,
+	               woken);
+
+	Printf(PRINT_HIGH, "Tic duration (%llu tics, %llu overruns, %.3fms average, "
+	       "%.3fms max):\n", stats.tics, stats.overruns,
+	       stats.tics ? stats.total_tic_time / 1000000.0 / stats.tics : 0.0,
+	       stats.max_tic_time / 1000000.0);
+	PrintHistogram("%", load_bounds, ARRAY_LENGTH(load_bounds), stats.load, stats.tics);
+}
+END_COMMAND(ticstats)
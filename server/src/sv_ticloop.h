@@ -0,0 +1,32 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2024 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Waiting between tics.  Packets and console input are handled as they
+//  come in, and how late tics start and how long they take is recorded.
+//
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#ifdef __linux__
+	#define ODA_HAVE_EPOLL
+#endif
+
+void SV_WaitForNextTic(dtime_t wake_time);
+void SV_TicStarted();
+void SV_TicFinished();
@@ -0,0 +1,265 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2024 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Worker pool for per-client network output.  Game logic stays on the
+//  main thread, only work that reads the world and writes to a single
+//  client's buffers may be handed to SV_RunPlayerJobs.
+//
+//  Without pthreads, or with sv_workerthreads set to 0, jobs simply run
+//  one after the other on the main thread.
+//
+//-----------------------------------------------------------------------------
+
+
+#include "odamex.h"
+
+#include "sv_workers.h"
+
+#include "i_system.h"
+
+EXTERN_CVAR(sv_workerthreads)
+
+namespace
+{
+
+bool in_jobs = false;
+
+#ifdef ODA_HAVE_WORKERS
+
+// Held by WorkerLock.
+pthread_mutex_t shared_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Protects the pool itself.
+pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+
+pthread_key_t worker_key;
+pthread_once_t worker_key_once = PTHREAD_ONCE_INIT;
+
+pthread_t threads[MAX_WORKER_THREADS];
+size_t num_threads = 0;
+size_t requested_threads = 0;
+bool quitting = false;
+
+// The batch of jobs being worked on.  Workers pick players off the list
+// until there are none left.
+PlayerJob current_job = NULL;
+const std::vector<player_t*>* current_players = NULL;
+size_t next_player = 0;
+unsigned int generation = 0;
+size_t busy_workers = 0;
+
+// The generation when the workers were started.  A worker that is slow to
+// get going still picks up any batch handed out after this.
+unsigned int start_generation = 0;
+
+#endif
+
+} // namespace
+
+#ifdef ODA_HAVE_WORKERS
+
+static void SV_CreateWorkerKey()
+{
+	pthread_key_create(&worker_key, NULL);
+}
+
+static void SV_DoPlayerJobs()
+{
+	for (;;)
+	{
+		const size_t i = __sync_fetch_and_add(&next_player, 1);
+		if (i >= current_players->size())
+			break;
+
+		current_job(*(*current_players)[i]);
+	}
+}
+
+static void* SV_WorkerThread(void* arg)
+{
+	pthread_setspecific(worker_key, arg);
+
+	pthread_mutex_lock(&pool_mutex);
+
+	unsigned int seen = start_generation;
+	for (;;)
+	{
+		while (!quitting && seen == generation)
+			pthread_cond_wait(&work_ready, &pool_mutex);
+
+		if (quitting)
+			break;
+
+		seen = generation;
+		pthread_mutex_unlock(&pool_mutex);
+
+		SV_DoPlayerJobs();
+
+		pthread_mutex_lock(&pool_mutex);
+		if (--busy_workers == 0)
+			pthread_cond_signal(&work_done);
+	}
+
+	pthread_mutex_unlock(&pool_mutex);
+	return NULL;
+}
+
+static void SV_StartWorkers(size_t count)
+{
+	SV_ShutdownWorkers();
+	requested_threads = count;
+
+	pthread_once(&worker_key_once, SV_CreateWorkerKey);
+
+	static bool registered = false;
+	if (!registered)
+	{
+		atterm(SV_ShutdownWorkers);
+		registered = true;
+	}
+
+	quitting = false;
+	start_generation = generation;
+	for (num_threads = 0; num_threads < count; num_threads++)
+	{
+		// Worker indexes start at 1, the main thread is 0.
+		void* index = reinterpret_cast<void*>(num_threads + 1);
+		if (pthread_create(&threads[num_threads], NULL, SV_WorkerThread, index) != 0)
+		{
+			Printf(PRINT_WARNING, "Could only start %" PRIuSIZE " of %" PRIuSIZE
+			       " worker threads.\n", num_threads, count);
+			break;
+		}
+	}
+}
+
+#endif
+
+//
+// SV_ShutdownWorkers
+//
+void SV_ShutdownWorkers()
+{
+#ifdef ODA_HAVE_WORKERS
+	if (num_threads == 0)
+		return;
+
+	pthread_mutex_lock(&pool_mutex);
+	quitting = true;
+	pthread_cond_broadcast(&work_ready);
+	pthread_mutex_unlock(&pool_mutex);
+
+	for (size_t i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	num_threads = 0;
+#endif
+}
+
+//
+// SV_RunPlayerJobs
+//
+// Run a job for every player in the list and wait for all of them to
+// finish.  Which thread a player is handled on is not defined, but each
+// player is only ever handled by one thread.
+//
+void SV_RunPlayerJobs(PlayerJob job, const std::vector<player_t*>& jobplayers)
+{
+	in_jobs = true;
+
+#ifdef ODA_HAVE_WORKERS
+	const size_t wanted = clamp(sv_workerthreads.asInt(), 0, MAX_WORKER_THREADS);
+	if (wanted != requested_threads)
+		SV_StartWorkers(wanted);
+
+	if (num_threads > 0 && jobplayers.size() > 1)
+	{
+		pthread_mutex_lock(&pool_mutex);
+		current_job = job;
+		current_players = &jobplayers;
+		next_player = 0;
+		busy_workers = num_threads;
+		generation++;
+		pthread_cond_broadcast(&work_ready);
+		pthread_mutex_unlock(&pool_mutex);
+
+		// Lend a hand instead of sitting idle.
+		SV_DoPlayerJobs();
+
+		pthread_mutex_lock(&pool_mutex);
+		while (busy_workers > 0)
+			pthread_cond_wait(&work_done, &pool_mutex);
+		pthread_mutex_unlock(&pool_mutex);
+
+		in_jobs = false;
+		return;
+	}
+#endif
+
+	for (size_t i = 0; i < jobplayers.size(); i++)
+		job(*jobplayers[i]);
+
+	in_jobs = false;
+}
+
+//
+// SV_InPlayerJobs
+//
+// Returns true while player jobs are running, on any thread.
+//
+bool SV_InPlayerJobs()
+{
+	return in_jobs;
+}
+
+//
+// SV_WorkerIndex
+//
+// Returns 0 on the main thread and 1 to MAX_WORKER_THREADS on workers, for
+// indexing per-thread scratch space.
+//
+size_t SV_WorkerIndex()
+{
+#ifdef ODA_HAVE_WORKERS
+	if (num_threads > 0)
+		return reinterpret_cast<size_t>(pthread_getspecific(worker_key));
+#endif
+
+	return 0;
+}
+
+WorkerLock::WorkerLock() : m_locked(false)
+{
+#ifdef ODA_HAVE_WORKERS
+	if (in_jobs && num_threads > 0)
+	{
+		pthread_mutex_lock(&shared_mutex);
+		m_locked = true;
+	}
+#endif
+}
+
+WorkerLock::~WorkerLock()
+{
+#ifdef ODA_HAVE_WORKERS
+	if (m_locked)
+		pthread_mutex_unlock(&shared_mutex);
+#endif
+}
@@ -0,0 +1,62 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// $Id$
+//
+// Copyright (C) 2006-2024 by The Odamex Team.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//  Worker pool for per-client network output.  Game logic stays on the
+//  main thread, only work that reads the world and writes to a single
+//  client's buffers may be handed to SV_RunPlayerJobs.
+//
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include "d_player.h"
+
+#ifdef UNIX
+	#include <pthread.h>
+	#define ODA_HAVE_WORKERS
+#endif
+
+// Worker threads that can run at once, not counting the main thread.
+#define MAX_WORKER_THREADS 16
+
+typedef void (*PlayerJob)(player_t& player);
+
+void SV_RunPlayerJobs(PlayerJob job, const std::vector<player_t*>& jobplayers);
+void SV_ShutdownWorkers();
+
+bool SV_InPlayerJobs();
+size_t SV_WorkerIndex();
+
+//
+// WorkerLock
+//
+// Guards state shared between player jobs, such as the socket and the
+// console.  Does nothing when there are no worker threads.
+//
+class WorkerLock
+{
+  public:
+	WorkerLock();
+	~WorkerLock();
+
+  private:
+	bool m_locked;
+
+	WorkerLock(const WorkerLock&);
+	WorkerLock& operator=(const WorkerLock&);
+};
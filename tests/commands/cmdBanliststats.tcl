@@ -0,0 +1,79 @@
+#!/bin/bash
+# \
+exec tclsh "$0" "$@"
+
+source tests/commands/common.tcl
+
+proc reconnect {} {
+ client "disconnect"
+ client "reconnect"
+ wait 2
+}
+
+proc main {} {
+ global server client serverout clientout
+
+ wait 2
+
+ clear
+ server "clearbanlist"
+ server "clearexceptionlist"
+ server "banliststats"
+ expectEventually $serverout {^0 bans, 0 prefixes indexed, 0 checked one by one, 0 expiring$}
+ expectMatch $serverout {^0 exceptions, 0 prefixes indexed, 0 checked one by one$}
+
+ # ranges that only mask trailing octets are indexed by prefix, the rest
+ # are checked one by one
+ clear
+ server "addban 200.100.*.*"
+ server "addban 127.0.*.*"
+ server "addban 127.*.0.1"
+ server "banliststats"
+ expectEventually $serverout {^3 bans, 2 prefixes indexed, 1 checked one by one, 0 expiring$}
+
+ # banned through the prefix index
+ clear
+ server "clearbanlist"
+ server "addban 127.0.*.*"
+ reconnect
+ expectEventually $serverout {^127\.0\.0\.1:10501 is banned, dropping client\.$}
+
+ # banned through a range that isn't indexed
+ clear
+ server "clearbanlist"
+ server "addban 127.*.0.1"
+ reconnect
+ expectEventually $serverout {^127\.0\.0\.1:10501 is banned, dropping client\.$}
+
+ # an exception lets the client in anyway
+ clear
+ server "addexception 127.0.0.*"
+ reconnect
+ expectEventually $serverout {^Player has connected\.$}
+
+ # a range with a high first octet doesn't catch anybody else
+ clear
+ server "clearbanlist"
+ server "clearexceptionlist"
+ server "addban 200.100.*.*"
+ reconnect
+ expectEventually $serverout {^Player has connected\.$}
+
+ clear
+ server "banliststats"
+ expectEventually $serverout {^1 bans, 1 prefixes indexed, 0 checked one by one, 0 expiring$}
+ expectMatch $serverout {^0 exceptions, 0 prefixes indexed, 0 checked one by one$}
+ expectMatch $serverout {^[1-9][0-9]* lookups, [0-9.]+us average, [0-9.]+us max$}
+
+ server "clearbanlist"
+}
+
+start
+
+set error [catch { main }]
+
+if { $error } {
+ puts "FAIL Test crashed!"
+}
+
+end
@@ -0,0 +1,52 @@
+#!/bin/bash
+# \
+exec tclsh "$0" "$@"
+
+source tests/commands/common.tcl
+
+proc chunks {} {
+ global serverout
+
+ clear
+ server "dumpheap 0 0"
+ expectEventually $serverout {^Using the tagged arena allocator\.$}
+ set out [expectEventually $serverout {^chunks: [0-9]+ \(.*\), [0-9]+ retired, [0-9]+ peak$}]
+ regexp {^chunks: ([0-9]+) } $out -> count
+ return $count
+}
+
+proc main {} {
+ global server client serverout clientout
+
+ server "map 1"
+ wait 2
+ set before [chunks]
+
+ # level memory goes back a whole arena at a time when the level ends, so
+ # loading the same map over and over doesn't keep taking chunks
+ for {set i 0} {$i < 5} {incr i} {
+  server "map 1"
+  wait 1
+ }
+ set after [chunks]
+
+ if { $after <= $before } {
+  puts "PASS $after chunks after reloading, $before before"
+ } else {
+  puts "FAIL ($after chunks after reloading, $before before)"
+ }
+
+ clear
+ server "dumpheap 0 0"
+ expectEventually $serverout {^slab allocs: [0-9]+ new, [0-9]+ reused; [0-9]+ mallocs; [1-9][0-9]* arena releases$}
+}
+
+start
+
+set error [catch { main }]
+
+if { $error } {
+ puts "FAIL Test crashed!"
+}
+
+end
@@ -0,0 +1,41 @@
+#!/bin/bash
+# \
+exec tclsh "$0" "$@"
+
+source tests/commands/common.tcl
+
+proc main {} {
+ global server client serverout clientout
+
+ # monsters only move once somebody is in the game to wake them up
+ server "sv_gametype 0"
+ server "sv_skill 4"
+ server "map 1"
+ wait 3
+ client "join"
+ wait 2
+
+ clear
+ server "mobjdeltastats reset"
+ expectEventually $serverout {^Actor delta statistics reset\.$}
+
+ wait 10
+
+ # the client sends CLF_MOBJDELTA, so once it has acknowledged an actor
+ # the updates for it are deltas
+ clear
+ server "mobjdeltastats"
+ expectEventually $serverout {^Delta: [1-9][0-9]* updates, [1-9][0-9]* bytes \([0-9.]+ bytes average\)$}
+ expectMatch $serverout {^Full: [0-9]+ updates, [0-9]+ bytes \([0-9.]+ bytes average\)$}
+ expectMatch $serverout {^Untracked: [0-9]+ updates$}
+}
+
+start
+
+set error [catch { main }]
+
+if { $error } {
+ puts "FAIL Test crashed!"
+}
+
+end
@@ -0,0 +1,50 @@
+#!/bin/bash
+# \
+exec tclsh "$0" "$@"
+
+source tests/commands/common.tcl
+
+proc main {} {
+ global server client serverout clientout
+
+ # nothing but the player's own shots should take netids
+ server "sv_nomonsters 1"
+ server "map 1"
+ wait 2
+ client "join"
+ wait 2
+
+ # bullet puffs are gone again a moment after they spawn, and their
+ # netids are given back
+ client "+attack"
+ wait 2
+ client "-attack"
+ wait 2
+
+ clear
+ server "netidstats"
+ set out [expectEventually $serverout {^Next new netid [0-9]+, [1-9][0-9]* freed netids waiting to be reused$}]
+ regexp {^Next new netid ([0-9]+),} $out -> nextid
+
+ # the freed netids are handed out again once they have been unused for
+ # long enough, so a shorter burst doesn't need any new ones
+ wait 31
+ client "+attack"
+ wait 1
+ client "-attack"
+ wait 2
+
+ clear
+ server "netidstats"
+ expectEventually $serverout "^Next new netid $nextid, \[0-9\]+ freed netids waiting to be reused\$"
+}
+
+start
+
+set error [catch { main }]
+
+if { $error } {
+ puts "FAIL Test crashed!"
+}
+
+end
@@ -0,0 +1,38 @@
+#!/bin/bash
+# \
+exec tclsh "$0" "$@"
+
+source tests/commands/common.tcl
+
+proc main {} {
+ global server client serverout clientout
+
+ wait 2
+
+ # the client acknowledges with clc_ackbits once the server flags its
+ # packets with SVF_ACKBITS
+ clear
+ server "reliablestats"
+ expectEventually $serverout {^[0-9]+ Player rtt [0-9]+ms rto [0-9]+ms, [0-9]+ resent, [0-9]+ dropped, [0-9]+ bytes over rate$}
+ expectMatch $serverout {^Total: [0-9]+ resent, [0-9]+ dropped, [0-9]+ not sent$}
+
+ # the reliable channel starts over for a new connection
+ client "disconnect"
+ client "reconnect"
+ wait 3
+
+ clear
+ server "reliablestats"
+ expectEventually $serverout {^[0-9]+ Player rtt [0-9]+ms rto [0-9]+ms, [0-9]+ resent, 0 dropped, [0-9]+ bytes over rate$}
+ expectMatch $serverout {^Total: [0-9]+ resent, 0 dropped, [0-9]+ not sent$}
+}
+
+start
+
+set error [catch { main }]
+
+if { $error } {
+ puts "FAIL Test crashed!"
+}
+
+end
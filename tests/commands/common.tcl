@@ -121,6 +121,39 @@ proc expect { stream expected {excludeTimestamp 1} } {
  }
 }
 
+proc expectMatch { stream pattern {excludeTimestamp 1} } {
+ # strip the timestamp
+ set out [lrange [gets $stream] $excludeTimestamp end]
+ set out [join $out " "]
+ if { [regexp -- $pattern $out] } {
+  puts "PASS $pattern"
+ } else {
+  puts "FAIL ($pattern|$out)"
+ }
+}
+
+# skips lines until one matches, returns it without the timestamp or an
+# empty string if none did
+proc skipUntil { stream pattern {excludeTimestamp 1} } {
+ while { [gets $stream line] >= 0 } {
+  set out [join [lrange $line $excludeTimestamp end] " "]
+  if { [regexp -- $pattern $out] } {
+   return $out
+  }
+ }
+ return ""
+}
+
+proc expectEventually { stream pattern {excludeTimestamp 1} } {
+ set out [skipUntil $stream $pattern $excludeTimestamp]
+ if { $out != "" } {
+  puts "PASS $pattern"
+ } else {
+  puts "FAIL ($pattern|)"
+ }
+ return $out
+}
+
 proc test { cmd expect } {
  global server client serverout clientout
 